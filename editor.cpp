@@ -0,0 +1,7432 @@
+/** includes */
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <numeric>
+#include <string_view>
+#include <tuple>
+#include <utility>
+
+#include "editor.h"
+
+/** filetypes */
+
+std::vector<std::string> C_HL_extensions = {".c", ".h", ".cpp"};
+std::vector<std::string> C_HL_keywords = {
+    "switch", "if",    "while",     "for",     "break",   "continue",
+    "return", "else",  "struct",    "union",   "typedef", "static",
+    "enum",   "class", "case",      "int|",    "long|",   "double|",
+    "float|", "char|", "unsigned|", "signed|", "void|"};
+
+std::vector<editorSyntax> HLDB = {
+    editorSyntax{"c", C_HL_extensions, C_HL_keywords, "//",
+                 HL_HIGHLIGHT_NUMBERS | HL_HIGHLIGHT_STRINGS},
+};
+
+/** prototypes */
+
+void editorUpdateRow(editorRow& row, size_t changed_from = 0);
+void editorDamageRows(editorConfig& E, int top, int bottom);
+bool editorUndoLoadFile(editorConfig& E);
+void editorJumpToLine(editorConfig& E, long long line);
+void editorProcessKey(editorConfig& E, int c);
+void editorOperate(editorConfig& E, char op, char reg, int kind, int y, int x,
+                   int ty, int tx, long long shifts = 1);
+bool editorGoToBuffer(editorConfig& E, int number);
+bool editorParseCommand(editorConfig& E, const std::string& text,
+                        editorExCommand& ex);
+std::string editorWorkingDirectory(editorConfig& E);
+std::string editorAbsolutePath(editorConfig& E, const std::string& name);
+std::string editorShortPath(editorConfig& E, const std::string& path);
+
+/** terminal */
+
+bool editorInputPending(editorConfig& E) {
+    if (E.terminal.input_fd == -1) return false;
+    struct pollfd fd = {E.terminal.input_fd, POLLIN, 0};
+    return poll(&fd, 1, 0) > 0;
+}
+
+// a terminal that can't be read any more gives escapes, with quit and error
+// set for the front end to act on
+int editorReadKey(editorConfig& E) {
+    int fd = E.terminal.input_fd;
+    if (fd == -1 || E.error != 0) return '\x1b';
+    ssize_t nread;
+    char c;
+    while ((nread = read(fd, &c, 1)) != 1) {
+        if (nread == -1 && errno != EAGAIN && errno != EINTR) {
+            E.error = errno;
+            E.quit = true;
+            return '\x1b';
+        }
+    }
+    if (c == '\x1b') {
+        char seq[3];
+        if (read(fd, &seq[0], 1) != 1) return '\x1b';
+        if (read(fd, &seq[1], 1) != 1) return '\x1b';
+        if (seq[0] == '[') {
+            if (seq[1] >= '0' && seq[1] <= '9') {
+                if (read(fd, &seq[2], 1) != 1) return '\x1b';
+                if (seq[2] == '~') {
+                    switch (seq[1]) {
+                        case '1':
+                            return HOME_KEY;
+                        case '3':
+                            return DEL_KEY;
+                        case '4':
+                            return END_KEY;
+                        case '5':
+                            return PAGE_UP;
+                        case '6':
+                            return PAGE_DOWN;
+                        case '7':
+                            return HOME_KEY;
+                        case '8':
+                            return END_KEY;
+                    }
+                }
+            } else {
+                switch (seq[1]) {
+                    case 'A':
+                        return ARROW_UP;
+                    case 'B':
+                        return ARROW_DOWN;
+                    case 'C':
+                        return ARROW_RIGHT;
+                    case 'D':
+                        return ARROW_LEFT;
+                    case 'H':
+                        return HOME_KEY;
+                    case 'F':
+                        return END_KEY;
+                }
+            }
+        } else if (seq[0] == 'O') {
+            switch (seq[1]) {
+                case 'H':
+                    return HOME_KEY;
+                case 'F':
+                    return END_KEY;
+            }
+        }
+        return '\x1b';
+    } else {
+        return c;
+    }
+}
+
+/** syntax highlighting */
+
+bool is_separator(char c) {
+    return isspace(c) || c == '\0' || strchr(",.()+-/*=~%<>[];", c) != NULL;
+}
+
+// highlights rendered[0, to) starting from state, which is left at position
+// to; tokens may be looked at and highlighted past to, up to rendered.size()
+void editorHighlightRange(editorConfig& E, const std::string& rendered,
+                          std::string& hl, size_t to,
+                          editorSegmentState& state) {
+    if (E.syntax.filetype == "") return;
+    if (state.in_comment) {
+        memset(hl.data(), HIGHLIGHT_COMMENT, to);
+        return;
+    }
+    const auto& keywords = E.syntax.keywords;
+    const auto& scs = E.syntax.singleline_comment_start;
+    size_t i = std::min(size_t(state.carry), to);
+    memset(hl.data(), state.carry_hl, i);
+    state.carry -= int(i);
+    if (state.carry > 0) return;
+    size_t len = rendered.size();
+    bool prev_sep = state.prev_sep;
+    char in_string = state.in_string;
+    char prev_hl = state.prev_hl;
+    while (i < to) {
+        char c = rendered[i];
+        if (i > 0) prev_hl = hl[i - 1];
+
+        if (scs.size() != 0 && !in_string) {
+            if (!strncmp(rendered.data() + i, scs.data(), scs.size())) {
+                memset(hl.data() + i, HIGHLIGHT_COMMENT, len - i);
+                state.in_comment = true;
+                return;
+            }
+        }
+
+        if ((E.syntax.flags & HL_HIGHLIGHT_STRINGS) != 0) {
+            if (in_string) {
+                hl[i] = HIGHLIGHT_STRING;
+                if (c == '\\' && i + 1 < len) {
+                    hl[i + 1] = HIGHLIGHT_STRING;
+                    i += 2;
+                    continue;
+                }
+                if (c == in_string) in_string = false;
+                i++;
+                prev_sep = 1;
+                continue;
+            } else {
+                if (c == '"' || c == '\'') {
+                    in_string = c;
+                    hl[i] = HIGHLIGHT_STRING;
+                    i++;
+                    continue;
+                }
+            }
+        }
+
+        if ((E.syntax.flags & HL_HIGHLIGHT_NUMBERS) != 0) {
+            if ((isdigit(c) && (prev_sep || prev_hl == HIGHLIGHT_NUMBER)) ||
+                (c == '.' && prev_hl == HIGHLIGHT_NUMBER)) {
+                hl[i] = HIGHLIGHT_NUMBER;
+                i++;
+                prev_sep = 0;
+                continue;
+            }
+        }
+
+        if (prev_sep) {
+            for (const auto& keyword : keywords) {
+                size_t klen = keyword.size();
+                bool kw2 = keyword[klen - 1] == '|';
+                if (kw2) klen--;
+                if (!strncmp(rendered.data() + i, keyword.data(), klen) &&
+                    is_separator(rendered[i + klen])) {
+                    memset(hl.data() + i,
+                           kw2 ? HIGHLIGHT_KEYWORD2 : HIGHLIGHT_KEYWORD1, klen);
+                    i += klen;
+                    break;
+                }
+            }
+            prev_sep = 0;
+            continue;
+        }
+
+        prev_sep = is_separator(c);
+        i++;
+    }
+    if (i > to) {
+        state.carry = int(i - to);
+        state.carry_hl = hl[to];
+    }
+    if (i > 0) state.prev_hl = hl[i - 1];
+    state.prev_sep = prev_sep;
+    state.in_string = in_string;
+}
+
+int editorSyntaxToColor(int x) {
+    switch (x) {
+        case HIGHLIGHT_COMMENT:
+            return 90;
+        case HIGHLIGHT_KEYWORD1:
+            return 94;  // 33;
+        case HIGHLIGHT_KEYWORD2:
+            return 91;  // 32;
+        case HIGHLIGHT_NUMBER:
+            return 36;  // 31;
+        case HIGHLIGHT_STRING:
+            return 36;  // 35;
+        case HIGHLIGHT_HEX_OFFSET:
+            return 90;
+        case HIGHLIGHT_HEX_PATCHED:
+            return 33;
+        case HIGHLIGHT_LIST_LOCATION:
+            return 35;
+        case HIGHLIGHT_MATCH:
+            return 43;  // a background, drawn over black
+        default:
+            return 37;
+    }
+}
+
+void editorSelectSyntaxHighlight(editorConfig& E) {
+    if (E.filename == "") return;
+    char* ext = strrchr(E.filename.data(), '.');
+    for (unsigned int j = 0; j < HLDB.size(); j++) {
+        editorSyntax* s = &HLDB[j];
+        unsigned int i = 0;
+        while (i < s->filematch.size()) {
+            int is_ext = (s->filematch[i][0] == '.');
+            if ((is_ext && ext && !strcmp(ext, s->filematch[i].c_str())) ||
+                (!is_ext &&
+                 strstr(E.filename.c_str(), s->filematch[i].c_str()))) {
+                E.syntax = *s;
+                for (auto& row : E.rows) editorUpdateRow(row);
+                editorDamageRows(E, 0, INT_MAX);
+                return;
+            }
+            i++;
+        }
+    }
+}
+
+/** row operations */
+
+bool editorIsLongRow(const editorRow& row) {
+    return row.raw_row.size() > LONG_ROW_THRESHOLD;
+}
+
+// appends raw[begin, end) with tabs expanded, rendered_x is the column of out[0]
+void editorRenderRaw(const std::string& raw, size_t begin, size_t end,
+                     int rendered_x, std::string& out) {
+    while (begin < end) {
+        const char* tab =
+            (const char*)memchr(raw.data() + begin, '\t', end - begin);
+        size_t stop = tab ? size_t(tab - raw.data()) : end;
+        out.append(raw, begin, stop - begin);
+        if (!tab) break;
+        do
+            out += ' ';
+        while ((size_t(rendered_x) + out.size()) % TAB_STOP != 0);
+        begin = stop + 1;
+    }
+}
+
+// computes the checkpoint at the start of the next segment of a long row
+void editorRowExtendSegments(editorConfig& E, editorRow& row) {
+    if (row.segments.empty()) row.segments.emplace_back();
+    size_t begin = (row.segments.size() - 1) * ROW_SEGMENT_SIZE;
+    size_t end = std::min(begin + ROW_SEGMENT_SIZE, row.raw_row.size());
+    size_t lookahead_end =
+        std::min(end + HIGHLIGHT_LOOKAHEAD, row.raw_row.size());
+    editorSegmentState state = row.segments.back();
+    std::string rendered, hl;
+    editorRenderRaw(row.raw_row, begin, end, state.rendered_x, rendered);
+    size_t segment_len = rendered.size();
+    editorRenderRaw(row.raw_row, end, lookahead_end, state.rendered_x,
+                    rendered);
+    hl.assign(rendered.size(), HIGHLIGHT_NORMAL);
+    editorHighlightRange(E, rendered, hl, segment_len, state);
+    state.rendered_x += int(segment_len);
+    row.segments.push_back(state);
+}
+
+size_t editorRowSegmentCount(const editorRow& row) {
+    return (row.raw_row.size() + ROW_SEGMENT_SIZE - 1) / ROW_SEGMENT_SIZE;
+}
+
+// makes rendered_row and highlight_row cover the rendered columns [from,
+// from + len) and returns the index of column from in them
+size_t editorRenderRow(editorConfig& E, editorRow& row, int from, int len) {
+    if (!editorIsLongRow(row)) {
+        if (row.stale) {
+            row.rendered_row.clear();
+            editorRenderRaw(row.raw_row, 0, row.raw_row.size(), 0,
+                            row.rendered_row);
+            row.highlight_row.assign(row.rendered_row.size(),
+                                     HIGHLIGHT_NORMAL);
+            editorSegmentState state;
+            editorHighlightRange(E, row.rendered_row, row.highlight_row,
+                                 row.rendered_row.size(), state);
+            row.window_rx = 0;
+            row.window_at_end = true;
+            row.stale = false;
+        }
+        return size_t(from);
+    }
+    int window_end = row.window_rx + (int)row.rendered_row.size();
+    if (!row.stale && from >= row.window_rx &&
+        (from + len <= window_end || row.window_at_end))
+        return size_t(from - row.window_rx);
+
+    // only the segments from the one holding column from onwards are rendered
+    size_t segment_count = editorRowSegmentCount(row);
+    if (row.segments.empty()) row.segments.emplace_back();
+    while (row.segments.size() < segment_count &&
+           row.segments.back().rendered_x <= from)
+        editorRowExtendSegments(E, row);
+    size_t k = row.segments.size() - 1;
+    while (k > 0 && row.segments[k].rendered_x > from) k--;
+    editorSegmentState state = row.segments[k];
+    const std::string& raw = row.raw_row;
+    std::string& rendered = row.rendered_row;
+    rendered.clear();
+    size_t needed = size_t(from - state.rendered_x + len);
+    size_t end = k * ROW_SEGMENT_SIZE;
+    while (end < raw.size() && rendered.size() < needed) {
+        size_t next = std::min(end + ROW_SEGMENT_SIZE, raw.size());
+        editorRenderRaw(raw, end, next, state.rendered_x, rendered);
+        end = next;
+    }
+    size_t shown = rendered.size();
+    editorRenderRaw(raw, end, std::min(end + HIGHLIGHT_LOOKAHEAD, raw.size()),
+                    state.rendered_x, rendered);
+    row.highlight_row.assign(rendered.size(), HIGHLIGHT_NORMAL);
+    row.window_rx = state.rendered_x;
+    editorHighlightRange(E, rendered, row.highlight_row, shown, state);
+    rendered.resize(shown);
+    row.highlight_row.resize(shown);
+    row.window_at_end = end == raw.size();
+    row.stale = false;
+    return size_t(from - row.window_rx);
+}
+
+// checkpoints for segments starting before the change (or close enough for
+// the highlighter to have looked at it) stay valid
+void editorUpdateRow(editorRow& row, size_t changed_from) {
+    row.stale = true;
+    row.generation++;
+    if (!editorIsLongRow(row)) {
+        row.segments.clear();
+        return;
+    }
+    size_t keep = (changed_from > HIGHLIGHT_LOOKAHEAD
+                       ? changed_from - HIGHLIGHT_LOOKAHEAD
+                       : 0) /
+                      ROW_SEGMENT_SIZE +
+                  1;
+    if (row.segments.size() > keep) row.segments.resize(keep);
+}
+
+int editorRowLen(editorConfig& E, int y) {
+    return size_t(y) >= E.rows.size() ? 0
+                                      : (int)E.rows[size_t(y)].raw_row.size();
+}
+
+// keeps the marks on their rows when count rows from at become n rows; a
+// mark on a row that goes goes with it
+void editorShiftMarks(editorConfig& E, int at, size_t count, size_t n) {
+    for (auto it = E.marks.begin(); it != E.marks.end();) {
+        int& y = it->second.y;
+        if (y >= at + (int)count) {
+            y += (int)n - (int)count;
+        } else if (y >= at + (int)n) {
+            it = E.marks.erase(it);
+            continue;
+        }
+        ++it;
+    }
+}
+
+// the same for the rows at lines taken out, or put back with added
+void editorShiftMarksScattered(editorConfig& E, const std::vector<int>& lines,
+                               bool added) {
+    for (auto it = E.marks.begin(); it != E.marks.end();) {
+        int& y = it->second.y;
+        if (added) {
+            // lines are where the rows end up, so lines[i] - i only grows
+            size_t below = 0, above = lines.size();
+            while (below < above) {
+                size_t middle = (below + above) / 2;
+                if (lines[middle] - (int)middle <= y)
+                    below = middle + 1;
+                else
+                    above = middle;
+            }
+            y += (int)below;
+        } else {
+            auto at = std::lower_bound(lines.begin(), lines.end(), y);
+            if (at != lines.end() && *at == y) {
+                it = E.marks.erase(it);
+                continue;
+            }
+            y -= (int)(at - lines.begin());
+        }
+        ++it;
+    }
+}
+
+// notes rows top through bottom as edited, for the windows showing them
+void editorDamageRows(editorConfig& E, int top, int bottom) {
+    E.damage_top = std::min(E.damage_top, top);
+    E.damage_bottom = std::max(E.damage_bottom, bottom);
+}
+
+// exchanges rows [at, at + count) with rows, shifting the tail only once
+void editorSwapRows(editorConfig& E, int at, size_t count,
+                    std::vector<std::string>& rows) {
+    size_t n = rows.size();
+    editorShiftMarks(E, at, count, n);
+    editorDamageRows(E, at, n == count ? at + (int)n - 1 : INT_MAX);
+    auto first = E.rows.begin() + at;
+    for (size_t i = 0; i < std::min(n, count); ++i) {
+        std::swap(first[long(i)].raw_row, rows[i]);
+        editorUpdateRow(first[long(i)]);
+    }
+    if (n > count) {
+        std::vector<editorRow> added(n - count);
+        for (size_t i = count; i < n; ++i)
+            added[i - count].raw_row = std::move(rows[i]);
+        rows.resize(count);
+        E.rows.insert(first + long(count), std::make_move_iterator(added.begin()),
+                      std::make_move_iterator(added.end()));
+    } else if (n < count) {
+        for (size_t i = n; i < count; ++i)
+            rows.push_back(std::move(first[long(i)].raw_row));
+        E.rows.erase(first + long(n), first + long(count));
+    }
+    E.dirty = true;
+}
+
+// puts row at + order[i] at at + i for each i, then turns order into its
+// inverse, which puts them back. Only the text moves, and marks go with it.
+// The text is gathered aside first rather than following the cycles of the
+// permutation, so no row waits on memory for the one before it
+void editorPermuteRows(editorConfig& E, int at, std::vector<int>& order) {
+    size_t n = order.size();
+    std::vector<int> inverse(n);
+    for (size_t i = 0; i < n; ++i) inverse[size_t(order[i])] = (int)i;
+    for (auto& [name, mark] : E.marks)
+        if (mark.y >= at && mark.y < at + (int)n)
+            mark.y = at + inverse[size_t(mark.y - at)];
+    editorDamageRows(E, at, at + (int)n - 1);
+    editorRow* rows = E.rows.data() + at;
+    std::vector<std::string> gathered(n);
+    for (size_t i = 0; i < n; ++i)
+        gathered[i] = std::move(rows[order[i]].raw_row);
+    for (size_t i = 0; i < n; ++i) {
+        rows[i].raw_row = std::move(gathered[i]);
+        editorUpdateRow(rows[i]);
+    }
+    order = std::move(inverse);
+    E.dirty = true;
+}
+
+// takes the rows at lines out of the buffer into rows, or when rows holds
+// them puts them back there; the rows in between move once either way
+void editorSwapScatteredRows(editorConfig& E, const std::vector<int>& lines,
+                             std::vector<std::string>& rows) {
+    size_t n = lines.size();
+    editorShiftMarksScattered(E, lines, !rows.empty());
+    editorDamageRows(E, lines[0], INT_MAX);
+    if (rows.empty()) {
+        rows.reserve(n);
+        size_t kept = size_t(lines[0]), next = 0;
+        for (size_t y = kept; y < E.rows.size(); ++y) {
+            if (next < n && y == size_t(lines[next])) {
+                rows.push_back(std::move(E.rows[y].raw_row));
+                next++;
+            } else {
+                E.rows[kept++] = std::move(E.rows[y]);
+            }
+        }
+        E.rows.resize(kept);
+    } else {
+        size_t old_size = E.rows.size();
+        E.rows.resize(old_size + n);
+        size_t from = old_size;
+        for (size_t i = n; i-- > 0;) {
+            size_t y = size_t(lines[i]);
+            while (from > y - i) {
+                from--;
+                E.rows[from + i + 1] = std::move(E.rows[from]);
+            }
+            E.rows[y] = editorRow();
+            E.rows[y].raw_row = std::move(rows[i]);
+        }
+        rows.clear();
+    }
+    E.dirty = true;
+}
+
+// exchanges count chars of row y starting at x with text
+void editorSwapInRow(editorConfig& E, int y, int x, size_t count,
+                     std::string& text) {
+    editorRow& row = E.rows[size_t(y)];
+    std::string replaced = row.raw_row.substr(size_t(x), count);
+    row.raw_row.replace(size_t(x), count, text);
+    text = std::move(replaced);
+    editorUpdateRow(row, size_t(x));
+    editorDamageRows(E, y, y);
+    E.dirty = true;
+}
+
+int editorComputeRenderedX(editorConfig& E, editorRow& row, int cursor_x) {
+    int rendered_x = 0;
+    size_t begin = 0;
+    if (editorIsLongRow(row)) {
+        size_t k = size_t(cursor_x) / ROW_SEGMENT_SIZE;
+        while (row.segments.size() <= k) editorRowExtendSegments(E, row);
+        rendered_x = row.segments[k].rendered_x;
+        begin = k * ROW_SEGMENT_SIZE;
+    }
+    for (auto c : std::string_view(row.raw_row.data() + begin,
+                                   size_t(cursor_x) - begin))
+        if (c == '\t')
+            rendered_x += TAB_STOP - rendered_x % TAB_STOP;
+        else
+            rendered_x++;
+    return rendered_x;
+}
+
+// the index of the char drawn at rendered column rendered_x, or the length
+// of the row when it is not that wide
+int editorComputeCursorX(editorConfig& E, editorRow& row, int rendered_x) {
+    int column = 0;
+    size_t x = 0;
+    if (editorIsLongRow(row)) {
+        size_t segment_count = editorRowSegmentCount(row);
+        if (row.segments.empty()) row.segments.emplace_back();
+        while (row.segments.size() < segment_count &&
+               row.segments.back().rendered_x <= rendered_x)
+            editorRowExtendSegments(E, row);
+        size_t k = row.segments.size() - 1;
+        while (k > 0 && row.segments[k].rendered_x > rendered_x) k--;
+        column = row.segments[k].rendered_x;
+        x = k * ROW_SEGMENT_SIZE;
+    }
+    for (; x < row.raw_row.size(); ++x) {
+        column += row.raw_row[x] == '\t' ? TAB_STOP - column % TAB_STOP : 1;
+        if (column > rendered_x) break;
+    }
+    return (int)x;
+}
+
+/** undo */
+
+size_t editorUndoOpBytes(const editorUndoOp& op) {
+    size_t bytes = sizeof(op) + op.lines.size() * sizeof(int);
+    for (const auto& s : op.absent) bytes += sizeof(s) + s.size();
+    return bytes;
+}
+
+// the next recorded op starts a new undo node, unless :g is running, which
+// makes a single one of everything it does
+void editorUndoBreak(editorConfig& E) {
+    if (!E.global_busy) E.undo.group_open = false;
+}
+
+void editorUndoReset(editorConfig& E) {
+    size_t max_bytes = E.undo.max_bytes;
+    E.undo = editorUndoTree();
+    E.undo.max_bytes = max_bytes;
+    E.undo.nodes.front().time = time(NULL);
+}
+
+editorUndoNode& editorUndoNodeAt(editorConfig& E, size_t seq) {
+    return E.undo.nodes[seq - E.undo.first];
+}
+
+size_t editorUndoNewest(editorConfig& E) {
+    return E.undo.first + E.undo.nodes.size() - 1;
+}
+
+void editorUndoKill(editorConfig& E, editorUndoNode& node) {
+    for (const auto& op : node.ops) E.undo.bytes -= editorUndoOpBytes(op);
+    node.ops = std::vector<editorUndoOp>();
+    node.alive = false;
+}
+
+// moves the root towards the current state, dropping the other branches,
+// until the history fits in max_bytes again
+void editorUndoPrune(editorConfig& E) {
+    auto& tree = E.undo;
+    while (tree.bytes > tree.max_bytes && tree.root != tree.current) {
+        size_t next = tree.current;
+        while (editorUndoNodeAt(E, next).parent != tree.root)
+            next = editorUndoNodeAt(E, next).parent;
+        editorUndoKill(E, editorUndoNodeAt(E, tree.root));
+        for (size_t seq = tree.root + 1; seq <= editorUndoNewest(E); ++seq) {
+            auto& node = editorUndoNodeAt(E, seq);
+            if (seq != next && node.alive &&
+                !editorUndoNodeAt(E, node.parent).alive)
+                editorUndoKill(E, node);
+        }
+        auto& new_root = editorUndoNodeAt(E, next);
+        for (const auto& op : new_root.ops)
+            tree.bytes -= editorUndoOpBytes(op);
+        new_root.ops = std::vector<editorUndoOp>();
+        tree.root = next;
+        while (!tree.nodes.front().alive) {
+            tree.nodes.pop_front();
+            tree.first++;
+        }
+        if (tree.saved < tree.root || (tree.saved <= editorUndoNewest(E) &&
+                                       !editorUndoNodeAt(E, tree.saved).alive))
+            tree.saved = SIZE_MAX;
+    }
+}
+
+// keystrokes of an insert session edit the same op while they stay inside
+// or right next to the span it already covers
+bool editorUndoMerge(editorUndoOp& last, int y, int x, size_t present,
+                     std::vector<std::string>& absent) {
+    if (last.x < 0 || x < 0 || last.y != y) return false;
+    int end = last.x + (int)last.present;
+    size_t removed = absent[0].size();
+    if (removed == 0 && x >= last.x && x <= end) {
+        last.present += present;
+    } else if (present == 0 && x >= last.x && x + (int)removed <= end) {
+        last.present -= removed;
+    } else if (present == 0 && x + (int)removed == last.x) {
+        last.x = x;
+        last.absent[0].insert(0, absent[0]);
+    } else if (present == 0 && x == end) {
+        last.absent[0] += absent[0];
+    } else {
+        return false;
+    }
+    return true;
+}
+
+void editorUndoRecord(editorConfig& E, int y, int x, size_t present,
+                      std::vector<std::string> absent,
+                      std::vector<int> lines = {}) {
+    auto& tree = E.undo;
+    if (!tree.group_open) {
+        // a change made after undoing starts a new branch, nothing is lost
+        editorUndoNode node;
+        node.parent = tree.current;
+        node.cursor_x = E.cursor_x;
+        node.cursor_y = E.cursor_y;
+        node.time = time(NULL);
+        tree.nodes.push_back(std::move(node));
+        tree.current = editorUndoNewest(E);
+        tree.group_open = true;
+    }
+    auto& ops = editorUndoNodeAt(E, tree.current).ops;
+    if (!ops.empty()) {
+        tree.bytes -= editorUndoOpBytes(ops.back());
+        bool merged = editorUndoMerge(ops.back(), y, x, present, absent);
+        tree.bytes += editorUndoOpBytes(ops.back());
+        if (merged) return;
+    }
+    ops.push_back({y, x, present, std::move(absent), std::move(lines)});
+    tree.bytes += editorUndoOpBytes(ops.back());
+    editorUndoPrune(E);
+}
+
+void editorUndoToggle(editorConfig& E, editorUndoOp& op) {
+    E.undo.bytes -= editorUndoOpBytes(op);
+    if (op.x == -3) {
+        editorPermuteRows(E, op.y, op.lines);
+    } else if (op.x == -2) {
+        size_t n = op.absent.size();
+        editorSwapScatteredRows(E, op.lines, op.absent);
+        op.present = n;
+    } else if (op.x < 0) {
+        size_t n = op.absent.size();
+        editorSwapRows(E, op.y, op.present, op.absent);
+        op.present = n;
+    } else {
+        size_t n = op.absent[0].size();
+        editorSwapInRow(E, op.y, op.x, op.present, op.absent[0]);
+        op.present = n;
+    }
+    E.undo.bytes += editorUndoOpBytes(op);
+}
+
+void editorClampCursor(editorConfig& E) {
+    E.cursor_y = std::clamp(E.cursor_y, 0, (int)E.rows.size());
+    E.cursor_x = std::clamp(E.cursor_x, 0, editorRowLen(E, E.cursor_y));
+}
+
+// undoes up to the common ancestor of the current state and target, then
+// redoes down to target: the cost is the length of the path between them
+void editorUndoTravel(editorConfig& E, size_t target) {
+    auto& tree = E.undo;
+    editorUndoBreak(E);
+    std::vector<size_t> down;
+    size_t at = tree.current;
+    while (at != target) {
+        if (at > target) {
+            auto& node = editorUndoNodeAt(E, at);
+            for (auto op = node.ops.rbegin(); op != node.ops.rend(); ++op)
+                editorUndoToggle(E, *op);
+            E.cursor_x = node.cursor_x;
+            E.cursor_y = node.cursor_y;
+            editorUndoNodeAt(E, node.parent).redo_child = at;
+            at = node.parent;
+        } else {
+            down.push_back(target);
+            target = editorUndoNodeAt(E, target).parent;
+        }
+    }
+    for (auto seq = down.rbegin(); seq != down.rend(); ++seq) {
+        auto& node = editorUndoNodeAt(E, *seq);
+        for (auto& op : node.ops) editorUndoToggle(E, op);
+        E.cursor_x = std::max(node.ops.front().x, 0);
+        E.cursor_y = node.ops.front().y;
+        at = *seq;
+    }
+    tree.current = at;
+    editorClampCursor(E);
+    E.dirty = tree.current != tree.saved;
+    editorSetStatusMessage(E, "state #%zu of %zu", tree.current,
+                           editorUndoNewest(E));
+}
+
+bool editorUndo(editorConfig& E) {
+    editorUndoLoadFile(E);
+    if (E.undo.current == E.undo.root) {
+        editorSetStatusMessage(E, "Already at oldest change");
+        return false;
+    }
+    editorUndoTravel(E, editorUndoNodeAt(E, E.undo.current).parent);
+    return true;
+}
+
+bool editorRedo(editorConfig& E) {
+    editorUndoLoadFile(E);
+    size_t child = editorUndoNodeAt(E, E.undo.current).redo_child;
+    if (child == 0 || child < E.undo.first ||
+        !editorUndoNodeAt(E, child).alive) {
+        editorSetStatusMessage(E, "Already at newest change");
+        return false;
+    }
+    editorUndoTravel(E, child);
+    return true;
+}
+
+// g- and g+: the previous or next state in the order they were created,
+// whichever branch it is on
+void editorUndoStep(editorConfig& E, long long steps) {
+    editorUndoLoadFile(E);
+    size_t target = E.undo.current;
+    while (steps < 0 && target > E.undo.root) {
+        if (editorUndoNodeAt(E, --target).alive) steps++;
+    }
+    while (steps > 0 && target < editorUndoNewest(E)) {
+        if (editorUndoNodeAt(E, ++target).alive) steps--;
+    }
+    editorUndoTravel(E, target);
+}
+
+// :earlier and :later with a time: the newest state no later than the
+// current state's time shifted by seconds
+void editorUndoTime(editorConfig& E, long long seconds) {
+    editorUndoLoadFile(E);
+    time_t when = editorUndoNodeAt(E, E.undo.current).time + seconds;
+    size_t target = E.undo.root;
+    for (size_t seq = E.undo.root + 1; seq <= editorUndoNewest(E); ++seq) {
+        const auto& node = editorUndoNodeAt(E, seq);
+        if (node.alive && node.time <= when) target = seq;
+    }
+    editorUndoTravel(E, target);
+}
+
+/** editor operations */
+
+void editorReplaceRows(editorConfig& E, int at, size_t count,
+                       std::vector<std::string> rows) {
+    size_t n = rows.size();
+    editorSwapRows(E, at, count, rows);
+    editorUndoRecord(E, at, -1, n, std::move(rows));
+}
+
+void editorReplaceInRow(editorConfig& E, int y, int x, size_t count,
+                        std::string text) {
+    size_t n = text.size();
+    editorSwapInRow(E, y, x, count, text);
+    editorUndoRecord(E, y, x, n, {std::move(text)});
+}
+
+// deletes the rows at lines, given in ascending order, in a single pass
+void editorDeleteScatteredRows(editorConfig& E, std::vector<int> lines) {
+    std::vector<std::string> rows;
+    editorSwapScatteredRows(E, lines, rows);
+    int y = lines[0];
+    editorUndoRecord(E, y, -2, 0, std::move(rows), std::move(lines));
+}
+
+// puts rows in at lines, given in ascending order as they are to end up, in
+// a single pass
+void editorInsertScatteredRows(editorConfig& E, std::vector<int> lines,
+                               std::vector<std::string> rows) {
+    size_t n = rows.size();
+    editorSwapScatteredRows(E, lines, rows);
+    int y = lines[0];
+    editorUndoRecord(E, y, -2, n, {}, std::move(lines));
+}
+
+// reorders the rows from at as editorPermuteRows does, undone the same way
+void editorReorderRows(editorConfig& E, int at, std::vector<int> order) {
+    size_t n = order.size();
+    editorPermuteRows(E, at, order);
+    editorUndoRecord(E, at, -3, n, {}, std::move(order));
+}
+
+void editorInsertRow(editorConfig& E, int at, const std::string& s) {
+    if (at < 0 || at > (int)E.rows.size()) return;
+    editorReplaceRows(E, at, 0, {s});
+}
+
+void editorRowInsertChar(editorConfig& E, int y, int at, int c) {
+    int size = (int)E.rows[size_t(y)].raw_row.size();
+    if (at < 0 || at > size) at = size;
+    editorReplaceInRow(E, y, at, 0, std::string(1, (char)c));
+}
+
+void editorRowDelChar(editorConfig& E, int y, int at) {
+    if (at <= 0 || at > (int)E.rows[size_t(y)].raw_row.size()) return;
+    editorReplaceInRow(E, y, at - 1, 1, "");
+}
+
+void editorRowAppendString(editorConfig& E, int y,
+                           const std::string& to_append) {
+    editorReplaceInRow(E, y, (int)E.rows[size_t(y)].raw_row.size(), 0,
+                       to_append);
+}
+
+void editorInsertChar(editorConfig& E, int c) {
+    if (E.cursor_y == (int)E.rows.size())
+        editorInsertRow(E, (int)E.rows.size(), "");
+    editorRowInsertChar(E, E.cursor_y, E.cursor_x, c);
+    E.cursor_x++;
+}
+
+void editorInsertNewline(editorConfig& E) {
+    if (E.cursor_x == 0) {
+        editorInsertRow(E, E.cursor_y, "");
+    } else {
+        const std::string& row = E.rows[size_t(E.cursor_y)].raw_row;
+        size_t tail = row.size() - size_t(E.cursor_x);
+        std::string moved = row.substr(size_t(E.cursor_x));
+        editorReplaceInRow(E, E.cursor_y, E.cursor_x, tail, "");
+        editorInsertRow(E, E.cursor_y + 1, moved);
+    }
+    E.cursor_x = 0;
+    E.cursor_y++;
+}
+
+void editorDelRow(editorConfig& E, int at) {
+    if (at < 0 || at >= (int)E.rows.size()) return;
+    editorReplaceRows(E, at, 1, {});
+}
+
+void editorDelChar(editorConfig& E) {
+    if (E.cursor_y == (int)E.rows.size()) return;
+    if (E.cursor_x == 0 && E.cursor_y == 0) return;
+    if (E.cursor_x == 0) {
+        int joined_at = (int)E.rows[size_t(E.cursor_y - 1)].raw_row.size();
+        editorRowAppendString(E, E.cursor_y - 1,
+                              E.rows[size_t(E.cursor_y)].raw_row);
+        editorDelRow(E, E.cursor_y);
+        E.cursor_x = joined_at;
+        E.cursor_y--;
+    } else {
+        editorRowDelChar(E, E.cursor_y, E.cursor_x);
+        E.cursor_x--;
+    }
+}
+
+// the text between (y1, x1) and (y2, x2), the end excluded
+std::vector<std::string> editorGetText(editorConfig& E, int y1, int x1, int y2,
+                                       int x2) {
+    const auto& first = E.rows[size_t(y1)].raw_row;
+    if (y1 == y2) return {first.substr(size_t(x1), size_t(x2 - x1))};
+    std::vector<std::string> text{first.substr(size_t(x1))};
+    text.reserve(size_t(y2 - y1 + 1));
+    for (int y = y1 + 1; y < y2; ++y) text.push_back(E.rows[size_t(y)].raw_row);
+    text.push_back(E.rows[size_t(y2)].raw_row.substr(0, size_t(x2)));
+    return text;
+}
+
+// removes the rows in between with a single splice
+std::vector<std::string> editorDeleteText(editorConfig& E, int y1, int x1,
+                                          int y2, int x2) {
+    std::vector<std::string> text = editorGetText(E, y1, x1, y2, x2);
+    if (y1 == y2) {
+        editorReplaceInRow(E, y1, x1, size_t(x2 - x1), "");
+        return text;
+    }
+    std::string tail = E.rows[size_t(y2)].raw_row.substr(size_t(x2));
+    editorReplaceInRow(E, y1, x1, size_t(editorRowLen(E, y1) - x1), tail);
+    editorReplaceRows(E, y1 + 1, size_t(y2 - y1), {});
+    return text;
+}
+
+void editorInsertText(editorConfig& E, int y, int x,
+                      std::vector<std::string> lines) {
+    if (y == (int)E.rows.size()) editorInsertRow(E, y, "");
+    if (lines.size() == 1) {
+        editorReplaceInRow(E, y, x, 0, lines[0]);
+        return;
+    }
+    std::string tail = E.rows[size_t(y)].raw_row.substr(size_t(x));
+    editorReplaceInRow(E, y, x, tail.size(), lines[0]);
+    lines.back() += tail;
+    std::vector<std::string> rest(std::make_move_iterator(lines.begin() + 1),
+                                  std::make_move_iterator(lines.end()));
+    editorReplaceRows(E, y + 1, 0, std::move(rest));
+}
+
+// op is ~ to toggle the case of chars in [from, to), u to lower it, U to
+// raise it
+void editorChangeCase(std::string& s, size_t from, size_t to, char op) {
+    for (size_t i = from; i < to; ++i) {
+        unsigned char c = (unsigned char)s[i];
+        if (op == 'u' || (op == '~' && isupper(c)))
+            s[i] = (char)tolower(c);
+        else
+            s[i] = (char)toupper(c);
+    }
+}
+
+void editorChangeCaseText(editorConfig& E, int y1, int x1, int y2, int x2,
+                          char op) {
+    if (y1 == y2) {
+        std::string text = E.rows[size_t(y1)].raw_row.substr(
+            size_t(x1), size_t(x2 - x1));
+        editorChangeCase(text, 0, text.size(), op);
+        editorReplaceInRow(E, y1, x1, text.size(), text);
+        return;
+    }
+    std::vector<std::string> rows;
+    rows.reserve(size_t(y2 - y1 + 1));
+    for (int y = y1; y <= y2; ++y) {
+        rows.push_back(E.rows[size_t(y)].raw_row);
+        size_t from = y == y1 ? size_t(x1) : 0;
+        size_t to = y == y2 ? size_t(x2) : rows.back().size();
+        editorChangeCase(rows.back(), from, to, op);
+    }
+    editorReplaceRows(E, y1, size_t(y2 - y1 + 1), std::move(rows));
+}
+
+// adds shifts tabs in front of a row, or takes away as many indents of a
+// tab or up to TAB_STOP spaces each when shifts is negative
+void editorShiftRow(std::string& row, long long shifts) {
+    if (shifts > 0) {
+        if (!row.empty()) row.insert(0, size_t(shifts), '\t');
+        return;
+    }
+    size_t x = 0;
+    for (; shifts < 0 && x < row.size(); ++shifts) {
+        if (row[x] == '\t') {
+            x++;
+            continue;
+        }
+        size_t spaces = 0;
+        while (spaces < TAB_STOP && x + spaces < row.size() &&
+               row[x + spaces] == ' ')
+            spaces++;
+        if (spaces == 0) break;
+        x += spaces;
+    }
+    row.erase(0, x);
+}
+
+/** registers */
+
+// "x yanks or deletes into x, "X appends to it; the unnamed register always
+// gets the text too, and "0 keeps the last yank
+void editorSetRegister(editorConfig& E, char name,
+                       std::vector<std::string> text, bool linewise, bool yank,
+                       bool blockwise = false) {
+    if (name == '_') return;
+    auto& registers = E.registers;
+    if (isupper(name)) {
+        auto& reg = registers[(char)tolower(name)];
+        if (!reg)
+            reg = std::make_shared<editorRegister>();
+        else if (reg.use_count() > 1)
+            reg = std::make_shared<editorRegister>(*reg);
+        if (reg->text.empty()) {
+            reg->text = std::move(text);
+            reg->blockwise = blockwise;
+        } else if (linewise || reg->linewise ||
+                   (blockwise && reg->blockwise)) {
+            reg->text.insert(reg->text.end(),
+                             std::make_move_iterator(text.begin()),
+                             std::make_move_iterator(text.end()));
+        } else {
+            reg->text.back() += text[0];
+            reg->text.insert(reg->text.end(),
+                             std::make_move_iterator(text.begin() + 1),
+                             std::make_move_iterator(text.end()));
+        }
+        reg->linewise = reg->linewise || linewise;
+        registers['"'] = reg;
+        return;
+    }
+    auto reg = std::make_shared<editorRegister>();
+    reg->text = std::move(text);
+    reg->linewise = linewise;
+    reg->blockwise = blockwise;
+    if (yank && name == '"') registers['0'] = reg;
+    registers[name] = reg;
+    registers['"'] = reg;
+}
+
+void editorPut(editorConfig& E, char name, long long count, bool after) {
+    auto it = E.registers.find(name);
+    if (it == E.registers.end() || it->second->text.empty()) {
+        editorSetStatusMessage(E, "Nothing in register %c", name);
+        return;
+    }
+    const editorRegister& reg = *it->second;
+    if (reg.linewise) {
+        int at = E.cursor_y;
+        if (after && at < (int)E.rows.size()) at++;
+        std::vector<std::string> rows;
+        rows.reserve(reg.text.size() * size_t(count));
+        for (long long i = 0; i < count; ++i)
+            rows.insert(rows.end(), reg.text.begin(), reg.text.end());
+        size_t added = rows.size();
+        editorReplaceRows(E, at, 0, std::move(rows));
+        E.cursor_y = at;
+        E.cursor_x = 0;
+        if (added > 2) editorSetStatusMessage(E, "%zu more lines", added);
+        return;
+    }
+    if (reg.blockwise) {
+        // every line goes in at the same rendered column of the rows below
+        // the cursor, all of them changed with one splice
+        int y = E.cursor_y;
+        int column = 0;
+        if (y < (int)E.rows.size()) {
+            editorRow& row = E.rows[size_t(y)];
+            int x = std::min(E.cursor_x + (after ? 1 : 0), editorRowLen(E, y));
+            column = editorComputeRenderedX(E, row, x);
+            if (after && E.cursor_x >= editorRowLen(E, y)) column++;
+        }
+        size_t width = 0;
+        for (auto& line : reg.text) width = std::max(width, line.size());
+        int existing = std::min((int)reg.text.size(), (int)E.rows.size() - y);
+        std::vector<std::string> rows;
+        rows.reserve(reg.text.size());
+        for (size_t i = 0; i < reg.text.size(); ++i) {
+            std::string piece;
+            for (long long k = 0; k < count; ++k) {
+                piece += reg.text[i];
+                if (k + 1 < count) piece.resize(size_t(k + 1) * width, ' ');
+            }
+            if ((int)i >= existing) {
+                rows.push_back(std::string(size_t(column), ' ') + piece);
+                continue;
+            }
+            editorRow& row = E.rows[size_t(y) + i];
+            rows.push_back(row.raw_row);
+            int end = editorComputeRenderedX(E, row, (int)row.raw_row.size());
+            if (end < column) rows.back().append(size_t(column - end), ' ');
+            size_t x = size_t(editorComputeCursorX(E, row, column));
+            if (end <= column) x = rows.back().size();
+            if (x < rows.back().size() && piece.size() < width)
+                piece.resize(width, ' ');
+            rows.back().insert(x, piece);
+        }
+        editorReplaceRows(E, y, size_t(std::max(existing, 0)), std::move(rows));
+        E.cursor_y = y;
+        E.cursor_x = editorComputeCursorX(E, E.rows[size_t(y)], column);
+        return;
+    }
+    std::vector<std::string> lines = reg.text;
+    for (long long i = 1; i < count; ++i) {
+        lines.back() += reg.text[0];
+        lines.insert(lines.end(), reg.text.begin() + 1, reg.text.end());
+    }
+    int y = E.cursor_y;
+    int x = after ? std::min(E.cursor_x + 1, editorRowLen(E, y)) : E.cursor_x;
+    int end_y = y + (int)lines.size() - 1;
+    int end_x = (int)lines.back().size() + (lines.size() == 1 ? x : 0);
+    editorInsertText(E, y, x, std::move(lines));
+    E.cursor_y = end_y;
+    E.cursor_x = std::max(end_x - 1, 0);
+}
+
+/** marks */
+
+// m sets marks a to z, and every key in visual mode sets < and > to the ends
+// of the selection
+bool editorSetMark(editorConfig& E, char name, int y, int x) {
+    if (!islower((unsigned char)name) && name != '<' && name != '>')
+        return false;
+    E.marks[name] = {y, x};
+    return true;
+}
+
+// where mark name is, kept inside the buffer; false, with an error shown,
+// when it is not set
+bool editorGetMark(editorConfig& E, char name, int& y, int& x) {
+    auto it = E.marks.find(name);
+    if (it == E.marks.end()) {
+        editorSetStatusMessage(E, islower((unsigned char)name) || name == '<' ||
+                                       name == '>'
+                                   ? "E20: Mark not set"
+                                   : "E78: Unknown mark");
+        return false;
+    }
+    y = std::clamp(it->second.y, 0, std::max((int)E.rows.size() - 1, 0));
+    x = std::min(it->second.x, editorRowLen(E, y));
+    return true;
+}
+
+/** words */
+
+// for WORD motions (big) everything but blanks is a word char
+inline int editorCharClass(char ch, bool big) {
+    unsigned char c = (unsigned char)ch;
+    if (c == ' ' || c == '\t') return CLASS_BLANK;
+    if (big || isalnum(c) || c == '_' || c >= 128) return CLASS_WORD;
+    return CLASS_PUNCT;
+}
+
+#ifdef __SSE2__
+inline __m128i editorInRange(__m128i v, unsigned char lo, unsigned char hi) {
+    __m128i shifted = _mm_sub_epi8(v, _mm_set1_epi8((char)lo));
+    __m128i above = _mm_subs_epu8(shifted, _mm_set1_epi8((char)(hi - lo)));
+    return _mm_cmpeq_epi8(above, _mm_setzero_si128());
+}
+
+// bit i is set when p[i] is of class cls
+inline unsigned editorClassMask(const char* p, int cls, bool big) {
+    __m128i v = _mm_loadu_si128((const __m128i*)p);
+    __m128i blank = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                                 _mm_cmpeq_epi8(v, _mm_set1_epi8('\t')));
+    unsigned blanks = (unsigned)_mm_movemask_epi8(blank);
+    if (cls == CLASS_BLANK) return blanks;
+    if (big) return cls == CLASS_WORD ? ~blanks & 0xffff : 0;
+    __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+    __m128i word = _mm_or_si128(editorInRange(lower, 'a', 'z'),
+                                editorInRange(v, '0', '9'));
+    word = _mm_or_si128(word, _mm_cmpeq_epi8(v, _mm_set1_epi8('_')));
+    // the sign bit marks bytes >= 128
+    unsigned words = (unsigned)(_mm_movemask_epi8(word) | _mm_movemask_epi8(v));
+    if (cls == CLASS_WORD) return words;
+    return ~(words | blanks) & 0xffff;
+}
+#endif
+
+// the first index from from on whose char is not of class cls
+size_t editorSkipClass(const std::string& s, size_t from, int cls, bool big) {
+    size_t i = from;
+#ifdef __SSE2__
+    for (; i + 16 <= s.size(); i += 16) {
+        unsigned other = ~editorClassMask(&s[i], cls, big) & 0xffff;
+        if (other) return i + size_t(__builtin_ctz(other));
+    }
+#endif
+    while (i < s.size() && editorCharClass(s[i], big) == cls) i++;
+    return i;
+}
+
+// the first index of the run of class cls chars that ends at from
+size_t editorSkipClassBack(const std::string& s, size_t from, int cls,
+                           bool big) {
+    size_t i = from;
+#ifdef __SSE2__
+    for (; i >= 16; i -= 16) {
+        unsigned other = ~editorClassMask(&s[i - 16], cls, big) & 0xffff;
+        if (other) return i - 16 + size_t(32 - __builtin_clz(other));
+    }
+#endif
+    while (i > 0 && editorCharClass(s[i - 1], big) == cls) i--;
+    return i;
+}
+
+// moves (y, x) to the start of the next word; an empty row is a word too
+void editorWordForward(editorConfig& E, int& y, int& x, bool big) {
+    int rows = (int)E.rows.size();
+    if (y >= rows) return;
+    const std::string* s = &E.rows[size_t(y)].raw_row;
+    size_t i = size_t(x);
+    if (i < s->size()) {
+        int cls = editorCharClass((*s)[i], big);
+        if (cls != CLASS_BLANK) i = editorSkipClass(*s, i, cls, big);
+    }
+    i = editorSkipClass(*s, i, CLASS_BLANK, big);
+    while (i >= s->size() && y + 1 < rows) {
+        s = &E.rows[size_t(++y)].raw_row;
+        i = editorSkipClass(*s, 0, CLASS_BLANK, big);
+        if (s->empty()) break;
+    }
+    x = (int)i;
+}
+
+// moves (y, x) to the last char of the word after it
+void editorWordEnd(editorConfig& E, int& y, int& x, bool big) {
+    int rows = (int)E.rows.size();
+    if (y >= rows) return;
+    const std::string* s = &E.rows[size_t(y)].raw_row;
+    size_t i = std::min(size_t(x + 1), s->size());
+    while ((i = editorSkipClass(*s, i, CLASS_BLANK, big)) >= s->size()) {
+        if (y + 1 >= rows) {
+            x = (int)s->size();
+            return;
+        }
+        s = &E.rows[size_t(++y)].raw_row;
+        i = 0;
+    }
+    x = (int)editorSkipClass(*s, i, editorCharClass((*s)[i], big), big) - 1;
+}
+
+// moves (y, x) to the start of the word before it
+void editorWordBackward(editorConfig& E, int& y, int& x, bool big) {
+    if (E.rows.empty()) return;
+    if (y >= (int)E.rows.size()) {
+        y = (int)E.rows.size() - 1;
+        x = editorRowLen(E, y);
+    }
+    const std::string* s = &E.rows[size_t(y)].raw_row;
+    size_t i = std::min(size_t(x), s->size());
+    while ((i = editorSkipClassBack(*s, i, CLASS_BLANK, big)) == 0) {
+        if (y == 0) {
+            x = 0;
+            return;
+        }
+        s = &E.rows[size_t(--y)].raw_row;
+        i = s->size();
+        if (i == 0) {
+            x = 0;
+            return;
+        }
+    }
+    int cls = editorCharClass((*s)[i - 1], big);
+    x = (int)editorSkipClassBack(*s, i - 1, cls, big);
+}
+
+// finds the range [(y1, x1), (y2, x2)) of text object c around the cursor:
+// iw/aw, iW/aW, quotes within the row, and brackets across rows
+bool editorTextObject(editorConfig& E, int c, bool around, long long count,
+                      int& y1, int& x1, int& y2, int& x2) {
+    int y = E.cursor_y;
+    if (y >= (int)E.rows.size()) return false;
+    const std::string& s = E.rows[size_t(y)].raw_row;
+    size_t x = std::min(size_t(E.cursor_x), s.size());
+    y1 = y2 = y;
+    if (c == 'w' || c == 'W') {
+        if (s.empty()) return false;
+        bool big = c == 'W';
+        x = std::min(x, s.size() - 1);
+        int cls = editorCharClass(s[x], big);
+        size_t from = editorSkipClassBack(s, x, cls, big);
+        size_t to = editorSkipClass(s, x, cls, big);
+        for (long long i = 1; i < count && to < s.size(); ++i)
+            to = editorSkipClass(s, to, editorCharClass(s[to], big), big);
+        if (around && cls == CLASS_BLANK) {
+            if (to < s.size())
+                to = editorSkipClass(s, to, editorCharClass(s[to], big), big);
+        } else if (around) {
+            size_t blanks = editorSkipClass(s, to, CLASS_BLANK, big);
+            if (blanks > to)
+                to = blanks;
+            else
+                from = editorSkipClassBack(s, from, CLASS_BLANK, big);
+        }
+        x1 = (int)from;
+        x2 = (int)to;
+        return true;
+    }
+    if (c == '"' || c == '\'' || c == '`') {
+        // quotes pair up from the start of the row
+        size_t quotes = 0;
+        for (size_t i = 0; i < x; ++i) quotes += s[i] == c;
+        size_t open, close;
+        if (x < s.size() && s[x] == c && quotes % 2 == 0) {
+            open = x;
+        } else if (quotes % 2 == 1) {
+            open = s.rfind((char)c, x - 1);
+        } else {
+            open = s.find((char)c, x);
+        }
+        if (open == std::string::npos) return false;
+        close = s.find((char)c, open + 1);
+        if (close == std::string::npos) return false;
+        x1 = (int)(around ? open : open + 1);
+        x2 = (int)(around ? close + 1 : close);
+        return true;
+    }
+    static const char pairs[] = "()bb[]{}BB<>";
+    const char* pair = c < 128 ? strchr(pairs, c) : NULL;
+    if (!pair || c == 0) return false;
+    size_t at = size_t(pair - pairs) & ~size_t(1);
+    char open = pairs[at] == 'b' ? '(' : pairs[at] == 'B' ? '{' : pairs[at];
+    char close = open == '(' ? ')' : open == '{' ? '}' : pairs[at + 1];
+    // walk back to the unmatched open bracket, then on to its match
+    int oy = y;
+    long long ox = s.empty() ? -1 : (long long)std::min(x, s.size() - 1);
+    if (ox >= 0 && s[size_t(ox)] == close) ox--;
+    for (long long depth = 0;; --ox) {
+        while (ox < 0) {
+            if (oy == 0) return false;
+            ox = editorRowLen(E, --oy) - 1;
+        }
+        char ch = E.rows[size_t(oy)].raw_row[size_t(ox)];
+        if (ch == close) depth++;
+        if (ch == open && depth-- == 0) break;
+    }
+    int cy = oy;
+    long long cx = ox + 1;
+    for (long long depth = 0;; ++cx) {
+        while (cx >= editorRowLen(E, cy)) {
+            if (cy + 1 >= (int)E.rows.size()) return false;
+            cy++;
+            cx = 0;
+        }
+        char ch = E.rows[size_t(cy)].raw_row[size_t(cx)];
+        if (ch == open) depth++;
+        if (ch == close && depth-- == 0) break;
+    }
+    y1 = oy;
+    x1 = (int)(around ? ox : ox + 1);
+    y2 = cy;
+    x2 = (int)(around ? cx + 1 : cx);
+    if (!around && x1 == editorRowLen(E, y1) && y1 < y2) {
+        y1++;
+        x1 = 0;
+    }
+    return true;
+}
+
+/** regular expressions */
+
+// patterns follow vim: magic by default, \v makes every operator special
+// without a backslash and \V makes them all need one; \c ignores case
+struct editorRegexParser {
+    const std::string& pattern;
+    size_t at = 0;
+    char magic = 'm';  // the last of \v, \m, \M and \V
+    bool ignore_case = false;
+    int groups = 0;
+    std::string error;
+
+    // the next char, and whether it is an operator rather than itself
+    std::pair<int, bool> next() {
+        while (at < pattern.size()) {
+            char c = pattern[at++];
+            const char* bare = magic == 'v'   ? ".*+?=@{}()|<>^$[~%"
+                               : magic == 'm' ? ".*[^$~"
+                               : magic == 'M' ? "^$"
+                                              : "";
+            if (c != '\\' || at == pattern.size())
+                return {(unsigned char)c, c != 0 && strchr(bare, c)};
+            char escaped = pattern[at++];
+            if (escaped != 0 && strchr("vmMV", escaped)) {
+                magic = escaped;
+                continue;
+            }
+            if (escaped == 'c' || escaped == 'C') {
+                ignore_case = escaped == 'c';
+                continue;
+            }
+            bool special = escaped != '\\' && escaped != '/' &&
+                           !(escaped != 0 && strchr(bare, escaped));
+            return {(unsigned char)escaped, special};
+        }
+        return {-1, false};
+    }
+
+    std::pair<int, bool> peek() {
+        size_t saved_at = at;
+        char saved_magic = magic;
+        bool saved_case = ignore_case;
+        auto token = next();
+        at = saved_at;
+        magic = saved_magic;
+        ignore_case = saved_case;
+        return token;
+    }
+
+    static bool ends(std::pair<int, bool> token) {
+        return token.first < 0 ||
+               (token.second && (token.first == '|' || token.first == ')'));
+    }
+
+    // code is built with jumps relative to the instruction, so that pieces
+    // can be copied for counted repeats
+    static editorRegexInst inst(int op, int x = 0, int y = 0) {
+        editorRegexInst i;
+        i.op = op;
+        i.x = x;
+        i.y = y;
+        return i;
+    }
+
+    static editorRegexInst set(std::bitset<256> bytes) {
+        editorRegexInst i = inst(RE_CHAR);
+        i.set = bytes;
+        return i;
+    }
+
+    // \s, \d, \w, \a, \l, \u, \x and \h, the upper case ones negated
+    static bool isClass(int c) {
+        return c > 0 && c < 128 && strchr("sSdDwWaAlLuUxXhH", c);
+    }
+
+    static std::bitset<256> byteClass(int c) {
+        std::bitset<256> bytes;
+        int lower = tolower(c);
+        for (int b = 0; b < 128; ++b) {
+            bool in = lower == 's'   ? b == ' ' || b == '\t'
+                      : lower == 'd' ? isdigit(b)
+                      : lower == 'w' ? isalnum(b) || b == '_'
+                      : lower == 'a' ? isalpha(b)
+                      : lower == 'l' ? islower(b)
+                      : lower == 'u' ? isupper(b)
+                      : lower == 'x' ? isxdigit(b)
+                                     : isalpha(b) || b == '_';
+            bytes[size_t(b)] = in;
+        }
+        if (isupper(c)) bytes.flip();
+        return bytes;
+    }
+
+    static std::bitset<256> namedClass(const std::string& name, bool& ok) {
+        std::bitset<256> bytes;
+        ok = true;
+        for (int b = 0; b < 128; ++b) {
+            bool in = name == "alpha"    ? isalpha(b)
+                      : name == "digit"  ? isdigit(b)
+                      : name == "alnum"  ? isalnum(b)
+                      : name == "space"  ? isspace(b)
+                      : name == "upper"  ? isupper(b)
+                      : name == "lower"  ? islower(b)
+                      : name == "punct"  ? ispunct(b)
+                      : name == "xdigit" ? isxdigit(b)
+                      : name == "blank"  ? b == ' ' || b == '\t'
+                                         : (ok = false);
+            bytes[size_t(b)] = in;
+        }
+        return bytes;
+    }
+
+    static unsigned char escapedByte(char c) {
+        return (unsigned char)(c == 't' ? '\t' : c == 'e' ? '\x1b'
+                               : c == 'r' ? '\r' : c == 'n' ? '\n' : c);
+    }
+
+    // [...] with ranges, [:name:] classes and backslash escapes; without a
+    // closing ] the [ stands for itself
+    std::vector<editorRegexInst> bracket() {
+        size_t start = at;
+        std::bitset<256> bytes;
+        bool negate = at < pattern.size() && pattern[at] == '^';
+        if (negate) at++;
+        for (bool first = true;
+             at < pattern.size() && (pattern[at] != ']' || first);
+             first = false) {
+            unsigned char lo = (unsigned char)pattern[at++];
+            if (lo == '[' && at < pattern.size() && pattern[at] == ':') {
+                size_t close = pattern.find(":]", at + 1);
+                bool ok = false;
+                if (close != std::string::npos)
+                    bytes |= namedClass(
+                        pattern.substr(at + 1, close - at - 1), ok);
+                if (ok) {
+                    at = close + 2;
+                    continue;
+                }
+            }
+            if (lo == '\\' && at < pattern.size()) {
+                if (isClass(pattern[at])) {
+                    bytes |= byteClass(pattern[at++]);
+                    continue;
+                }
+                lo = escapedByte(pattern[at++]);
+            }
+            unsigned char hi = lo;
+            if (at + 1 < pattern.size() && pattern[at] == '-' &&
+                pattern[at + 1] != ']') {
+                at++;
+                hi = (unsigned char)pattern[at++];
+                if (hi == '\\' && at < pattern.size())
+                    hi = escapedByte(pattern[at++]);
+                if (hi < lo) {
+                    error = "E944: Reverse range in character class";
+                    return {};
+                }
+            }
+            for (int b = lo; b <= hi; ++b) bytes.set(size_t(b));
+        }
+        if (at >= pattern.size()) {
+            at = start;
+            return {set(std::bitset<256>().set('['))};
+        }
+        at++;
+        if (negate) bytes.flip();
+        return {set(bytes)};
+    }
+
+    std::vector<editorRegexInst> group(bool capture) {
+        int n = capture ? ++groups : 0;
+        auto inner = alternation();
+        auto close = next();
+        if (error.empty() && !(close.second && close.first == ')'))
+            error = capture ? "E54: Unmatched \\(" : "E53: Unmatched \\%(";
+        if (!capture) return inner;
+        std::vector<editorRegexInst> code{inst(RE_SAVE, 2 * n)};
+        code.insert(code.end(), inner.begin(), inner.end());
+        code.push_back(inst(RE_SAVE, 2 * n + 1));
+        return code;
+    }
+
+    // vim items with no instruction here: lookaround, \zs and \ze, the \%
+    // items other than \%(, multi-line ones, back references, ~ and the
+    // classes that depend on options. They are refused rather than taken
+    // for the chars they are written with
+    static bool isUnsupported(int c) {
+        return c > 0 && c < 128 && strchr("@z_&~123456789iIkKfFpPoO", c);
+    }
+
+    std::vector<editorRegexInst> atom(bool first) {
+        size_t start = at;
+        auto [c, special] = next();
+        if (!special) return {set(std::bitset<256>().set(size_t(c)))};
+        if (isClass(c)) return {set(byteClass(c))};
+        bool item = c == '@' || c == 'z' || c == '%' || c == '_';
+        if (isUnsupported(c) ||
+            (c == '%' && (at == pattern.size() || pattern[at] != '('))) {
+            size_t end = std::min(at + (item ? 1 : 0), pattern.size());
+            error = "Unsupported pattern item: " +
+                    pattern.substr(start, end - start);
+            return {};
+        }
+        switch (c) {
+            case '.':
+                return {set(std::bitset<256>().set())};
+            case '[':
+                return bracket();
+            case '(':
+                return group(true);
+            case '%':
+                at++;
+                return group(false);
+            case '^':
+                if (!first) break;
+                return {inst(RE_ASSERT, RE_LINE_START)};
+            case '$':
+                if (!ends(peek())) break;
+                return {inst(RE_ASSERT, RE_LINE_END)};
+            case '<':
+                return {inst(RE_ASSERT, RE_WORD_START)};
+            case '>':
+                return {inst(RE_ASSERT, RE_WORD_END)};
+        }
+        return {set(std::bitset<256>().set(escapedByte((char)c)))};
+    }
+
+    // the count in \{n,m}, \{-n,m} for as few as possible
+    bool braces(long& min, long& max, bool& greedy) {
+        auto number = [&](long fallback) {
+            if (at >= pattern.size() || !isdigit(pattern[at])) return fallback;
+            long value = 0;
+            while (at < pattern.size() && isdigit(pattern[at]))
+                value = std::min(value * 10 + (pattern[at++] - '0'),
+                                 long(REGEX_MAX_PROGRAM));
+            return value;
+        };
+        greedy = !(at < pattern.size() && pattern[at] == '-');
+        if (!greedy) at++;
+        min = number(0);
+        max = min;
+        if (at < pattern.size() && pattern[at] == ',') {
+            at++;
+            max = number(-1);
+        } else if (at < pattern.size() && pattern[at] == '}' &&
+                   !isdigit(pattern[at - 1])) {
+            max = -1;  // \{} is the same as *
+        }
+        if (at < pattern.size() && pattern[at] == '\\') at++;
+        if (at >= pattern.size() || pattern[at] != '}') return false;
+        at++;
+        return max < 0 || min <= max;
+    }
+
+    std::vector<editorRegexInst> repeat(
+        const std::vector<editorRegexInst>& code, long min, long max,
+        bool greedy) {
+        int len = (int)code.size();
+        long copies = min + (max < 0 ? 1 : max - min);
+        if (copies * len > REGEX_MAX_PROGRAM) {
+            error = "E363: Pattern too long";
+            return {};
+        }
+        std::vector<editorRegexInst> out;
+        for (long i = 0; i < min; ++i)
+            out.insert(out.end(), code.begin(), code.end());
+        if (max < 0) {
+            out.push_back(greedy ? inst(RE_SPLIT, 1, len + 2)
+                                 : inst(RE_SPLIT, len + 2, 1));
+            out.insert(out.end(), code.begin(), code.end());
+            out.push_back(inst(RE_JMP, -(len + 1)));
+        }
+        for (long i = min; i < max; ++i) {
+            out.push_back(greedy ? inst(RE_SPLIT, 1, len + 1)
+                                 : inst(RE_SPLIT, len + 1, 1));
+            out.insert(out.end(), code.begin(), code.end());
+        }
+        return out;
+    }
+
+    std::vector<editorRegexInst> concat() {
+        std::vector<editorRegexInst> code;
+        for (bool first = true; error.empty() && !ends(peek()); first = false) {
+            auto piece = atom(first);
+            while (error.empty()) {
+                auto [c, special] = peek();
+                long min = 0, max = -1;
+                bool greedy = true;
+                if (!special || !(c == '*' || c == '+' || c == '=' ||
+                                  c == '?' || c == '{'))
+                    break;
+                next();
+                if (c == '+') min = 1;
+                if (c == '=' || c == '?') max = 1;
+                if (c == '{' && !braces(min, max, greedy)) {
+                    error = "E554: Syntax error in \\{...}";
+                    break;
+                }
+                piece = repeat(piece, min, max, greedy);
+            }
+            code.insert(code.end(), piece.begin(), piece.end());
+            if (code.size() > REGEX_MAX_PROGRAM)
+                error = "E363: Pattern too long";
+        }
+        return code;
+    }
+
+    std::vector<editorRegexInst> alternation() {
+        auto code = concat();
+        while (error.empty()) {
+            auto token = peek();
+            if (!(token.second && token.first == '|')) break;
+            next();
+            auto other = concat();
+            std::vector<editorRegexInst> both{
+                inst(RE_SPLIT, 1, (int)code.size() + 2)};
+            both.insert(both.end(), code.begin(), code.end());
+            both.push_back(inst(RE_JMP, (int)other.size() + 1));
+            both.insert(both.end(), other.begin(), other.end());
+            code = std::move(both);
+        }
+        return code;
+    }
+};
+
+std::shared_ptr<editorRegex> editorRegexCompile(const std::string& pattern,
+                                                std::string& error) {
+    editorRegexParser parser{pattern};
+    auto code = parser.alternation();
+    if (parser.error.empty() && parser.at < pattern.size())
+        parser.error = "E55: Unmatched \\)";
+    if (!parser.error.empty()) {
+        error = parser.error;
+        return NULL;
+    }
+    auto re = std::make_shared<editorRegex>();
+    auto& program = re->program;
+    re->groups = parser.groups;
+    program.push_back(editorRegexParser::inst(RE_SAVE, 0));
+    program.insert(program.end(), code.begin(), code.end());
+    program.push_back(editorRegexParser::inst(RE_SAVE, 1));
+    program.push_back(editorRegexParser::inst(RE_MATCH));
+    for (size_t i = 0; i < program.size(); ++i) {
+        auto& inst = program[i];
+        if (inst.op == RE_SPLIT || inst.op == RE_JMP) inst.x += (int)i;
+        if (inst.op == RE_SPLIT) inst.y += (int)i;
+        if (inst.op == RE_ASSERT && inst.x >= RE_WORD_START)
+            re->dfa_exact = false;
+        if (inst.op == RE_CHAR && parser.ignore_case)
+            for (size_t b = 'a'; b <= 'z'; ++b)
+                if (inst.set[b] || inst.set[b - 32])
+                    inst.set.set(b).set(b - 32);
+    }
+    // the first bytes let the program skip ahead while it has no threads
+    std::vector<int> pending{0};
+    std::vector<bool> seen(program.size());
+    while (!pending.empty()) {
+        int pc = pending.back();
+        pending.pop_back();
+        if (seen[size_t(pc)]) continue;
+        seen[size_t(pc)] = true;
+        const auto& inst = program[size_t(pc)];
+        if (inst.op == RE_CHAR) re->first |= inst.set;
+        if (inst.op == RE_MATCH) re->first_usable = false;
+        if (inst.op == RE_JMP || inst.op == RE_SPLIT) pending.push_back(inst.x);
+        if (inst.op == RE_SPLIT) pending.push_back(inst.y);
+        if (inst.op == RE_SAVE || inst.op == RE_ASSERT)
+            pending.push_back(pc + 1);
+    }
+    // the bytes every match starts with; plain text goes to the SIMD
+    // substring search instead of the program
+    for (size_t i = 1;
+         program[i].op == RE_CHAR && program[i].set.count() == 1; ++i)
+        for (int b = 0; b < 256; ++b)
+            if (program[i].set[size_t(b)]) re->prefix += (char)b;
+    re->literal = program.size() > 3 && re->prefix.size() + 3 == program.size();
+    if (re->literal) re->literal_text = re->prefix;
+    // bytes that no instruction tells apart share a DFA column
+    std::map<std::vector<bool>, int> classes;
+    for (int b = 0; b < 256; ++b) {
+        std::vector<bool> signature;
+        for (auto& inst : program)
+            if (inst.op == RE_CHAR) signature.push_back(inst.set[size_t(b)]);
+        auto it = classes.emplace(signature, (int)classes.size()).first;
+        re->byte_class[size_t(b)] = it->second;
+    }
+    re->classes = (int)classes.size();
+    re->marks.assign(program.size(), 0);
+    return re;
+}
+
+bool editorRegexAssert(int kind, std::string_view s, size_t pos) {
+    bool before = pos > 0 && editorCharClass(s[pos - 1], false) == CLASS_WORD;
+    bool after =
+        pos < s.size() && editorCharClass(s[pos], false) == CLASS_WORD;
+    switch (kind) {
+        case RE_LINE_START:
+            return pos == 0;
+        case RE_LINE_END:
+            return pos == s.size();
+        case RE_WORD_START:
+            return !before && after;
+        default:
+            return before && !after;
+    }
+}
+
+// adds the threads reachable from pc without reading a byte; a $ stays
+// pending unless at_end, since the DFA only learns where the row ends there
+void editorDfaClosure(editorRegex& re, int pc, bool at_start, bool at_end,
+                      std::vector<int>& out) {
+    if (re.marks[size_t(pc)] == re.generation) return;
+    re.marks[size_t(pc)] = re.generation;
+    const editorRegexInst& inst = re.program[size_t(pc)];
+    switch (inst.op) {
+        case RE_JMP:
+            editorDfaClosure(re, inst.x, at_start, at_end, out);
+            break;
+        case RE_SPLIT:
+            editorDfaClosure(re, inst.x, at_start, at_end, out);
+            editorDfaClosure(re, inst.y, at_start, at_end, out);
+            break;
+        case RE_SAVE:
+            editorDfaClosure(re, pc + 1, at_start, at_end, out);
+            break;
+        case RE_ASSERT:
+            if (inst.x == RE_LINE_START && at_start)
+                editorDfaClosure(re, pc + 1, at_start, at_end, out);
+            else if (inst.x == RE_LINE_END && at_end)
+                editorDfaClosure(re, pc + 1, at_start, at_end, out);
+            else if (inst.x == RE_LINE_END)
+                out.push_back(pc);
+            else if (inst.x >= RE_WORD_START)
+                editorDfaClosure(re, pc + 1, at_start, at_end, out);
+            break;
+        default:
+            out.push_back(pc);
+    }
+}
+
+void editorDfaNewGeneration(editorRegex& re) {
+    if (++re.generation == 0) {
+        std::fill(re.marks.begin(), re.marks.end(), 0);
+        re.generation = 1;
+    }
+}
+
+// the state for a set of threads, -1 once the state cache is full
+int editorDfaFind(editorRegex& re, std::vector<int>& pcs) {
+    std::sort(pcs.begin(), pcs.end());
+    auto it = re.state_ids.find(pcs);
+    if (it != re.state_ids.end()) return it->second;
+    if (re.states.size() >= REGEX_MAX_DFA_STATES) return -1;
+    editorDfaState state;
+    for (int pc : pcs)
+        if (re.program[size_t(pc)].op == RE_MATCH) state.match = true;
+    state.pcs = pcs;
+    int id = (int)re.states.size();
+    re.states.push_back(std::move(state));
+    re.state_ids.emplace(std::move(pcs), id);
+    re.transitions.resize(re.states.size() * size_t(re.classes), -1);
+    return id;
+}
+
+// a new match may start at any byte, so every state carries the start
+int editorDfaStep(editorRegex& re, const std::vector<int>& from,
+                  unsigned char byte) {
+    editorDfaNewGeneration(re);
+    std::vector<int> pcs;
+    for (int pc : from) {
+        const editorRegexInst& inst = re.program[size_t(pc)];
+        if (inst.op == RE_CHAR && inst.set[byte])
+            editorDfaClosure(re, pc + 1, false, false, pcs);
+    }
+    editorDfaClosure(re, 0, false, false, pcs);
+    return editorDfaFind(re, pcs);
+}
+
+// the state before any byte is read, at column 0 or away from it
+int editorDfaStart(editorRegex& re, bool at_start) {
+    int& state = re.start[at_start];
+    if (state < 0) {
+        editorDfaNewGeneration(re);
+        std::vector<int> pcs;
+        editorDfaClosure(re, 0, at_start, false, pcs);
+        state = editorDfaFind(re, pcs);
+    }
+    return state;
+}
+
+void editorDfaFlush(editorRegex& re) {
+    re.states.clear();
+    re.state_ids.clear();
+    re.transitions.clear();
+    re.start[0] = re.start[1] = -1;
+    re.flushes++;
+}
+
+// builds the transition of the state at row on byte and returns it as the
+// table holds it: the next state's row, or -2 into a match. -3 when the
+// states had to be dropped too often and the program should run instead;
+// dropping them renumbers the states, so other rows in hand go stale when
+// re.flushes changes
+int editorDfaMiss(editorRegex& re, int row, unsigned char byte) {
+    int classes = re.classes;
+    int state = row / classes;
+    std::vector<int> current = re.states[size_t(state)].pcs;
+    int found = editorDfaStep(re, current, byte);
+    if (found < 0) {
+        // start over with only the state in hand
+        if (re.flushes >= REGEX_MAX_DFA_FLUSHES) {
+            re.flushes++;
+            return -3;
+        }
+        editorDfaFlush(re);
+        state = editorDfaFind(re, current);
+        found = editorDfaStep(re, current, byte);
+    }
+    int next = re.states[size_t(found)].match ? -2 : found * classes;
+    re.transitions[size_t(state * classes + re.byte_class[byte])] = next;
+    return next;
+}
+
+// whether a row ending in state has a match
+bool editorDfaMatchesAtEnd(editorRegex& re, int state) {
+    editorDfaState& last = re.states[size_t(state)];
+    if (last.match) return true;
+    if (last.match_at_end < 0) {
+        editorDfaNewGeneration(re);
+        std::vector<int> pcs;
+        for (int pc : last.pcs)
+            if (re.program[size_t(pc)].op == RE_ASSERT)
+                editorDfaClosure(re, pc + 1, false, true, pcs);
+        last.match_at_end = 0;
+        for (int pc : pcs)
+            if (re.program[size_t(pc)].op == RE_MATCH) last.match_at_end = 1;
+    }
+    return last.match_at_end;
+}
+
+// whether s has a match starting at or after from, one table lookup per
+// byte once the states met are built; -1 when the pattern needs more states
+// than the cache holds too often and the caller should run the program
+int editorDfaSearch(editorRegex& re, std::string_view s, size_t from) {
+    if (re.flushes > REGEX_MAX_DFA_FLUSHES) return -1;
+    if (re.states.size() + 2 > REGEX_MAX_DFA_STATES) editorDfaFlush(re);
+    int classes = re.classes;
+    int idle = editorDfaStart(re, false);
+    int state = editorDfaStart(re, from == 0);
+    if (re.states[size_t(state)].match) return 1;
+    const int* table = re.transitions.data();
+    int row = state * classes;  // where the state's transitions start
+    // with no match under way only a byte that can start one changes state
+    int idle_row = re.first_usable ? idle * classes : -1;
+    bool dead = re.states[size_t(idle)].pcs.empty();
+    for (size_t i = from; i < s.size(); ++i) {
+        if (row == idle_row) {
+            if (dead) break;
+            while (i < s.size() && !re.first[(unsigned char)s[i]]) i++;
+            if (i == s.size()) break;
+        }
+        unsigned char byte = (unsigned char)s[i];
+        int next = table[row + re.byte_class[byte]];
+        if (next >= 0) {
+            row = next;
+            continue;
+        }
+        if (next == -2) return 1;  // into a match state
+        int flushes = re.flushes;
+        next = editorDfaMiss(re, row, byte);
+        if (next == -3) return -1;
+        if (re.flushes != flushes && idle_row >= 0)
+            idle_row = editorDfaStart(re, false) * classes;
+        table = re.transitions.data();
+        if (next == -2) return 1;
+        row = next;
+    }
+    return editorDfaMatchesAtEnd(re, row / classes);
+}
+
+// like editorDfaSearch for text holding many rows, each ending in \n or
+// \r\n, without a call per row: 1 with from moved to the start of the first
+// row from there on that has a match, 0 when none has. On -1 from is the
+// start of the row the DFA gave up in
+int editorDfaSearchRows(editorRegex& re, std::string_view text,
+                        size_t& from) {
+    if (re.flushes > REGEX_MAX_DFA_FLUSHES) return -1;
+    if (re.states.size() + 2 > REGEX_MAX_DFA_STATES) editorDfaFlush(re);
+    int classes = re.classes;
+    int idle = editorDfaStart(re, false);
+    int start = editorDfaStart(re, true);
+    if (re.states[size_t(start)].match) return 1;
+    const int* table = re.transitions.data();
+    int start_row = start * classes;
+    int idle_row = re.first_usable ? idle * classes : -1;
+    bool dead = re.states[size_t(idle)].pcs.empty();
+    std::bitset<256> stops = re.first;
+    stops.set('\n').set('\r');
+    size_t size = text.size(), row_start = from;
+    int row = start_row;
+    for (size_t i = from;; ++i) {
+        if (row == idle_row) {
+            if (dead) {
+                const char* end = (const char*)memchr(text.data() + i, '\n',
+                                                      size - i);
+                i = end ? size_t(end - text.data()) : size;
+            }
+            while (i < size && !stops[(unsigned char)text[i]]) i++;
+        }
+        unsigned char byte = i < size ? (unsigned char)text[i] : '\n';
+        if (byte == '\r' && (i + 1 == size || text[i + 1] == '\n')) byte = '\n';
+        if (byte == '\n') {
+            if (editorDfaMatchesAtEnd(re, row / classes)) {
+                from = row_start;
+                return 1;
+            }
+            if (text[i] == '\r') i++;
+            if (i + 1 >= size) return 0;
+            row_start = i + 1;
+            row = start_row;
+            continue;
+        }
+        int next = table[row + re.byte_class[byte]];
+        if (next >= 0) {
+            row = next;
+            continue;
+        }
+        if (next != -2) {
+            int flushes = re.flushes;
+            next = editorDfaMiss(re, row, byte);
+            if (next == -3) {
+                from = row_start;
+                return -1;
+            }
+            if (re.flushes != flushes) {
+                idle = editorDfaStart(re, false);
+                start_row = editorDfaStart(re, true) * classes;
+                if (idle_row >= 0) idle_row = idle * classes;
+            }
+            table = re.transitions.data();
+        }
+        if (next == -2) {
+            from = row_start;
+            return 1;
+        }
+        row = next;
+    }
+}
+
+// runs the program over s from from on as a Pike VM: threads are kept in
+// priority order and those behind a match are dropped, which finds the
+// match a backtracker would, in time linear in the row; caps gets the
+// match and its groups as pairs of offsets
+bool editorRegexExec(const editorRegex& re, std::string_view s, size_t from,
+                     std::vector<size_t>& caps) {
+    if (from > s.size()) return false;
+    size_t slots = 2 * size_t(re.groups + 1);
+    // per-thread buffers, so matching row after row does not allocate
+    static thread_local std::vector<int> current, next;
+    static thread_local std::vector<size_t> current_caps, next_caps;
+    static thread_local std::vector<size_t> scratch;
+    static thread_local std::vector<unsigned> marks;
+    current.clear();
+    next.clear();
+    current_caps.clear();
+    next_caps.clear();
+    scratch.assign(slots, std::string::npos);
+    marks.assign(re.program.size(), 0);
+    unsigned generation = 1;
+    auto add = [&](auto& self, std::vector<int>& list,
+                   std::vector<size_t>& list_caps, int pc,
+                   size_t pos) -> void {
+        if (marks[size_t(pc)] == generation) return;
+        marks[size_t(pc)] = generation;
+        const editorRegexInst& inst = re.program[size_t(pc)];
+        switch (inst.op) {
+            case RE_JMP:
+                self(self, list, list_caps, inst.x, pos);
+                break;
+            case RE_SPLIT:
+                self(self, list, list_caps, inst.x, pos);
+                self(self, list, list_caps, inst.y, pos);
+                break;
+            case RE_SAVE: {
+                size_t old = scratch[size_t(inst.x)];
+                scratch[size_t(inst.x)] = pos;
+                self(self, list, list_caps, pc + 1, pos);
+                scratch[size_t(inst.x)] = old;
+                break;
+            }
+            case RE_ASSERT:
+                if (editorRegexAssert(inst.x, s, pos))
+                    self(self, list, list_caps, pc + 1, pos);
+                break;
+            default:
+                list.push_back(pc);
+                list_caps.insert(list_caps.end(), scratch.begin(),
+                                 scratch.end());
+        }
+    };
+    bool matched = false;
+    for (size_t pos = from;; ++pos) {
+        // a match may also start here, with the least priority
+        if (!matched) {
+            if (current.empty() && re.first_usable) {
+                while (pos < s.size() && !re.first[(unsigned char)s[pos]])
+                    pos++;
+                generation++;
+            }
+            std::fill(scratch.begin(), scratch.end(), std::string::npos);
+            add(add, current, current_caps, 0, pos);
+        }
+        if (pos == s.size()) {
+            for (size_t i = 0; i < current.size(); ++i) {
+                if (re.program[size_t(current[i])].op != RE_MATCH) continue;
+                caps.assign(current_caps.begin() + long(i * slots),
+                            current_caps.begin() + long((i + 1) * slots));
+                matched = true;
+                break;
+            }
+            break;
+        }
+        generation++;
+        unsigned char byte = (unsigned char)s[pos];
+        for (size_t i = 0; i < current.size(); ++i) {
+            const editorRegexInst& inst = re.program[size_t(current[i])];
+            auto thread_caps = current_caps.begin() + long(i * slots);
+            if (inst.op == RE_MATCH) {
+                // threads after this one have less priority
+                caps.assign(thread_caps, thread_caps + long(slots));
+                matched = true;
+                break;
+            }
+            if (!inst.set[byte]) continue;
+            std::copy(thread_caps, thread_caps + long(slots), scratch.begin());
+            add(add, next, next_caps, current[i] + 1, pos + 1);
+        }
+        std::swap(current, next);
+        std::swap(current_caps, next_caps);
+        next.clear();
+        next_caps.clear();
+        if (matched && current.empty()) break;
+    }
+    return matched;
+}
+
+// compiled patterns are kept, so repeated searches reuse both the program
+// and the DFA states built so far
+std::shared_ptr<editorRegex> editorRegexGet(editorConfig& E,
+                                            const std::string& pattern,
+                                            std::string* error = NULL) {
+    auto it = E.regex_cache.find(pattern);
+    if (it != E.regex_cache.end()) return it->second;
+    std::string message;
+    auto re = editorRegexCompile(pattern, message);
+    if (!re) {
+        if (error) *error = message;
+        return NULL;
+    }
+    if (E.regex_cache.size() >= REGEX_CACHE_SIZE) E.regex_cache.clear();
+    E.regex_cache.emplace(pattern, re);
+    return re;
+}
+
+/** workers */
+
+void editorWorkerLoop(editorWorkers& workers) {
+    while (true) {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> guard(workers.lock);
+            workers.wake.wait(guard, [&] {
+                return workers.stopping || !workers.jobs.empty();
+            });
+            if (workers.jobs.empty()) return;
+            job = std::move(workers.jobs.front());
+            workers.jobs.pop_front();
+        }
+        job();
+    }
+}
+
+size_t editorWorkerCount(editorConfig& E) {
+    auto& threads = E.workers.threads;
+    if (threads.empty()) {
+        unsigned count = std::max(std::thread::hardware_concurrency(), 1u);
+        for (unsigned i = 0; i < count; ++i)
+            threads.emplace_back(editorWorkerLoop, std::ref(E.workers));
+    }
+    return threads.size();
+}
+
+// runs task(i, worker) for every i below count, worker telling the threads
+// apart for state of their own. merge(i) runs on this thread in order of i
+// as soon as the tasks up to i are done, and the screen is redrawn now and
+// then meanwhile; a key press cancels the tasks not started yet. The tasks
+// may read the buffer: merge may only change rows of tasks already done, in
+// place, and nothing else moves rows until this returns. Returns whether
+// every task ran
+bool editorParallelFor(editorConfig& E, size_t count,
+                       const std::function<void(size_t, size_t)>& task,
+                       const std::function<void(size_t)>& merge) {
+    size_t workers = std::min(editorWorkerCount(E), count);
+    if (count == 1) {
+        // not worth a round trip through a worker
+        task(0, 0);
+        merge(0);
+        return true;
+    }
+    std::mutex lock;
+    std::condition_variable finished;
+    std::vector<char> done(count, 0);
+    std::atomic<size_t> next{0};
+    std::atomic<bool> cancelled{false};
+    size_t running = workers;
+    {
+        std::lock_guard<std::mutex> guard(E.workers.lock);
+        for (size_t worker = 0; worker < workers; ++worker)
+            E.workers.jobs.push_back([&, worker] {
+                size_t i;
+                while (!cancelled && (i = next++) < count) {
+                    task(i, worker);
+                    std::lock_guard<std::mutex> guard(lock);
+                    done[i] = 1;
+                    finished.notify_one();
+                }
+                std::lock_guard<std::mutex> guard(lock);
+                running--;
+                finished.notify_one();
+            });
+    }
+    E.workers.wake.notify_all();
+    auto interval = std::chrono::milliseconds(PARALLEL_REDRAW_MS);
+    auto redrawn = std::chrono::steady_clock::now();
+    size_t merged = 0;
+    std::unique_lock<std::mutex> guard(lock);
+    while (true) {
+        finished.wait_for(guard, interval, [&] {
+            return running == 0 || (merged < count && done[merged]);
+        });
+        while (merged < count && done[merged]) {
+            guard.unlock();
+            merge(merged++);
+            guard.lock();
+        }
+        if (running == 0) break;
+        guard.unlock();
+        if (editorInputPending(E)) cancelled = true;
+        if (std::chrono::steady_clock::now() - redrawn >= interval) {
+            editorRefreshScreen(E);
+            redrawn = std::chrono::steady_clock::now();
+        }
+        guard.lock();
+    }
+    return merged == count;
+}
+
+/** search */
+
+// the first match of pattern starting at or after from; the SSE2 loop only
+// compares in full where both the first and the last byte of pattern match
+size_t editorFindForward(std::string_view s, size_t from,
+                         std::string_view pattern) {
+    size_t m = pattern.size();
+    if (m == 0 || s.size() < m || from > s.size() - m)
+        return std::string::npos;
+    size_t last = s.size() - m;  // where the last possible match starts
+    size_t i = from;
+#ifdef __SSE2__
+    __m128i first = _mm_set1_epi8(pattern[0]);
+    __m128i final = _mm_set1_epi8(pattern[m - 1]);
+    for (; i + 16 <= last + 1; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(s.data() + i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(s.data() + i + m - 1));
+        unsigned mask = (unsigned)_mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, final)));
+        for (; mask; mask &= mask - 1) {
+            size_t at = i + size_t(__builtin_ctz(mask));
+            if (m <= 2 ||
+                memcmp(s.data() + at + 1, pattern.data() + 1, m - 2) == 0)
+                return at;
+        }
+    }
+#endif
+    while (i <= last) {
+        const char* hit =
+            (const char*)memchr(s.data() + i, pattern[0], last - i + 1);
+        if (!hit) break;
+        i = size_t(hit - s.data());
+        if (memcmp(hit, pattern.data(), m) == 0) return i;
+        i++;
+    }
+    return std::string::npos;
+}
+
+// the last match of pattern starting at or before to
+size_t editorFindBackward(std::string_view s, size_t to,
+                          std::string_view pattern) {
+    size_t m = pattern.size();
+    if (m == 0 || s.size() < m) return std::string::npos;
+    size_t i = std::min(to, s.size() - m) + 1;  // matches start before i
+#ifdef __SSE2__
+    __m128i first = _mm_set1_epi8(pattern[0]);
+    __m128i final = _mm_set1_epi8(pattern[m - 1]);
+    for (; i >= 16; i -= 16) {
+        const char* block = s.data() + i - 16;
+        __m128i a = _mm_loadu_si128((const __m128i*)block);
+        __m128i b = _mm_loadu_si128((const __m128i*)(block + m - 1));
+        unsigned mask = (unsigned)_mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, final)));
+        while (mask) {
+            int high = 31 - __builtin_clz(mask);
+            size_t at = i - 16 + size_t(high);
+            if (m <= 2 ||
+                memcmp(s.data() + at + 1, pattern.data() + 1, m - 2) == 0)
+                return at;
+            mask &= ~(1u << high);
+        }
+    }
+#endif
+    while (i-- > 0)
+        if (s[i] == pattern[0] && memcmp(&s[i], pattern.data(), m) == 0)
+            return i;
+    return std::string::npos;
+}
+
+// the first match of re in s starting at or after from, its end in *end;
+// plain text takes the SIMD path, anything else is ruled out per row by the
+// DFA before the program runs to find where the match is
+size_t editorRegexFind(editorRegex& re, std::string_view s, size_t from,
+                       size_t* end = NULL) {
+    if (re.literal) {
+        size_t at = editorFindForward(s, from, re.literal_text);
+        if (end && at != std::string::npos) *end = at + re.literal_text.size();
+        return at;
+    }
+    if (from > s.size()) return std::string::npos;
+    if (editorDfaSearch(re, s, from) == 0) return std::string::npos;
+    std::vector<size_t> caps;
+    if (!editorRegexExec(re, s, from, caps)) return std::string::npos;
+    if (end) *end = caps[1];
+    return caps[0];
+}
+
+// editorRegexFind with the groups too, in caps as start and end pairs
+bool editorRegexMatch(editorRegex& re, std::string_view s, size_t from,
+                      std::vector<size_t>& caps) {
+    if (re.literal || re.groups == 0) {
+        size_t end, at = editorRegexFind(re, s, from, &end);
+        caps.assign({at, end});
+        return at != std::string::npos;
+    }
+    if (from > s.size()) return false;
+    if (editorDfaSearch(re, s, from) == 0) return false;
+    return editorRegexExec(re, s, from, caps);
+}
+
+// the start of the last match of re in s starting at or before to
+size_t editorRegexFindBackward(editorRegex& re, std::string_view s,
+                               size_t to) {
+    if (re.literal) return editorFindBackward(s, to, re.literal_text);
+    size_t last = std::string::npos;
+    std::vector<size_t> caps;
+    if (editorDfaSearch(re, s, 0) == 0) return last;
+    for (size_t from = 0;
+         from <= to && editorRegexExec(re, s, from, caps) && caps[0] <= to;
+         from = caps[0] + 1)
+        last = caps[0];
+    return last;
+}
+
+bool editorRegexContains(editorRegex& re, std::string_view s) {
+    if (re.literal)
+        return editorFindForward(s, 0, re.literal_text) != std::string::npos;
+    int found = editorDfaSearch(re, s, 0);
+    if (found == 0 || (found > 0 && re.dfa_exact)) return found > 0;
+    std::vector<size_t> caps;
+    return editorRegexExec(re, s, 0, caps);
+}
+
+// calls found(x, end) for each match in s, going on after the end of each
+// like :s does; an empty match right where the last one ended is skipped
+template <typename Found>
+void editorForEachMatch(editorRegex& re, std::string_view s, Found found) {
+    size_t last = std::string::npos, end;
+    for (size_t from = 0, at;
+         (at = editorRegexFind(re, s, from, &end)) != std::string::npos;
+         from = std::max(end, at + 1)) {
+        if (at == end && at == last) continue;
+        found(at, end);
+        last = end;
+    }
+}
+
+// moves (y, x) to the next match after it, or the one before it, going round
+// the ends of the file and finally back to row y itself
+bool editorSearchFrom(editorConfig& E, editorRegex& re, bool forward, int& y,
+                      int& x, bool& wrapped) {
+    size_t rows = E.rows.size();
+    for (size_t k = 0; k <= rows; ++k) {
+        size_t r = forward ? (size_t(y) + k) % rows
+                           : (size_t(y) + rows - k % rows) % rows;
+        const std::string& row = E.rows[r].raw_row;
+        size_t at;
+        if (k == 0 && forward)
+            at = editorRegexFind(re, row, size_t(x) + 1);
+        else if (k == 0)
+            at = x > 0 ? editorRegexFindBackward(re, row, size_t(x) - 1)
+                       : std::string::npos;
+        else if (forward)
+            at = editorRegexFind(re, row, 0);
+        else
+            at = editorRegexFindBackward(re, row, row.size());
+        if (at == std::string::npos) continue;
+        if (forward ? size_t(y) + k >= rows : k > size_t(y)) wrapped = true;
+        y = (int)r;
+        x = (int)at;
+        return true;
+    }
+    return false;
+}
+
+// jumps to the count-th match of the last pattern, in its direction unless
+// reverse is set
+bool editorSearch(editorConfig& E, bool reverse, long long count) {
+    if (E.search_pattern.empty()) {
+        editorSetStatusMessage(E, "No previous search pattern");
+        return false;
+    }
+    std::string error;
+    auto re = editorRegexGet(E, E.search_pattern, &error);
+    if (!re) {
+        editorSetStatusMessage(E, "%s", error.c_str());
+        return false;
+    }
+    E.hlsearch_hidden = false;
+    bool forward = E.search_forward != reverse;
+    int y = E.cursor_y, x = E.cursor_x;
+    if (y >= (int)E.rows.size()) {
+        y = (int)E.rows.size() - 1;
+        x = editorRowLen(E, y);
+    }
+    bool wrapped = false;
+    for (long long i = 0; i < count; ++i) {
+        if (E.rows.empty() ||
+            !editorSearchFrom(E, *re, forward, y, x, wrapped)) {
+            editorSetStatusMessage(E, "Pattern not found: %s",
+                                   E.search_pattern.c_str());
+            return false;
+        }
+    }
+    E.cursor_y = y;
+    E.cursor_x = x;
+    if (wrapped)
+        editorSetStatusMessage(E, forward
+                                   ? "search hit BOTTOM, continuing at TOP"
+                                   : "search hit TOP, continuing at BOTTOM");
+    else
+        editorSetStatusMessage(E, "%c%s", forward ? '/' : '?',
+                               E.search_pattern.c_str());
+    return true;
+}
+
+// the row a search from the origin meets after rank others
+int editorIncrementalRow(editorConfig& E, size_t rank) {
+    size_t rows = E.rows.size(), origin = size_t(E.incsearch.origin_y);
+    return (int)(E.command_prompt == '/' ? (origin + rank) % rows
+                                         : (origin + rows - rank) % rows);
+}
+
+size_t editorIncrementalRank(editorConfig& E, int row) {
+    size_t rows = E.rows.size(), origin = size_t(E.incsearch.origin_y);
+    return E.command_prompt == '/' ? (size_t(row) + rows - origin) % rows
+                                   : (origin + rows - size_t(row)) % rows;
+}
+
+// decides about budget bytes worth of rows for the longest prefix; a row can
+// only match plain text if it matched a prefix of that text, so where the
+// shorter one is decided only its hits are looked at
+bool editorIncrementalScan(editorConfig& E, size_t budget) {
+    auto& levels = E.incsearch.levels;
+    editorSearchLevel& level = levels.back();
+    const editorSearchLevel* parent =
+        levels.size() > 1 ? &levels[levels.size() - 2] : NULL;
+    if (parent && !(parent->regex && parent->regex->literal &&
+                    level.regex->literal &&
+                    level.regex->literal_text.rfind(
+                        parent->regex->literal_text, 0) == 0))
+        parent = NULL;
+    size_t rows = E.rows.size();
+    while (level.done < rows) {
+        if (budget == 0) return false;
+        int row;
+        if (parent && level.parent_hits < parent->hits.size()) {
+            row = parent->hits[level.parent_hits++];
+            level.done = editorIncrementalRank(E, row) + 1;
+        } else {
+            if (parent) level.done = std::max(level.done, parent->done);
+            if (level.done >= rows) break;
+            row = editorIncrementalRow(E, level.done++);
+        }
+        const std::string& raw = E.rows[size_t(row)].raw_row;
+        budget -= std::min(budget, raw.size() + 1);
+        if (editorRegexContains(*level.regex, raw)) level.hits.push_back(row);
+    }
+    return true;
+}
+
+// moves the cursor to the match nearest to the origin once it is known
+bool editorIncrementalJump(editorConfig& E) {
+    const auto& inc = E.incsearch;
+    const editorSearchLevel& level = inc.levels.back();
+    editorRegex& re = *level.regex;
+    bool forward = E.command_prompt == '/';
+    for (int row : level.hits) {
+        const std::string& raw = E.rows[size_t(row)].raw_row;
+        if (row != inc.origin_y) {
+            E.cursor_y = row;
+            E.cursor_x = (int)(forward ? editorRegexFind(re, raw, 0)
+                                       : editorRegexFindBackward(
+                                             re, raw, raw.size()));
+            return true;
+        }
+        // the origin row comes first only with a match past the cursor
+        size_t x = size_t(inc.origin_x);
+        size_t at = forward ? editorRegexFind(re, raw, x + 1)
+                  : x > 0   ? editorRegexFindBackward(re, raw, x - 1)
+                            : std::string::npos;
+        if (at != std::string::npos) {
+            E.cursor_y = row;
+            E.cursor_x = (int)at;
+            return true;
+        }
+    }
+    if (level.done < E.rows.size() || level.hits.empty()) return false;
+    // the only match is in the origin row, on the far side of the cursor
+    const std::string& raw = E.rows[size_t(inc.origin_y)].raw_row;
+    E.cursor_y = inc.origin_y;
+    E.cursor_x = (int)(forward ? editorRegexFind(re, raw, 0)
+                               : editorRegexFindBackward(re, raw, raw.size()));
+    return true;
+}
+
+void editorIncrementalStart(editorConfig& E) {
+    auto& inc = E.incsearch;
+    inc.levels.clear();
+    inc.origin_y = E.cursor_y;
+    inc.origin_x = E.cursor_x;
+    inc.row_offset = E.row_offset;
+    inc.col_offset = E.col_offset;
+}
+
+// puts the cursor and the view back where the search began
+void editorIncrementalRestore(editorConfig& E) {
+    const auto& inc = E.incsearch;
+    E.cursor_y = inc.origin_y;
+    E.cursor_x = inc.origin_x;
+    E.row_offset = inc.row_offset;
+    E.col_offset = inc.col_offset;
+}
+
+// follows the pattern as it is typed: the rows matching each prefix are kept,
+// so a longer pattern only rechecks the rows the shorter one matched and a
+// backspace reuses them as they are; the scan gives up as soon as another key
+// is waiting, leaving what it decided for the next pattern
+void editorIncrementalSearch(editorConfig& E) {
+    auto& levels = E.incsearch.levels;
+    const std::string& pattern = E.command_buf;
+    while (!levels.empty() && pattern.rfind(levels.back().pattern, 0) != 0)
+        levels.pop_back();
+    if (!pattern.empty() &&
+        (levels.empty() || levels.back().pattern != pattern)) {
+        levels.emplace_back();
+        levels.back().pattern = pattern;
+        levels.back().regex = editorRegexGet(E, pattern);
+    }
+    editorIncrementalRestore(E);
+    // a pattern half typed may not compile yet
+    if (levels.empty() || !levels.back().regex ||
+        E.cursor_y >= (int)E.rows.size())
+        return;
+    bool moved = false;
+    while (true) {
+        bool done = editorIncrementalScan(E, INCSEARCH_SCAN_BYTES);
+        if (!moved && editorIncrementalJump(E)) {
+            moved = true;
+            if (!done) editorRefreshScreen(E);
+        }
+        if (done || editorInputPending(E)) return;
+    }
+}
+
+// the pattern to highlight with hlsearch on; rows keep their matches until
+// they are edited or the pattern changes
+std::shared_ptr<editorRegex> editorHighlightRegex(editorConfig& E) {
+    if (!E.hlsearch || E.hlsearch_hidden || E.search_pattern.empty())
+        return NULL;
+    if (E.search_pattern != E.hlsearch_pattern) {
+        E.hlsearch_pattern = E.search_pattern;
+        E.hlsearch_key++;
+    }
+    return editorRegexGet(E, E.search_pattern);
+}
+
+const std::vector<int>& editorRowMatches(editorConfig& E, editorRow& row,
+                                         editorRegex& re) {
+    if (row.matches_key == E.hlsearch_key &&
+        row.matches_generation == row.generation)
+        return row.matches;
+    row.matches.clear();
+    editorForEachMatch(re, row.raw_row, [&](size_t at, size_t end) {
+        row.matches.push_back((int)at);
+        row.matches.push_back((int)end);
+    });
+    row.matches_key = E.hlsearch_key;
+    row.matches_generation = row.generation;
+    return row.matches;
+}
+
+// runs the pattern typed after / or ?, an empty one repeats the last search
+void editorSearchCommand(editorConfig& E) {
+    editorIncrementalRestore(E);
+    E.incsearch.levels.clear();
+    if (!E.command_buf.empty()) E.search_pattern = E.command_buf;
+    E.search_forward = E.command_prompt == '/';
+    editorSearch(E, false, 1);
+}
+
+// the pattern between the delimiters at the start of arg, as in /pat/, with
+// backslashes kept for the regex; at is left after the closing delimiter
+std::string editorParsePattern(const std::string& arg, size_t& at) {
+    while (at < arg.size() && arg[at] == ' ') at++;
+    if (at == arg.size() || isalnum((unsigned char)arg[at]) ||
+        arg[at] == '\\' || arg[at] == '"' || arg[at] == '|')
+        return "";
+    char delimiter = arg[at++];
+    std::string pattern;
+    for (; at < arg.size() && arg[at] != delimiter; ++at) {
+        if (arg[at] == '\\' && at + 1 < arg.size()) pattern += arg[at++];
+        pattern += arg[at];
+    }
+    if (at < arg.size()) at++;
+    return pattern;
+}
+
+// compiles pattern, or the last search pattern when it is empty, which
+// pattern then becomes
+std::shared_ptr<editorRegex> editorUsePattern(editorConfig& E,
+                                              const std::string& pattern) {
+    if (!pattern.empty()) E.search_pattern = pattern;
+    E.hlsearch_hidden = false;
+    if (E.search_pattern.empty()) {
+        editorSetStatusMessage(E, "E35: No previous regular expression");
+        return NULL;
+    }
+    std::string error;
+    auto re = editorRegexGet(E, E.search_pattern, &error);
+    if (!re) editorSetStatusMessage(E, "%s", error.c_str());
+    return re;
+}
+
+// counts the matches in every row, split in chunks of rows over the workers,
+// each with a copy of the pattern since the DFA grows as it runs; with list
+// set the matches go to the list view as well, in order as chunks are merged
+bool editorSearchAll(editorConfig& E, const editorRegex& re, bool list,
+                     size_t& matches, size_t& lines) {
+    size_t rows = E.rows.size();
+    size_t chunks = (rows + PARALLEL_CHUNK_ROWS - 1) / PARALLEL_CHUNK_ROWS;
+    std::vector<editorRegex> copies(std::min(editorWorkerCount(E), chunks), re);
+    std::vector<std::vector<editorListEntry>> found(chunks);
+    std::vector<size_t> chunk_matches(chunks), chunk_lines(chunks);
+    matches = lines = 0;
+    auto task = [&](size_t chunk, size_t worker) {
+        size_t end = std::min((chunk + 1) * PARALLEL_CHUNK_ROWS, rows);
+        for (size_t y = chunk * PARALLEL_CHUNK_ROWS; y < end; ++y) {
+            size_t before = chunk_matches[chunk];
+            editorForEachMatch(
+                copies[worker], E.rows[y].raw_row, [&](size_t x, size_t) {
+                    chunk_matches[chunk]++;
+                    if (list)
+                        found[chunk].push_back({(int)y, (int)x, E.number});
+                });
+            if (chunk_matches[chunk] > before) chunk_lines[chunk]++;
+        }
+    };
+    auto merge = [&](size_t chunk) {
+        matches += chunk_matches[chunk];
+        lines += chunk_lines[chunk];
+        if (list) {
+            auto& entries = E.list.entries;
+            entries.insert(entries.end(), found[chunk].begin(),
+                           found[chunk].end());
+            std::vector<editorListEntry>().swap(found[chunk]);
+        }
+        editorSetStatusMessage(E, "%zu matches on %zu lines...", matches,
+                               lines);
+    };
+    return editorParallelFor(E, chunks, task, merge);
+}
+
+// :count /pat/ reports how many matches there are, :matches /pat/ lists them
+void editorCountMatches(editorConfig& E, const std::string& arg, bool list) {
+    size_t at = 0;
+    std::string pattern = editorParsePattern(arg, at);
+    auto re = editorUsePattern(E, pattern);
+    if (!re) return;
+    if (list) {
+        E.list = editorListView();
+        E.list.active = true;
+        E.list.title = "/" + E.search_pattern;
+    }
+    size_t matches, lines;
+    bool complete = editorSearchAll(E, *re, list, matches, lines);
+    if (matches == 0 && list) E.list.active = false;
+    if (!complete)
+        editorSetStatusMessage(
+            E, "Interrupted: %zu matches on %zu lines so far", matches, lines);
+    else if (matches == 0)
+        editorSetStatusMessage(E, "E486: Pattern not found: %s",
+                               E.search_pattern.c_str());
+    else
+        editorSetStatusMessage(E, "%zu match%s on %zu line%s", matches,
+                               matches == 1 ? "" : "es", lines,
+                               lines == 1 ? "" : "s");
+}
+
+/** substitute */
+
+// appends one match's replacement to out, on its last row: & or \0 is the
+// match, \1 to \9 its groups, \r breaks the row, \t is a tab, \u and \l
+// change the case of the next char and \U and \L that of all up to \E
+void editorExpandReplacement(const std::string& rep, std::string_view row,
+                             const std::vector<size_t>& caps,
+                             std::vector<std::string>& out) {
+    char one = 0, all = 0;
+    auto put = [&](std::string_view text) {
+        for (char c : text) {
+            char mode = one ? one : all;
+            one = 0;
+            if (mode) c = char(mode == 'u' ? toupper(c) : tolower(c));
+            out.back() += c;
+        }
+    };
+    auto group = [&](size_t n) {
+        if (2 * n + 1 < caps.size() && caps[2 * n] != std::string::npos)
+            put(row.substr(caps[2 * n], caps[2 * n + 1] - caps[2 * n]));
+    };
+    for (size_t i = 0; i < rep.size(); ++i) {
+        char c = rep[i];
+        if (c == '&') {
+            group(0);
+        } else if (c != '\\' || i + 1 == rep.size()) {
+            put(std::string_view(&rep[i], 1));
+        } else if (isdigit((unsigned char)(c = rep[++i]))) {
+            group(size_t(c - '0'));
+        } else if (c == 'r') {
+            out.emplace_back();
+        } else if (c == 'n' || c == 't') {
+            put(c == 'n' ? std::string_view("\0", 1) : "\t");
+        } else if (c == 'u' || c == 'l') {
+            one = c;
+        } else if (c == 'U' || c == 'L') {
+            all = char(tolower(c));
+        } else if (c == 'E' || c == 'e') {
+            all = 0;
+        } else {
+            put(std::string_view(&rep[i], 1));
+        }
+    }
+}
+
+// appends what row becomes with its matches replaced, built in one pass, to
+// out; more than one row if the replacement breaks lines. Returns how many
+// matches were replaced, leaving out as it was when there are none
+size_t editorSubstituteRow(editorRegex& re, const std::string& rep,
+                           bool global, std::string_view row,
+                           std::vector<std::string>& out) {
+    std::vector<size_t> caps;
+    size_t replaced = 0, copied = 0, last = std::string::npos;
+    size_t first = out.size();
+    for (size_t from = 0;
+         from <= row.size() && editorRegexMatch(re, row, from, caps);) {
+        size_t at = caps[0], end = caps[1];
+        from = std::max(end, at + 1);
+        if (at == end && at == last) continue;
+        if (replaced++ == 0) {
+            out.emplace_back();
+            out.back().reserve(row.size());
+        }
+        out.back() += row.substr(copied, at - copied);
+        editorExpandReplacement(rep, row, caps, out);
+        copied = last = end;
+        if (!global) break;
+    }
+    if (replaced > 0) out.back() += row.substr(copied);
+    if (replaced == 0) out.resize(first);
+    return replaced;
+}
+
+// asks about each match in turn, changing the buffer as it goes
+void editorSubstituteConfirm(editorConfig& E, editorRegex& re,
+                             const std::string& rep, bool global, int top,
+                             int bottom, size_t& substitutions, size_t& lines) {
+    std::vector<size_t> caps;
+    bool all = false, quit = false;
+    for (int y = top; y <= bottom && !quit; ++y) {
+        size_t from = 0, last = std::string::npos;
+        bool changed = false;
+        while (true) {
+            std::string_view row = E.rows[size_t(y)].raw_row;
+            if (from > row.size() || !editorRegexMatch(re, row, from, caps))
+                break;
+            size_t at = caps[0], end = caps[1];
+            if (at == end && at == last) {
+                from = at + 1;
+                continue;
+            }
+            if (!all) {
+                E.cursor_y = y;
+                E.cursor_x = (int)at;
+                editorSetStatusMessage(E, "replace with %s (y/n/a/q/l)?",
+                                       rep.c_str());
+                editorRefreshScreen(E);
+                int c = editorReadKey(E);
+                if (c == 'q' || c == '\x1b') {
+                    quit = true;
+                    break;
+                }
+                if (c == 'n') {
+                    from = std::max(end, at + 1);
+                    last = end;
+                    continue;
+                }
+                if (c != 'y' && c != 'a' && c != 'l') continue;
+                all = c == 'a';
+                quit = c == 'l';
+            }
+            std::vector<std::string> parts{""};
+            editorExpandReplacement(rep, row, caps, parts);
+            size_t resume = parts.back().size();
+            if (parts.size() == 1) {
+                resume += at;
+                editorReplaceInRow(E, y, (int)at, end - at,
+                                   std::move(parts[0]));
+            } else {
+                parts.front().insert(0, row.substr(0, at));
+                parts.back() += row.substr(end);
+                size_t added = parts.size() - 1;
+                editorReplaceRows(E, y, 1, std::move(parts));
+                y += (int)added;
+                bottom += (int)added;
+            }
+            substitutions++;
+            changed = true;
+            last = resume;
+            from = at == end ? resume + 1 : resume;
+            if (!global || quit) break;
+        }
+        if (changed) lines++;
+    }
+}
+
+// rebuilds the rows of the range on the workers. Changed rows are swapped
+// in place as chunks come back, a run of neighbours at a time; the rows a
+// replacement breaking them adds go in after the workers are done, all in
+// one pass, so unchanged rows are never copied. It is one undo step
+bool editorSubstituteAll(editorConfig& E, const editorRegex& re,
+                         const std::string& rep, bool global, bool count_only,
+                         int top, int bottom, size_t& substitutions,
+                         size_t& lines) {
+    size_t rows = size_t(bottom - top + 1);
+    size_t chunks = (rows + PARALLEL_CHUNK_ROWS - 1) / PARALLEL_CHUNK_ROWS;
+    std::vector<editorRegex> copies(std::min(editorWorkerCount(E), chunks), re);
+    std::vector<editorSubstituteChunk> results(chunks);
+    auto task = [&](size_t chunk, size_t worker) {
+        editorSubstituteChunk& result = results[chunk];
+        size_t begin = size_t(top) + chunk * PARALLEL_CHUNK_ROWS;
+        size_t end = std::min(begin + PARALLEL_CHUNK_ROWS, size_t(bottom) + 1);
+        for (size_t y = begin; y < end; ++y) {
+            size_t before = result.rows.size();
+            size_t replaced =
+                count_only
+                    ? editorSubstituteRow(copies[worker], "", global,
+                                          E.rows[y].raw_row, result.rows)
+                    : editorSubstituteRow(copies[worker], rep, global,
+                                          E.rows[y].raw_row, result.rows);
+            if (replaced == 0) continue;
+            if (count_only) result.rows.clear();
+            result.changed.push_back((int)y);
+            result.produced.push_back(result.rows.size() - before);
+            result.substitutions += replaced;
+        }
+    };
+    int span_top = -1;
+    std::vector<std::string> span;  // the first row each changed row makes
+    std::vector<int> added_at;      // where the rest are to end up
+    std::vector<std::string> added;
+    auto flush = [&] {
+        size_t count = span.size();
+        if (count > 0) editorReplaceRows(E, span_top, count, std::move(span));
+        span.clear();
+    };
+    substitutions = lines = 0;
+    int last = -1;
+    auto merge = [&](size_t chunk) {
+        editorSubstituteChunk& result = results[chunk];
+        substitutions += result.substitutions;
+        lines += result.changed.size();
+        size_t next = 0;
+        for (size_t i = 0; !count_only && i < result.changed.size(); ++i) {
+            int y = result.changed[i];
+            if (!span.empty() && span_top + (int)span.size() != y) flush();
+            if (span.empty()) span_top = y;
+            span.push_back(std::move(result.rows[next++]));
+            for (size_t k = 1; k < result.produced[i]; ++k) {
+                added_at.push_back(y + 1 + (int)added_at.size());
+                added.push_back(std::move(result.rows[next++]));
+            }
+            E.cursor_y = last = y;
+        }
+        flush();
+        result = editorSubstituteChunk();
+        editorSetStatusMessage(E, "%zu substitutions on %zu lines...",
+                               substitutions, lines);
+    };
+    bool complete = editorParallelFor(E, chunks, task, merge);
+    if (!added.empty()) {
+        E.cursor_y = last + (int)added.size();
+        editorInsertScatteredRows(E, std::move(added_at), std::move(added));
+    }
+    return complete;
+}
+
+// :[range]s/pat/rep/[flags] with the flags g for every match in a row, c to
+// confirm each, i and I to ignore case or not and n to only count. An empty
+// pat is the last search pattern, ~ in rep the last replacement, and a bare
+// :s or :& repeats the last substitution
+void editorSubstituteCommand(editorConfig& E, editorExCommand& ex) {
+    const std::string& cmd = ex.arg;
+    int top = ex.top, bottom = ex.bottom;
+    size_t at = 0;
+    bool repeat = ex.name == "&";
+    std::string pattern, rep = E.last_replacement;
+    if (!repeat && at < cmd.size()) {
+        char delimiter = cmd[at];
+        if (isalnum((unsigned char)delimiter) || delimiter == '\\' ||
+            delimiter == '"' || delimiter == '|' || delimiter == ' ') {
+            editorSetStatusMessage(
+                E, "E146: Regular expressions can't be delimited by letters");
+            return;
+        }
+        pattern = editorParsePattern(cmd, at);
+        rep.clear();
+        for (; at < cmd.size() && cmd[at] != delimiter; ++at) {
+            if (cmd[at] == '~')
+                rep += E.last_replacement;
+            else if (cmd[at] == '\\' && at + 1 < cmd.size())
+                rep += cmd.substr(at++, 2);
+            else
+                rep += cmd[at];
+        }
+        if (at < cmd.size()) at++;
+    }
+    bool global = false, confirm = false, count_only = false;
+    std::string ignore_case;
+    for (; at < cmd.size(); ++at) {
+        switch (cmd[at]) {
+            case 'g':
+                global = !global;
+                break;
+            case 'c':
+                confirm = true;
+                break;
+            case 'n':
+                count_only = true;
+                break;
+            case 'i':
+                ignore_case = "\\c";
+                break;
+            case 'I':
+                ignore_case = "\\C";
+                break;
+            case ' ':
+            case '&':  // the flags are not kept, so there are none to keep
+                break;
+            default:
+                editorSetStatusMessage(E, "E488: Trailing characters: %s",
+                                       cmd.c_str() + at);
+                return;
+        }
+    }
+    auto re = editorUsePattern(E, pattern);
+    if (!re) return;
+    if (!ignore_case.empty()) {
+        std::string error;
+        re = editorRegexGet(E, ignore_case + E.search_pattern, &error);
+        if (!re) return;
+    }
+    E.last_replacement = rep;
+    editorUndoBreak(E);
+    int cursor_y = E.cursor_y, cursor_x = E.cursor_x;
+    size_t substitutions = 0, lines = 0;
+    bool complete = true;
+    if (confirm && !count_only)
+        editorSubstituteConfirm(E, *re, rep, global, top, bottom, substitutions,
+                                lines);
+    else
+        complete = editorSubstituteAll(E, *re, rep, global, count_only, top,
+                                       bottom, substitutions, lines);
+    if (count_only || substitutions == 0) {
+        E.cursor_y = cursor_y;
+        E.cursor_x = cursor_x;
+    } else {
+        const std::string& row = E.rows[size_t(E.cursor_y)].raw_row;
+        E.cursor_x = (int)std::min(row.find_first_not_of(" \t"), row.size());
+    }
+    if (!complete)
+        editorSetStatusMessage(E, "Interrupted: %zu substitutions on %zu lines",
+                               substitutions, lines);
+    else if (count_only && substitutions > 0)
+        editorSetStatusMessage(E, "%zu match%s on %zu line%s", substitutions,
+                               substitutions == 1 ? "" : "es", lines,
+                               lines == 1 ? "" : "s");
+    else if (substitutions == 0 && !confirm)
+        editorSetStatusMessage(E, "E486: Pattern not found: %s",
+                               E.search_pattern.c_str());
+    else if (substitutions > 1)
+        editorSetStatusMessage(E, "%zu substitutions on %zu line%s",
+                               substitutions, lines, lines == 1 ? "" : "s");
+    else
+        editorSetStatusMessage(E, "");
+}
+
+/** global */
+
+// the count at arg[at] that ends arg, left as it is when there is none;
+// false, with an error shown, when there is something else
+bool editorCountArg(editorConfig& E, const std::string& arg, size_t at,
+                    long long& count) {
+    size_t digits = at;
+    long long value = 0;
+    while (at < arg.size() && isdigit((unsigned char)arg[at]))
+        value = std::min(value * 10 + (arg[at++] - '0'), (long long)INT_MAX);
+    if (at < arg.size()) {
+        editorSetStatusMessage(E, "E488: Trailing characters: %s",
+                               arg.c_str() + at);
+        return false;
+    }
+    if (at == digits) return true;
+    if (value == 0) {
+        editorSetStatusMessage(E, "E939: Positive count required");
+        return false;
+    }
+    count = value;
+    return true;
+}
+
+// the [x] [count] after :d or :y, with count 0 when there is none; false,
+// with an error shown, when arg is something else
+bool editorRegisterArg(editorConfig& E, const std::string& arg, char& reg,
+                       long long& count) {
+    size_t at = 0;
+    reg = '"';
+    count = 0;
+    if (at < arg.size() && (isalpha((unsigned char)arg[at]) ||
+                            arg[at] == '"' || arg[at] == '_')) {
+        reg = arg[at++];
+        while (at < arg.size() && arg[at] == ' ') at++;
+    }
+    return editorCountArg(E, arg, at, count);
+}
+
+// runs keys as if typed in normal mode, then leaves whatever mode they
+// ended in; within one undo step with the rest of the command
+void editorExecuteNormal(editorConfig& E, const std::string& keys) {
+    E.mode = NORMAL;
+    E.normal_buf = "";
+    for (char c : keys) editorProcessKey(E, (unsigned char)c);
+    if (E.mode != NORMAL) editorProcessKey(E, '\x1b');
+    E.normal_buf = "";
+}
+
+// runs command on every marked row from y on, with the cursor at its start,
+// unmarking each first. Rows the command deletes lose their mark and rows it
+// moves keep it. Returns false when a key press stopped it early
+bool editorForEachMarked(editorConfig& E, size_t y,
+                         const std::function<void()>& command) {
+    bool complete = true;
+    for (; y < E.rows.size(); ++y) {
+        if (!E.rows[y].marked) continue;
+        if (editorInputPending(E)) {
+            complete = false;
+            break;
+        }
+        E.rows[y].marked = false;
+        size_t before = E.rows.size();
+        E.cursor_y = (int)y;
+        E.cursor_x = 0;
+        command();
+        // marked rows after y are at least this far up now
+        if (E.rows.size() < before) y -= std::min(y, before - E.rows.size());
+        y--;
+    }
+    for (; y < E.rows.size(); ++y) E.rows[y].marked = false;
+    editorClampCursor(E);
+    return complete;
+}
+
+// the rows from top to bottom matching re, or not matching it with invert,
+// checked in chunks over the workers; false when a key press stopped it
+bool editorMatchingRows(editorConfig& E, const editorRegex& re, bool invert,
+                        int top, int bottom, std::vector<int>& lines) {
+    size_t rows = size_t(bottom - top + 1);
+    size_t chunks = (rows + PARALLEL_CHUNK_ROWS - 1) / PARALLEL_CHUNK_ROWS;
+    std::vector<editorRegex> copies(std::min(editorWorkerCount(E), chunks), re);
+    std::vector<std::vector<int>> found(chunks);
+    auto task = [&](size_t chunk, size_t worker) {
+        size_t begin = size_t(top) + chunk * PARALLEL_CHUNK_ROWS;
+        size_t end = std::min(begin + PARALLEL_CHUNK_ROWS, size_t(bottom) + 1);
+        for (size_t y = begin; y < end; ++y)
+            if (editorRegexContains(copies[worker], E.rows[y].raw_row) !=
+                invert)
+                found[chunk].push_back((int)y);
+    };
+    auto merge = [&](size_t chunk) {
+        lines.insert(lines.end(), found[chunk].begin(), found[chunk].end());
+        std::vector<int>().swap(found[chunk]);
+        editorSetStatusMessage(E, "%zu matching lines...", lines.size());
+    };
+    return editorParallelFor(E, chunks, task, merge);
+}
+
+// :[range]norm[al][!] keys runs keys on each row of the range or, without
+// one, once where the cursor is
+void editorNormalCommand(editorConfig& E, editorExCommand& ex) {
+    if (ex.arg.empty()) {
+        editorSetStatusMessage(E, "E471: Argument required");
+        return;
+    }
+    if (ex.addresses == 0) {
+        editorExecuteNormal(E, ex.arg);
+        return;
+    }
+    for (int y = ex.top; y <= ex.bottom; ++y) E.rows[size_t(y)].marked = true;
+    editorForEachMarked(E, size_t(ex.top),
+                        [&] { editorExecuteNormal(E, ex.arg); });
+}
+
+// :[range]g/pat/cmd runs cmd on every row matching pat, and :v/pat/cmd or
+// :g!/pat/cmd on every other one; the range is all rows unless given. The
+// rows are found in one parallel pass before cmd runs on any. A d deletes
+// them all in a single pass over the buffer, a p (or no cmd) lists them and
+// anything else runs row by row. All of it is one undo step
+void editorGlobalCommand(editorConfig& E, editorExCommand& ex) {
+    const std::string& cmd = ex.arg;
+    int top = ex.top, bottom = ex.bottom;
+    size_t at = 0;
+    bool invert = ex.name == "vglobal" || ex.bang;
+    if (E.global_busy) {
+        editorSetStatusMessage(E, "E147: Cannot do :global recursive");
+        return;
+    }
+    std::string pattern = editorParsePattern(cmd, at);
+    if (at == 0) {
+        editorSetStatusMessage(
+            E, "E148: Regular expression missing from :global");
+        return;
+    }
+    auto re = editorUsePattern(E, pattern);
+    if (!re) return;
+    while (at < cmd.size() && cmd[at] == ' ') at++;
+    std::string command = cmd.substr(at);
+    std::vector<int> lines;
+    if (top <= bottom &&
+        !editorMatchingRows(E, *re, invert, top, bottom, lines)) {
+        editorSetStatusMessage(E, "Interrupted");
+        return;
+    }
+    if (lines.empty()) {
+        if (invert)
+            editorSetStatusMessage(E, "Pattern found in every line: %s",
+                                   E.search_pattern.c_str());
+        else
+            editorSetStatusMessage(E, "Pattern not found: %s",
+                                   E.search_pattern.c_str());
+        return;
+    }
+    size_t count = lines.size();
+    if (command.empty() || command == "p" || command == "print") {
+        E.list = editorListView();
+        E.list.active = true;
+        E.list.title = ex.text.substr(0, ex.text.size() - command.size());
+        E.list.entries.reserve(count);
+        for (int y : lines) E.list.entries.push_back({y, 0, E.number});
+        editorSetStatusMessage(E, "%zu line%s", count, count == 1 ? "" : "s");
+        return;
+    }
+    // a plain :d deletes every row at once
+    editorExCommand inner;
+    char reg = 0;
+    long long reg_count = 0;
+    bool batch = editorParseCommand(E, command, inner) &&
+                 inner.name == "delete" && inner.addresses == 0 &&
+                 editorRegisterArg(E, inner.arg, reg, reg_count) &&
+                 reg_count == 0;
+    editorUndoBreak(E);
+    E.global_busy = true;
+    if (batch) {
+        // deleting row by row would leave only the last one in the register
+        std::vector<std::string> text;
+        if (isupper(reg))
+            for (int y : lines) text.push_back(E.rows[size_t(y)].raw_row);
+        else
+            text.push_back(E.rows[size_t(lines.back())].raw_row);
+        editorSetRegister(E, reg, std::move(text), true, false);
+        E.cursor_y = lines.back() + 1 - (int)count;
+        E.cursor_x = 0;
+        editorDeleteScatteredRows(E, std::move(lines));
+        editorClampCursor(E);
+        if (E.cursor_y == (int)E.rows.size() && E.cursor_y > 0) E.cursor_y--;
+        editorSetStatusMessage(E, "%zu fewer line%s", count,
+                               count == 1 ? "" : "s");
+    } else {
+        for (int y : lines) E.rows[size_t(y)].marked = true;
+        editorSetStatusMessage(E, "");
+        if (!editorForEachMarked(E, size_t(lines[0]),
+                                 [&] { editorExecuteCommand(E, command); }))
+            editorSetStatusMessage(E, "Interrupted");
+    }
+    E.global_busy = false;
+    editorUndoBreak(E);
+}
+
+/** grep */
+
+// * and ? match within a path component and ** across them, [...] is a
+// class of chars, negated by a leading ! or ^
+bool editorGlobMatch(std::string_view glob, std::string_view path) {
+    while (!glob.empty()) {
+        char c = glob[0];
+        if (c == '*') {
+            bool across = glob.size() > 1 && glob[1] == '*';
+            glob.remove_prefix(across ? 2 : 1);
+            if (across && !glob.empty() && glob[0] == '/') {
+                // **/ stands for no components or some whole ones
+                glob.remove_prefix(1);
+                for (size_t at = 0;; at++) {
+                    if (editorGlobMatch(glob, path.substr(at))) return true;
+                    at = path.find('/', at);
+                    if (at == std::string_view::npos) return false;
+                }
+            }
+            for (size_t at = 0; at <= path.size(); ++at) {
+                if (editorGlobMatch(glob, path.substr(at))) return true;
+                if (at < path.size() && path[at] == '/' && !across)
+                    return false;
+            }
+            return false;
+        }
+        if (path.empty()) return false;
+        size_t used = 1;
+        bool negate = glob.size() > 1 && (glob[1] == '!' || glob[1] == '^');
+        size_t close = c == '[' ? glob.find(']', negate ? 3 : 2)
+                                : std::string_view::npos;
+        if (c == '?') {
+            if (path[0] == '/') return false;
+        } else if (close != std::string_view::npos) {
+            unsigned char ch = (unsigned char)path[0];
+            bool in = false;
+            for (size_t i = negate ? 2 : 1; i < close; ++i) {
+                if (i + 2 < close && glob[i + 1] == '-') {
+                    in |= ch >= (unsigned char)glob[i] &&
+                          ch <= (unsigned char)glob[i + 2];
+                    i += 2;
+                } else {
+                    in |= ch == (unsigned char)glob[i];
+                }
+            }
+            if (in == negate || ch == '/') return false;
+            used = close + 1;
+        } else if (c == '\\' && glob.size() > 1) {
+            if (path[0] != glob[1]) return false;
+            used = 2;
+        } else if (c != path[0]) {
+            return false;
+        }
+        glob.remove_prefix(used);
+        path.remove_prefix(1);
+    }
+    return path.empty();
+}
+
+// the rules of the .gitignore and .ignore files in a directory, over those
+// of the directories above; just those when it has neither
+std::shared_ptr<const editorIgnoreFile> editorReadIgnoreFiles(
+    int dir_fd, const std::string& base,
+    std::shared_ptr<const editorIgnoreFile> parent,
+    const std::string& above = "") {
+    auto ignore = std::make_shared<editorIgnoreFile>();
+    for (const char* name : {".gitignore", ".ignore"}) {
+        int fd = openat(dir_fd, name, O_RDONLY);
+        if (fd == -1) continue;
+        std::string text;
+        char buf[4096];
+        ssize_t n;
+        while ((n = read(fd, buf, sizeof(buf))) > 0)
+            text.append(buf, size_t(n));
+        close(fd);
+        for (size_t start = 0; start < text.size();) {
+            size_t end = std::min(text.find('\n', start), text.size());
+            std::string line = text.substr(start, end - start);
+            start = end + 1;
+            while (!line.empty() && (line.back() == '\r' || line.back() == ' '))
+                line.pop_back();
+            if (line.empty() || line[0] == '#') continue;
+            editorIgnoreRule rule;
+            if (line[0] == '!') {
+                rule.negate = true;
+                line.erase(0, 1);
+            }
+            if (!line.empty() && line.back() == '/') {
+                rule.dir_only = true;
+                line.pop_back();
+            }
+            rule.anchored = line.find('/') != std::string::npos;
+            if (!line.empty() && line[0] == '/') line.erase(0, 1);
+            if (line.empty()) continue;
+            rule.glob = std::move(line);
+            ignore->rules.push_back(std::move(rule));
+        }
+    }
+    if (ignore->rules.empty()) return parent;
+    ignore->parent = std::move(parent);
+    ignore->base = base;
+    ignore->above = above;
+    return ignore;
+}
+
+// what the paths of the entries of dir start with as it is walked
+std::string editorWalkPrefix(const std::string& dir) {
+    if (dir == ".") return "";
+    return dir.back() == '/' ? dir : dir + "/";
+}
+
+// the rules of the ignore files above root, up to the top of the git
+// repository it is in; none outside of one
+std::shared_ptr<const editorIgnoreFile> editorIgnoreFilesAbove(
+    const std::string& root) {
+    char* resolved = realpath(root.c_str(), NULL);
+    if (!resolved) return NULL;
+    std::string path = resolved;
+    free(resolved);
+    std::vector<size_t> ends;  // where the paths of those above end
+    struct stat st;
+    bool top = stat((path + "/.git").c_str(), &st) == 0;
+    for (size_t end = path.size(); !top && end > 0;) {
+        end = path.rfind('/', end - 1);
+        if (end == std::string::npos) break;
+        ends.push_back(end);
+        std::string dir = path.substr(0, std::max(end, size_t(1)));
+        top = stat((dir + "/.git").c_str(), &st) == 0;
+    }
+    std::shared_ptr<const editorIgnoreFile> ignore;
+    if (!top) return ignore;
+    for (auto end = ends.rbegin(); end != ends.rend(); ++end) {
+        std::string dir = path.substr(0, std::max(*end, size_t(1)));
+        int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+        if (fd == -1) continue;
+        ignore = editorReadIgnoreFiles(fd, editorWalkPrefix(root), ignore,
+                                       path.substr(*end + 1) + "/");
+        close(fd);
+    }
+    return ignore;
+}
+
+// whether the ignore files rule out path, a directory when dir is set: the
+// last rule matching in the deepest file that has one decides
+bool editorIgnored(const editorIgnoreFile* ignore, std::string_view path,
+                   bool dir) {
+    std::string joined;
+    for (; ignore; ignore = ignore->parent.get()) {
+        std::string_view rest = path.substr(ignore->base.size());
+        if (!ignore->above.empty()) {
+            joined = ignore->above;
+            joined += rest;
+            rest = joined;
+        }
+        std::string_view name = rest.substr(rest.rfind('/') + 1);
+        for (auto rule = ignore->rules.rbegin(); rule != ignore->rules.rend();
+             ++rule) {
+            if (rule->dir_only && !dir) continue;
+            if (editorGlobMatch(rule->glob, rule->anchored ? rest : name))
+                return !rule->negate;
+        }
+    }
+    return false;
+}
+
+// adds the files under dirs to files, reading the directories of each level
+// of the tree in parallel. Hidden entries, symbolic links and whatever the
+// ignore files rule out are skipped; false when a key press stopped it
+bool editorWalk(editorConfig& E, std::vector<editorWalkDir> dirs,
+                std::vector<std::string>& files) {
+    while (!dirs.empty()) {
+        std::vector<std::vector<editorWalkDir>> found_dirs(dirs.size());
+        std::vector<std::vector<std::string>> found_files(dirs.size());
+        auto task = [&](size_t i, size_t) {
+            const editorWalkDir& dir = dirs[i];
+            DIR* handle = opendir(dir.path.c_str());
+            if (!handle) return;
+            std::string prefix = editorWalkPrefix(dir.path);
+            auto ignore =
+                editorReadIgnoreFiles(dirfd(handle), prefix, dir.ignore);
+            while (struct dirent* entry = readdir(handle)) {
+                if (entry->d_name[0] == '.') continue;
+                int type = entry->d_type;
+                struct stat st;
+                if (type == DT_UNKNOWN &&
+                    fstatat(dirfd(handle), entry->d_name, &st,
+                            AT_SYMLINK_NOFOLLOW) == 0)
+                    type = S_ISDIR(st.st_mode)   ? DT_DIR
+                           : S_ISREG(st.st_mode) ? DT_REG
+                                                 : DT_UNKNOWN;
+                if (type != DT_DIR && type != DT_REG) continue;
+                std::string path = prefix + entry->d_name;
+                if (editorIgnored(ignore.get(), path, type == DT_DIR))
+                    continue;
+                if (type == DT_DIR)
+                    found_dirs[i].push_back({std::move(path), ignore});
+                else
+                    found_files[i].push_back(std::move(path));
+            }
+            closedir(handle);
+        };
+        std::vector<editorWalkDir> next;
+        auto merge = [&](size_t i) {
+            std::move(found_dirs[i].begin(), found_dirs[i].end(),
+                      std::back_inserter(next));
+            std::move(found_files[i].begin(), found_files[i].end(),
+                      std::back_inserter(files));
+            std::vector<editorWalkDir>().swap(found_dirs[i]);
+            std::vector<std::string>().swap(found_files[i]);
+            editorSetStatusMessage(E, "%zu files...", files.size());
+        };
+        if (!editorParallelFor(E, dirs.size(), task, merge)) return false;
+        dirs = std::move(next);
+    }
+    return true;
+}
+
+// adds the lines of a file's text that re matches to found, numbered from 0,
+// once for every match with every set or else once each
+void editorGrepText(editorRegex& re, std::string_view text, bool every,
+                    std::vector<editorListEntry>& found) {
+    size_t line = 0, counted = 0;  // line is the number of the one at counted
+    auto add = [&](size_t start, size_t end, size_t x) {
+        line += size_t(
+            std::count(text.begin() + long(counted), text.begin() + long(start),
+                       '\n'));
+        counted = start;
+        std::string_view row = text.substr(start, end - start);
+        if (!row.empty() && row.back() == '\r') row.remove_suffix(1);
+        editorListEntry entry;
+        entry.y = (int)line;
+        entry.x = (int)x;
+        entry.text = row.substr(0, GREP_TEXT_BYTES);
+        found.push_back(std::move(entry));
+    };
+    auto line_end = [&](size_t at) {
+        return std::min(text.find('\n', at), text.size());
+    };
+    if (!re.literal && !re.prefix.empty()) {
+        // only lines holding the prefix can match
+        for (size_t from = 0, at;
+             (at = editorFindForward(text, from, re.prefix)) !=
+             std::string::npos;) {
+            size_t start = text.rfind('\n', at);
+            start = start == std::string::npos ? 0 : start + 1;
+            size_t end = line_end(at);
+            std::string_view row = text.substr(start, end - start);
+            if (!row.empty() && row.back() == '\r') row.remove_suffix(1);
+            if (every)
+                editorForEachMatch(
+                    re, row, [&](size_t x, size_t) { add(start, end, x); });
+            else if (size_t x = editorRegexFind(re, row, at - start);
+                     x != std::string::npos)
+                add(start, end, x);
+            from = end + 1;
+        }
+        return;
+    }
+    if (re.literal) {
+        // the whole text at once, a line is only looked at for a match
+        const std::string& literal = re.literal_text;
+        for (size_t from = 0, at;
+             (at = editorFindForward(text, from, literal)) !=
+             std::string::npos;) {
+            size_t start = text.rfind('\n', at);
+            start = start == std::string::npos ? 0 : start + 1;
+            size_t end = line_end(at);
+            add(start, end, at - start);
+            from = every ? at + literal.size() : end + 1;
+        }
+        return;
+    }
+    for (size_t start = 0; start < text.size();) {
+        // the DFA runs through the lines with no match without a call each
+        if (editorDfaSearchRows(re, text, start) == 0) break;
+        size_t end = line_end(start);
+        std::string_view row = text.substr(start, end - start);
+        if (!row.empty() && row.back() == '\r') row.remove_suffix(1);
+        if (every)
+            editorForEachMatch(re, row,
+                               [&](size_t at, size_t) { add(start, end, at); });
+        else if (size_t at = editorRegexFind(re, row, 0);
+                 at != std::string::npos)
+            add(start, end, at);
+        start = end + 1;
+    }
+}
+
+// greps the file at path, unless a NUL early on shows it to be binary. Big
+// files are mapped, small ones cost less to read into a buffer kept for the
+// next one
+void editorGrepFile(editorRegex& re, const std::string& path, bool every,
+                    std::vector<editorListEntry>& found) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1) return;
+    struct stat st;
+    if (fstat(fd, &st) == -1 || st.st_size == 0) {
+        close(fd);
+        return;
+    }
+    size_t size = size_t(st.st_size);
+    const char* data;
+    void* mapped = MAP_FAILED;
+    static thread_local std::string buffer;
+    if (size >= GREP_MMAP_BYTES) {
+        mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped == MAP_FAILED) {
+            close(fd);
+            return;
+        }
+        madvise(mapped, size, MADV_SEQUENTIAL);
+        data = (const char*)mapped;
+    } else {
+        buffer.resize(size);
+        auto fill = [&](size_t from, size_t to) {
+            ssize_t n;
+            while (from < to && (n = read(fd, &buffer[from], to - from)) > 0)
+                from += size_t(n);
+            return from;
+        };
+        // the start first, which is all there is to read of a binary file
+        size_t sniff = std::min(size, size_t(BINARY_SNIFF_BYTES));
+        size = fill(0, sniff);
+        if (size == sniff && !memchr(buffer.data(), '\0', sniff))
+            size = fill(sniff, buffer.size());
+        data = buffer.data();
+    }
+    close(fd);
+    if (!memchr(data, '\0', std::min(size, size_t(BINARY_SNIFF_BYTES))))
+        editorGrepText(re, std::string_view(data, size), every, found);
+    if (mapped != MAP_FAILED) munmap(mapped, size);
+}
+
+// :vim[grep] /pat/[g][j] [path ...] lists the lines matching pat in the
+// files under the paths, or under the current directory when there are
+// none. A pat without delimiters ends at the first space; with g every match
+// is listed rather than the first in each line, and j changes nothing since
+// the list is what opens. The files are found and searched over the workers
+// and matches show up in the list as they come, in the order of the paths
+void editorGrepCommand(editorConfig& E, editorExCommand& ex) {
+    const std::string& cmd = ex.arg;
+    size_t at = 0;
+    size_t pattern_at = at;
+    std::string pattern = editorParsePattern(cmd, at);
+    bool every = false;
+    if (at == pattern_at) {
+        at = std::min(cmd.find(' ', at), cmd.size());
+        pattern = cmd.substr(pattern_at, at - pattern_at);
+    } else {
+        for (; at < cmd.size() && (cmd[at] == 'g' || cmd[at] == 'j'); ++at)
+            every |= cmd[at] == 'g';
+    }
+    std::vector<std::pair<std::string, bool>> paths;  // and whether a dir
+    for (size_t end; at < cmd.size(); at = end) {
+        at = std::min(cmd.find_first_not_of(' ', at), cmd.size());
+        end = std::min(cmd.find(' ', at), cmd.size());
+        std::string path = editorAbsolutePath(E, cmd.substr(at, end - at));
+        struct stat st;
+        if (path.empty() || stat(path.c_str(), &st) == -1) continue;
+        paths.push_back({path, S_ISDIR(st.st_mode)});
+    }
+    if (paths.empty()) paths.push_back({editorWorkingDirectory(E), true});
+    auto re = editorUsePattern(E, pattern);
+    if (!re) return;
+
+    E.list = editorListView();
+    E.list.active = true;
+    E.list.title = ex.text;
+    // the paths in the order given, the files under each directory sorted
+    // where it comes
+    std::vector<std::string> files;
+    bool complete = true;
+    for (size_t i = 0; i < paths.size() && complete; ++i) {
+        auto& [path, dir] = paths[i];
+        if (!dir) {
+            files.push_back(std::move(path));
+            continue;
+        }
+        size_t walked = files.size();
+        complete = editorWalk(E, {{path, editorIgnoreFilesAbove(path)}}, files);
+        std::sort(files.begin() + long(walked), files.end());
+    }
+    size_t count = files.size();
+    size_t chunks = (count + GREP_CHUNK_FILES - 1) / GREP_CHUNK_FILES;
+    std::vector<editorRegex> copies(std::min(editorWorkerCount(E), chunks),
+                                    *re);
+    std::vector<std::vector<editorListEntry>> found(count);
+    auto task = [&](size_t chunk, size_t worker) {
+        size_t end = std::min((chunk + 1) * GREP_CHUNK_FILES, count);
+        for (size_t i = chunk * GREP_CHUNK_FILES; i < end; ++i)
+            editorGrepFile(copies[worker], files[i], every, found[i]);
+    };
+    auto merge = [&](size_t chunk) {
+        auto& list = E.list;
+        size_t end = std::min((chunk + 1) * GREP_CHUNK_FILES, count);
+        for (size_t i = chunk * GREP_CHUNK_FILES; i < end; ++i) {
+            if (found[i].empty()) continue;
+            int file = (int)list.files.size();
+            list.files.push_back(std::move(files[i]));
+            for (auto& entry : found[i]) {
+                entry.file = file;
+                list.entries.push_back(std::move(entry));
+            }
+            std::vector<editorListEntry>().swap(found[i]);
+        }
+        editorSetStatusMessage(E, "%zu matches in %zu files...",
+                               list.entries.size(), list.files.size());
+    };
+    complete = complete && editorParallelFor(E, chunks, task, merge);
+    size_t matches = E.list.entries.size(), matched = E.list.files.size();
+    if (matches == 0) E.list.active = false;
+    if (!complete)
+        editorSetStatusMessage(
+            E, "Interrupted: %zu matches in %zu files so far", matches,
+            matched);
+    else if (matches == 0)
+        editorSetStatusMessage(E, "E480: No match: %s",
+                               E.search_pattern.c_str());
+    else
+        editorSetStatusMessage(E, "%zu match%s in %zu file%s", matches,
+                               matches == 1 ? "" : "es", matched,
+                               matched == 1 ? "" : "s");
+}
+
+/** sort */
+
+std::string_view editorSortKey(editorConfig& E, const editorSortKeys& keys,
+                               int i) {
+    std::string_view row = E.rows[size_t(keys.top + i)].raw_row;
+    if (keys.spans.empty()) return row;
+    auto [start, end] = keys.spans[size_t(i)];
+    return row.substr(start, end - start);
+}
+
+// the first number in key, negative when a - comes right before it
+long long editorSortNumber(std::string_view key) {
+    size_t at = 0;
+    while (at < key.size() && !isdigit((unsigned char)key[at])) at++;
+    if (at == key.size()) return LLONG_MIN;
+    bool negative = at > 0 && key[at - 1] == '-';
+    long long value = 0;
+    for (; at < key.size() && isdigit((unsigned char)key[at]); ++at) {
+        int digit = key[at] - '0';
+        bool overflows = value > (LLONG_MAX - digit) / 10;
+        value = overflows ? LLONG_MAX : value * 10 + digit;
+    }
+    return negative ? -value : value;
+}
+
+// row i of the range as sorted on the sixteen bytes of its key from depth:
+// those bytes in two words, big end first so they compare as numbers, then
+// how many of them the key fills and i, so that rows with equal keys keep
+// their order. With n the number takes the place of the bytes
+std::array<uint64_t, 3> editorSortItem(editorConfig& E,
+                                       const editorSortKeys& keys, int i,
+                                       size_t depth) {
+    std::string_view key = editorSortKey(E, keys, i);
+    std::array<uint64_t, 3> item = {0, 0, uint64_t(uint32_t(i))};
+    if (keys.numeric) {
+        item[0] = uint64_t(editorSortNumber(key)) ^ (uint64_t(1) << 63);
+        return item;
+    }
+    // a copy and a byte swap rather than a loop over the key where it can,
+    // so that many rows can be on their way from memory at once
+    size_t filled = key.size() > depth ? key.size() - depth : 0;
+    unsigned char bytes[16] = {};
+    if (filled >= 16)
+        memcpy(bytes, key.data() + depth, filled = 16);
+    else
+        for (size_t k = 0; k < filled; ++k)
+            bytes[k] = (unsigned char)key[depth + k];
+    if (keys.ignore_case)
+        for (auto& c : bytes) c = (unsigned char)tolower(c);
+    memcpy(item.data(), bytes, 16);
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    item[0] = __builtin_bswap64(item[0]);
+    item[1] = __builtin_bswap64(item[1]);
+#endif
+    item[2] |= uint64_t(filled) << 32;
+    return item;
+}
+
+// whether item a goes before item b: by their bytes and how many of them
+// the key fills, backwards when reversed, then by the row they stand for
+bool editorSortBefore(const editorSortKeys& keys,
+                      const std::array<uint64_t, 3>& a,
+                      const std::array<uint64_t, 3>& b) {
+    auto key_a = std::make_tuple(a[0], a[1], a[2] >> 32);
+    auto key_b = std::make_tuple(b[0], b[1], b[2] >> 32);
+    if (key_a != key_b) return keys.reverse ? key_b < key_a : key_a < key_b;
+    return uint32_t(a[2]) < uint32_t(b[2]);
+}
+
+// whether items a and b agree on all sixteen bytes, so that only the bytes
+// after them can tell their rows apart
+bool editorSortTied(const std::array<uint64_t, 3>& a,
+                    const std::array<uint64_t, 3>& b) {
+    return a[0] == b[0] && a[1] == b[1] && a[2] >> 32 == 16 &&
+           b[2] >> 32 == 16;
+}
+
+int editorSortCompare(std::string_view a, std::string_view b,
+                      bool ignore_case) {
+    if (!ignore_case) return a.compare(b);
+    for (size_t i = 0; i < std::min(a.size(), b.size()); ++i) {
+        int ca = tolower((unsigned char)a[i]);
+        int cb = tolower((unsigned char)b[i]);
+        if (ca != cb) return ca - cb;
+    }
+    return a.size() < b.size() ? -1 : a.size() > b.size();
+}
+
+// puts the rows of the range in order, rows with equal keys in the order
+// they came. Each row gets an item for the first sixteen bytes of its key;
+// runs of PARALLEL_CHUNK_ROWS items are sorted on the workers, then merged
+// in pairs, the pairs of each round on the workers too. Runs of items still
+// tied after that are sorted again on the next sixteen bytes, and so on, so
+// a row is read once per sixteen bytes it shares with another rather than
+// once per comparison. False when a key press stopped it
+bool editorSortOrder(editorConfig& E, const editorSortKeys& keys,
+                     std::vector<int>& order) {
+    size_t n = order.size();
+    size_t width = PARALLEL_CHUNK_ROWS;
+    size_t chunks = (n + width - 1) / width;
+    std::vector<std::array<uint64_t, 3>> items(n), merged(n);
+    auto before = [&](const std::array<uint64_t, 3>& a,
+                      const std::array<uint64_t, 3>& b) {
+        return editorSortBefore(keys, a, b);
+    };
+    auto sort_run = [&](size_t run, size_t) {
+        size_t begin = run * width, end = std::min(begin + width, n);
+        for (size_t i = begin; i < end; ++i)
+            items[i] = editorSortItem(E, keys, (int)i, 0);
+        std::sort(items.begin() + long(begin), items.begin() + long(end),
+                  before);
+    };
+    if (!editorParallelFor(E, chunks, sort_run, [](size_t) {})) return false;
+    for (; width < n; width *= 2) {
+        auto merge_pair = [&](size_t pair, size_t) {
+            size_t begin = pair * 2 * width;
+            size_t middle = std::min(begin + width, n);
+            size_t end = std::min(middle + width, n);
+            auto first = items.begin();
+            std::merge(first + long(begin), first + long(middle),
+                       first + long(middle), first + long(end),
+                       merged.begin() + long(begin), before);
+        };
+        size_t pairs = (n + 2 * width - 1) / (2 * width);
+        if (!editorParallelFor(E, pairs, merge_pair, [](size_t) {}))
+            return false;
+        items.swap(merged);
+    }
+    merged = {};
+    std::vector<std::pair<size_t, size_t>> tied;  // runs that need more bytes
+    auto find_ties = [&](size_t begin, size_t end, auto& runs) {
+        for (size_t j = begin; j < end;) {
+            size_t k = j + 1;
+            while (k < end && editorSortTied(items[j], items[k])) k++;
+            if (k - j > 1) runs.push_back({j, k});
+            j = k;
+        }
+    };
+    find_ties(0, n, tied);
+    // each round rereads the tied rows sixteen bytes further on, all of
+    // them in one pass, and then sorts each run again. The rows are all over
+    // memory by now, so the row sixteen ahead and the text of the one eight
+    // ahead are asked for while one is read
+    for (size_t depth = 16; !tied.empty(); depth += 16) {
+        std::vector<size_t> members;
+        for (auto [begin, end] : tied)
+            for (size_t j = begin; j < end; ++j) members.push_back(j);
+        auto row = [&](size_t p) -> const editorRow& {
+            size_t i = uint32_t(items[members[p]][2]);
+            return E.rows[size_t(keys.top) + i];
+        };
+        auto reread = [&](size_t chunk, size_t) {
+            size_t begin = chunk * PARALLEL_CHUNK_ROWS;
+            size_t end = std::min(begin + PARALLEL_CHUNK_ROWS, members.size());
+            for (size_t p = begin; p < end; ++p) {
+                if (p + 16 < members.size()) __builtin_prefetch(&row(p + 16));
+                if (p + 8 < members.size())
+                    __builtin_prefetch(row(p + 8).raw_row.data() + depth);
+                auto& item = items[members[p]];
+                item = editorSortItem(E, keys, int(uint32_t(item[2])), depth);
+            }
+        };
+        chunks = (members.size() + PARALLEL_CHUNK_ROWS - 1) /
+                 PARALLEL_CHUNK_ROWS;
+        if (!editorParallelFor(E, chunks, reread, [](size_t) {})) return false;
+        chunks = (tied.size() + PARALLEL_CHUNK_ROWS - 1) / PARALLEL_CHUNK_ROWS;
+        std::vector<std::vector<std::pair<size_t, size_t>>> still(chunks);
+        auto resort = [&](size_t chunk, size_t) {
+            size_t last =
+                std::min((chunk + 1) * PARALLEL_CHUNK_ROWS, tied.size());
+            for (size_t t = chunk * PARALLEL_CHUNK_ROWS; t < last; ++t) {
+                auto [begin, end] = tied[t];
+                std::sort(items.begin() + long(begin),
+                          items.begin() + long(end), before);
+                find_ties(begin, end, still[chunk]);
+            }
+        };
+        if (!editorParallelFor(E, chunks, resort, [](size_t) {})) return false;
+        tied.clear();
+        for (auto& runs : still)
+            tied.insert(tied.end(), runs.begin(), runs.end());
+    }
+    for (size_t i = 0; i < n; ++i) order[i] = int(uint32_t(items[i][2]));
+    return true;
+}
+
+// :[range]sor[t][!] [n][i][r][u] [/pat/] sorts the rows, backwards with !,
+// by the first number in them with n and ignoring case with i, dropping
+// rows whose key equals the one before with u. With a pattern the key is what
+// follows its match, or the match itself with r, and empty where it does
+// not match. Rows only trade places, so the undo step is just the order
+void editorSortCommand(editorConfig& E, editorExCommand& ex) {
+    editorSortKeys keys;
+    bool by_match = false, unique = false, has_pattern = false;
+    std::string pattern;
+    for (size_t at = 0; at < ex.arg.size();) {
+        char c = ex.arg[at];
+        if (c == 'n' || c == 'i' || c == 'r' || c == 'u' || c == ' ') {
+            keys.numeric |= c == 'n';
+            keys.ignore_case |= c == 'i';
+            by_match |= c == 'r';
+            unique |= c == 'u';
+            at++;
+        } else if (!has_pattern && !isalnum((unsigned char)c) && c != '\\' &&
+                   c != '"' && c != '|') {
+            pattern = editorParsePattern(ex.arg, at);
+            has_pattern = true;
+        } else {
+            editorSetStatusMessage(E, "E474: Invalid argument");
+            return;
+        }
+    }
+    std::shared_ptr<editorRegex> re;
+    if (has_pattern && !(re = editorUsePattern(E, pattern))) return;
+    keys.top = ex.top;
+    keys.reverse = ex.bang;
+    size_t n = size_t(ex.bottom - ex.top + 1);
+    if (n < 2) return;
+    editorSetStatusMessage(E, "Sorting %zu lines...", n);
+    size_t chunks = (n + PARALLEL_CHUNK_ROWS - 1) / PARALLEL_CHUNK_ROWS;
+    std::vector<editorRegex> copies;
+    if (re) {
+        copies.assign(std::min(editorWorkerCount(E), chunks), *re);
+        keys.spans.resize(n);
+    }
+    auto match_rows = [&](size_t chunk, size_t worker) {
+        size_t begin = chunk * PARALLEL_CHUNK_ROWS;
+        size_t end = std::min(begin + PARALLEL_CHUNK_ROWS, n);
+        for (size_t i = begin; i < end; ++i) {
+            const std::string& row = E.rows[size_t(keys.top) + i].raw_row;
+            size_t match_end,
+                at = editorRegexFind(copies[worker], row, 0, &match_end);
+            if (at == std::string::npos)
+                keys.spans[i] = {0, 0};
+            else if (by_match)
+                keys.spans[i] = {at, match_end};
+            else
+                keys.spans[i] = {match_end, row.size()};
+        }
+    };
+    std::vector<int> order(n);
+    if ((re && !editorParallelFor(E, chunks, match_rows, [](size_t) {})) ||
+        !editorSortOrder(E, keys, order)) {
+        editorSetStatusMessage(E, "Interrupted");
+        return;
+    }
+    std::vector<int> picked;  // where each row came from, for its span
+    if (unique && !keys.spans.empty()) picked = order;
+    bool moved = false;
+    for (size_t i = 0; i < n && !moved; ++i) moved = order[i] != (int)i;
+    if (moved) editorReorderRows(E, ex.top, std::move(order));
+    // with the rows in order, equal ones are neighbours read in turn
+    auto row = [&](size_t i) -> std::string_view {
+        return E.rows[size_t(ex.top) + i].raw_row;
+    };
+    auto key = [&](size_t i) {
+        if (picked.empty()) return row(i);
+        auto [start, end] = keys.spans[size_t(picked[i])];
+        return row(i).substr(start, end - start);
+    };
+    std::vector<int> repeated;
+    for (size_t i = 1; unique && i < n; ++i)
+        if (keys.numeric
+                ? editorSortNumber(key(i - 1)) == editorSortNumber(key(i))
+                : editorSortCompare(key(i - 1), key(i), keys.ignore_case) == 0)
+            repeated.push_back(ex.top + (int)i);
+    if (!repeated.empty()) editorDeleteScatteredRows(E, repeated);
+    E.cursor_y = ex.top;
+    E.cursor_x = 0;
+    if (repeated.size() > 2)
+        editorSetStatusMessage(E, "%zu fewer lines", repeated.size());
+    else
+        editorSetStatusMessage(E, "");
+}
+
+// :[range]uniq [i] drops every row that repeats an earlier one of the range,
+// ignoring case with i. The rows are hashed on the workers, then each worker
+// takes the rows whose hash falls in its share and looks them up in a table
+// of its own, so a row is only compared with rows of the same hash
+void editorUniqCommand(editorConfig& E, editorExCommand& ex) {
+    bool ignore_case = false;
+    for (char c : ex.arg) {
+        if (c != 'i' && c != ' ') {
+            editorSetStatusMessage(E, "E474: Invalid argument");
+            return;
+        }
+        ignore_case |= c == 'i';
+    }
+    int top = ex.top;
+    size_t n = size_t(ex.bottom - ex.top + 1);
+    if (n < 2) return;
+    std::vector<size_t> hashes(n);
+    auto hash_rows = [&](size_t chunk, size_t) {
+        size_t begin = chunk * PARALLEL_CHUNK_ROWS;
+        size_t end = std::min(begin + PARALLEL_CHUNK_ROWS, n);
+        std::string lower;
+        for (size_t i = begin; i < end; ++i) {
+            std::string_view row = E.rows[size_t(top) + i].raw_row;
+            if (ignore_case) {
+                lower.resize(row.size());
+                std::transform(row.begin(), row.end(), lower.begin(),
+                               [](char c) { return (char)tolower(c); });
+                row = lower;
+            }
+            hashes[i] = std::hash<std::string_view>()(row);
+        }
+    };
+    size_t parts = editorWorkerCount(E);
+    std::vector<std::vector<int>> repeats(parts);
+    // each part is an open addressed table of first rows, the high bits of
+    // a hash picking the part and the low ones the slot
+    auto find_repeats = [&](size_t part, size_t) {
+        size_t slots = 16;
+        while (slots < 2 * (n / parts + 1)) slots *= 2;
+        std::vector<int> firsts(slots, -1);
+        auto slot_of = [&](size_t i) { return hashes[i] & (slots - 1); };
+        for (size_t i = 0; i < n; ++i) {
+            // the slot sixteen rows on, and the row in the slot eight rows
+            // on, are asked for ahead so that their misses overlap
+            if (i + 16 < n) __builtin_prefetch(&firsts[slot_of(i + 16)]);
+            int ahead = i + 8 < n ? firsts[slot_of(i + 8)] : -1;
+            if (ahead >= 0) __builtin_prefetch(&E.rows[size_t(top + ahead)]);
+            if ((uint64_t(hashes[i]) >> 32) % parts != part) continue;
+            size_t slot = slot_of(i);
+            for (; firsts[slot] >= 0; slot = (slot + 1) & (slots - 1)) {
+                size_t first = size_t(firsts[slot]);
+                if (hashes[first] == hashes[i] &&
+                    editorSortCompare(E.rows[size_t(top) + first].raw_row,
+                                      E.rows[size_t(top) + i].raw_row,
+                                      ignore_case) == 0)
+                    break;
+            }
+            if (firsts[slot] < 0)
+                firsts[slot] = (int)i;
+            else
+                repeats[part].push_back(top + (int)i);
+        }
+    };
+    size_t chunks = (n + PARALLEL_CHUNK_ROWS - 1) / PARALLEL_CHUNK_ROWS;
+    if (!editorParallelFor(E, chunks, hash_rows, [](size_t) {}) ||
+        !editorParallelFor(E, parts, find_repeats, [](size_t) {})) {
+        editorSetStatusMessage(E, "Interrupted");
+        return;
+    }
+    std::vector<int> repeated;
+    for (auto& part : repeats)
+        repeated.insert(repeated.end(), part.begin(), part.end());
+    std::sort(repeated.begin(), repeated.end());
+    if (!repeated.empty()) editorDeleteScatteredRows(E, repeated);
+    E.cursor_y = std::min(top, std::max((int)E.rows.size() - 1, 0));
+    E.cursor_x = 0;
+    if (repeated.size() > 2)
+        editorSetStatusMessage(E, "%zu fewer lines", repeated.size());
+}
+
+// row with each run of blanks that holds a tab, or with all each run of two
+// or more, written again as tabs and spaces reaching the same column, or as
+// spaces alone with expandtab; false when that is the row as it was
+bool editorRetabRow(editorConfig& E, const std::string& row, bool all,
+                    std::string& out) {
+    out.clear();
+    int column = 0;
+    bool changed = false;
+    for (size_t x = 0; x < row.size();) {
+        if (row[x] != ' ' && row[x] != '\t') {
+            out += row[x++];
+            column++;
+            continue;
+        }
+        size_t start = x;
+        int from = column;
+        bool tab = false;
+        for (; x < row.size() && (row[x] == ' ' || row[x] == '\t'); ++x) {
+            tab |= row[x] == '\t';
+            column += row[x] == '\t' ? TAB_STOP - column % TAB_STOP : 1;
+        }
+        std::string_view run(row.data() + start, x - start);
+        size_t written = out.size();
+        if (!tab && !(all && run.size() > 1)) {
+            out += run;
+            continue;
+        }
+        for (int stop = from - from % TAB_STOP + TAB_STOP;
+             !E.expandtab && stop <= column; stop += TAB_STOP) {
+            out += '\t';
+            from = stop;
+        }
+        out.append(size_t(column - from), ' ');
+        changed |= std::string_view(out).substr(written) != run;
+    }
+    return changed;
+}
+
+// :[range]ret[ab][!] rewrites the blanks of the rows for TAB_STOP as
+// editorRetabRow does, the rows of each chunk on the workers and changed
+// neighbours swapped back in a run at a time
+void editorRetabCommand(editorConfig& E, editorExCommand& ex) {
+    size_t n = size_t(ex.bottom - ex.top + 1);
+    size_t chunks = (n + PARALLEL_CHUNK_ROWS - 1) / PARALLEL_CHUNK_ROWS;
+    std::vector<std::vector<int>> changed(chunks);
+    std::vector<std::vector<std::string>> rows(chunks);
+    auto task = [&](size_t chunk, size_t) {
+        size_t begin = size_t(ex.top) + chunk * PARALLEL_CHUNK_ROWS;
+        size_t end = std::min(begin + PARALLEL_CHUNK_ROWS, size_t(ex.top) + n);
+        std::string out;
+        for (size_t y = begin; y < end; ++y) {
+            if (!editorRetabRow(E, E.rows[y].raw_row, ex.bang, out)) continue;
+            changed[chunk].push_back((int)y);
+            rows[chunk].push_back(std::move(out));
+        }
+    };
+    size_t lines = 0;
+    auto merge = [&](size_t chunk) {
+        std::vector<std::string> span;
+        int span_top = -1;
+        auto flush = [&] {
+            size_t count = span.size();
+            if (count > 0)
+                editorReplaceRows(E, span_top, count, std::move(span));
+            span.clear();
+        };
+        for (size_t i = 0; i < changed[chunk].size(); ++i) {
+            int y = changed[chunk][i];
+            if (span_top + (int)span.size() != y) {
+                flush();
+                span_top = y;
+            }
+            span.push_back(std::move(rows[chunk][i]));
+        }
+        flush();
+        lines += changed[chunk].size();
+        changed[chunk] = std::vector<int>();
+        rows[chunk] = std::vector<std::string>();
+    };
+    if (!editorParallelFor(E, chunks, task, merge))
+        editorSetStatusMessage(E, "Interrupted: %zu lines changed", lines);
+    editorClampCursor(E);
+}
+
+/** external processes */
+
+bool editorFindProgram(const char* name) {
+    const char* path = getenv("PATH");
+    if (!path) return false;
+    std::string_view dirs(path);
+    while (!dirs.empty()) {
+        size_t end = std::min(dirs.find(':'), dirs.size());
+        std::string candidate(dirs.substr(0, end));
+        candidate += '/';
+        candidate += name;
+        if (access(candidate.c_str(), X_OK) == 0) return true;
+        dirs.remove_prefix(std::min(end + 1, dirs.size()));
+    }
+    return false;
+}
+
+// runs argv with the given fds as its stdin, stdout and stderr, which is
+// discarded when err_fd is -1, in dir unless that is NULL
+pid_t editorSpawn(const std::vector<const char*>& argv, int in_fd, int out_fd,
+                  int err_fd = -1, const char* dir = NULL) {
+    pid_t pid = fork();
+    if (pid != 0) return pid;
+    if (dir && chdir(dir) == -1) _exit(127);
+    dup2(in_fd, STDIN_FILENO);
+    dup2(out_fd, STDOUT_FILENO);
+    if (err_fd == -1) err_fd = open("/dev/null", O_WRONLY);
+    if (err_fd != -1) dup2(err_fd, STDERR_FILENO);
+    for (int fd = 3; fd < 256; ++fd) close(fd);
+    // ignored here while a child runs, which exec would keep
+    for (int sig : {SIGPIPE, SIGINT, SIGQUIT}) signal(sig, SIG_DFL);
+    std::vector<char*> args;
+    for (auto arg : argv) args.push_back(const_cast<char*>(arg));
+    args.push_back(NULL);
+    execvp(args[0], args.data());
+    _exit(127);
+}
+
+// the exit status of the child, 128 plus the signal if one killed it, or -1
+// when it can't be waited for
+int editorChildStatus(pid_t pid) {
+    int status;
+    while (waitpid(pid, &status, 0) == -1)
+        if (errno != EINTR) return -1;
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
+
+bool editorWaitChild(pid_t pid) {
+    return editorChildStatus(pid) == 0;
+}
+
+bool editorWriteAll(int fd, const char* buf, size_t len) {
+    while (len > 0) {
+        ssize_t written = write(fd, buf, len);
+        if (written == -1) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        buf += written;
+        len -= size_t(written);
+    }
+    return true;
+}
+
+// writes rows [top, bottom], each with a newline, to to_fd unless it is -1
+// while splitting what comes from from_fd into rows, a chunk at a time both
+// ways so neither side is ever held whole. to_fd is closed once it has all
+// of them or its reader has gone. The screen shows how far it got every so
+// often; false when a key press stopped it
+bool editorPumpRows(editorConfig& E, int to_fd, int from_fd, int top,
+                    int bottom, std::vector<std::string>& rows) {
+    std::string out, pending;  // pending is a row still being read
+    size_t sent = 0;
+    int y = top;
+    size_t x = 0;
+    // the rows from y and char x on, up to a chunk
+    auto fill = [&] {
+        out.clear();
+        sent = 0;
+        while (y <= bottom && out.size() < PIPE_CHUNK_BYTES) {
+            const std::string& row = E.rows[size_t(y)].raw_row;
+            size_t take =
+                std::min(row.size() - x, PIPE_CHUNK_BYTES - out.size());
+            out.append(row, x, take);
+            x += take;
+            if (x == row.size()) {
+                out += '\n';
+                y++;
+                x = 0;
+            }
+        }
+    };
+    if (to_fd != -1) fcntl(to_fd, F_SETFL, O_NONBLOCK);
+    fcntl(from_fd, F_SETFL, O_NONBLOCK);
+    std::vector<char> buf(PIPE_CHUNK_BYTES);
+    auto interval = std::chrono::milliseconds(PARALLEL_REDRAW_MS);
+    auto redrawn = std::chrono::steady_clock::now();
+    bool complete = true;
+    while (true) {
+        struct pollfd fds[3] = {{from_fd, POLLIN, 0},
+                                {E.terminal.input_fd, POLLIN, 0},
+                                {to_fd, POLLOUT, 0}};
+        if (poll(fds, to_fd == -1 ? 2 : 3, PARALLEL_REDRAW_MS) == -1 &&
+            errno != EINTR)
+            break;
+        if (fds[1].revents) {
+            complete = false;
+            break;
+        }
+        if (to_fd != -1 && fds[2].revents) {
+            if (sent == out.size()) fill();
+            ssize_t written =
+                write(to_fd, out.data() + sent, out.size() - sent);
+            if (written > 0) sent += size_t(written);
+            // EPIPE when the reader stops early, which is up to it
+            bool failed = written == -1 && errno != EAGAIN && errno != EINTR;
+            if (failed || (sent == out.size() && y > bottom)) {
+                close(to_fd);
+                to_fd = -1;
+            }
+        }
+        if (fds[0].revents) {
+            ssize_t got = read(from_fd, buf.data(), buf.size());
+            if (got == 0 || (got == -1 && errno != EAGAIN && errno != EINTR))
+                break;
+            const char* data = buf.data();
+            size_t left = got > 0 ? size_t(got) : 0;
+            while (const char* end = (const char*)memchr(data, '\n', left)) {
+                pending.append(data, size_t(end - data));
+                if (!pending.empty() && pending.back() == '\r')
+                    pending.pop_back();
+                rows.push_back(std::move(pending));
+                pending.clear();
+                left -= size_t(end - data) + 1;
+                data = end + 1;
+            }
+            pending.append(data, left);
+        }
+        if (std::chrono::steady_clock::now() - redrawn >= interval) {
+            editorSetStatusMessage(E, "%zu lines...", rows.size());
+            editorRefreshScreen(E);
+            redrawn = std::chrono::steady_clock::now();
+        }
+    }
+    if (to_fd != -1) close(to_fd);
+    if (!pending.empty()) rows.push_back(std::move(pending));
+    return complete;
+}
+
+// runs cmd through the shell with rows [top, bottom] as its input, or none
+// when top is past bottom, adding what it prints to rows. Returns its exit
+// status, -1 when it could not be run and -2 when a key press stopped it
+int editorShellFilter(editorConfig& E, const std::string& cmd, int top,
+                      int bottom, std::vector<std::string>& rows) {
+    int to_child[2], from_child[2];
+    if (pipe(to_child) == -1) return -1;
+    if (pipe(from_child) == -1) {
+        close(to_child[0]);
+        close(to_child[1]);
+        return -1;
+    }
+    std::string cwd = editorWorkingDirectory(E);
+    pid_t pid = editorSpawn({"sh", "-c", cmd.c_str()}, to_child[0],
+                            from_child[1], -1, cwd.c_str());
+    close(to_child[0]);
+    close(from_child[1]);
+    if (pid == -1) {
+        close(to_child[1]);
+        close(from_child[0]);
+        return -1;
+    }
+    int to_fd = to_child[1];
+    if (top > bottom) {
+        close(to_fd);
+        to_fd = -1;
+    }
+    bool complete = editorPumpRows(E, to_fd, from_child[0], top, bottom, rows);
+    close(from_child[0]);
+    if (!complete) kill(pid, SIGTERM);
+    int status = editorChildStatus(pid);
+    return complete ? status : -2;
+}
+
+/** compression */
+
+int editorDetectCompression(int fd) {
+    unsigned char magic[4];
+    ssize_t n = pread(fd, magic, sizeof(magic), 0);
+    if (n >= 2 && magic[0] == 0x1f && magic[1] == 0x8b)
+        return COMPRESSION_GZIP;
+    if (n == 4 && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f &&
+        magic[3] == 0xfd)
+        return COMPRESSION_ZSTD;
+    return COMPRESSION_NONE;
+}
+
+// pigz and zstd -T0 spread the work over all cores when they are available
+std::vector<const char*> editorCompressorArgs(int compression,
+                                              bool decompress) {
+    if (compression == COMPRESSION_GZIP) {
+        const char* gzip = editorFindProgram("pigz") ? "pigz" : "gzip";
+        if (decompress) return {gzip, "-dc"};
+        return {gzip, "-c"};
+    }
+    if (decompress) return {"zstd", "-dcq"};
+    return {"zstd", "-cq", "-T0"};
+}
+
+/** undo file */
+
+uint64_t editorHash(uint64_t hash, const char* data, size_t len) {
+    for (size_t i = 0; i < len; ++i) {
+        hash ^= (unsigned char)data[i];
+        hash *= 0x100000001b3ULL;  // 64-bit FNV-1a
+    }
+    return hash;
+}
+
+// hash of the buffer as editorRowsToString would write it
+uint64_t editorRowsHash(editorConfig& E) {
+    uint64_t hash = HASH_SEED;
+    for (const auto& row : E.rows) {
+        hash = editorHash(hash, row.raw_row.data(), row.raw_row.size());
+        hash = editorHash(hash, "\n", 1);
+    }
+    return hash;
+}
+
+// the history of dir/name lives in dir/.name.vun
+std::string editorUndoFilePath(editorConfig& E) {
+    size_t slash = E.filename.rfind('/');
+    size_t name = slash == std::string::npos ? 0 : slash + 1;
+    return E.filename.substr(0, name) + "." + E.filename.substr(name) +
+           ".vun";
+}
+
+void editorPutVarint(std::string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out += char(value | 0x80);
+        value >>= 7;
+    }
+    out += char(value);
+}
+
+struct editorUndoReader {
+    const std::string& in;
+    size_t at = 0;
+    bool ok = true;
+
+    uint64_t varint() {
+        uint64_t value = 0;
+        for (int shift = 0; ok && shift < 64; shift += 7) {
+            if (at == in.size()) break;
+            unsigned char byte = (unsigned char)in[at++];
+            value |= uint64_t(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) return value;
+        }
+        ok = false;
+        return 0;
+    }
+
+    std::string string() {
+        size_t len = size_t(varint());
+        if (!ok || len > in.size() - at) {
+            ok = false;
+            return "";
+        }
+        at += len;
+        return in.substr(at - len, len);
+    }
+};
+
+// written next to the file on every save, hash is the content just written
+void editorUndoWriteFile(editorConfig& E, uint64_t hash) {
+    const auto& tree = E.undo;
+    std::string out = UNDO_FILE_MAGIC;
+    editorPutVarint(out, hash);
+    editorPutVarint(out, tree.first);
+    editorPutVarint(out, tree.nodes.size());
+    editorPutVarint(out, tree.root);
+    editorPutVarint(out, tree.current);
+    for (const auto& node : tree.nodes) {
+        editorPutVarint(out, node.alive);
+        editorPutVarint(out, node.parent);
+        editorPutVarint(out, node.redo_child);
+        editorPutVarint(out, uint64_t(node.cursor_x));
+        editorPutVarint(out, uint64_t(node.cursor_y));
+        editorPutVarint(out, uint64_t(node.time));
+        editorPutVarint(out, node.ops.size());
+        for (const auto& op : node.ops) {
+            editorPutVarint(out, uint64_t(op.y));
+            editorPutVarint(out, uint64_t(op.x + 3));
+            editorPutVarint(out, op.present);
+            editorPutVarint(out, op.lines.size());
+            // ascending lines are stored as gaps, a permutation as it is
+            for (size_t i = 0; i < op.lines.size(); ++i)
+                editorPutVarint(out, uint64_t(op.lines[i] -
+                                              (i > 0 && op.x == -2
+                                                   ? op.lines[i - 1]
+                                                   : 0)));
+            editorPutVarint(out, op.absent.size());
+            for (const auto& text : op.absent) {
+                editorPutVarint(out, text.size());
+                out += text;
+            }
+        }
+    }
+    // it holds text taken out of the file, so it is no more readable than
+    // the file, and written under a fresh name so nothing put in its way is
+    // followed
+    std::string path = editorUndoFilePath(E);
+    std::string tmp = path + ".XXXXXX";
+    int fd = mkstemp(&tmp[0]);
+    if (fd == -1) return;
+    struct stat st;
+    mode_t mode = stat(E.filename.c_str(), &st) == 0 ? st.st_mode & 0600 : 0600;
+    bool written = fchmod(fd, mode) == 0 &&
+                   editorWriteAll(fd, out.data(), out.size());
+    if (close(fd) == -1) written = false;
+    if (!written || rename(tmp.c_str(), path.c_str()) == -1)
+        unlink(tmp.c_str());
+}
+
+bool editorUndoParseFile(const std::string& in, uint64_t hash,
+                         editorUndoTree& tree) {
+    editorUndoReader r{in};
+    size_t magic_len = strlen(UNDO_FILE_MAGIC);
+    if (in.compare(0, magic_len, UNDO_FILE_MAGIC) != 0) return false;
+    r.at = magic_len;
+    if (r.varint() != hash) return false;
+    tree.first = size_t(r.varint());
+    size_t count = size_t(r.varint());
+    tree.root = size_t(r.varint());
+    tree.current = size_t(r.varint());
+    size_t newest = tree.first + count - 1;
+    if (!r.ok || count == 0 || count > in.size() || tree.root < tree.first ||
+        tree.current < tree.root || tree.current > newest)
+        return false;
+    tree.nodes.assign(count, editorUndoNode());
+    for (auto& node : tree.nodes) {
+        node.alive = r.varint() != 0;
+        node.parent = size_t(r.varint());
+        node.redo_child = size_t(r.varint());
+        node.cursor_x = int(r.varint());
+        node.cursor_y = int(r.varint());
+        node.time = time_t(r.varint());
+        size_t ops = size_t(r.varint());
+        if (!r.ok || ops > in.size()) return false;
+        node.ops.resize(ops);
+        for (auto& op : node.ops) {
+            op.y = int(r.varint());
+            op.x = int(r.varint()) - 3;
+            op.present = size_t(r.varint());
+            size_t lines = size_t(r.varint());
+            if (!r.ok || op.x < -3 || lines > in.size()) return false;
+            for (size_t i = 0; i < lines && r.ok; ++i)
+                op.lines.push_back((i > 0 && op.x == -2 ? op.lines.back() : 0) +
+                                   int(r.varint()));
+            size_t texts = size_t(r.varint());
+            if (!r.ok || texts > in.size()) return false;
+            for (size_t i = 0; i < texts && r.ok; ++i)
+                op.absent.push_back(r.string());
+            if (op.x >= 0 && op.absent.size() != 1) return false;
+            if ((op.x <= -2) != !op.lines.empty()) return false;
+            if (op.x == -2 && op.absent.size() + op.present != lines)
+                return false;
+            if (op.x == -3) {
+                std::vector<bool> seen(lines);
+                if (!op.absent.empty() || op.present != lines) return false;
+                for (int line : op.lines) {
+                    if (line < 0 || size_t(line) >= lines || seen[size_t(line)])
+                        return false;
+                    seen[size_t(line)] = true;
+                }
+            }
+            tree.bytes += editorUndoOpBytes(op);
+        }
+        if (node.redo_child > newest) return false;
+    }
+    for (size_t seq = tree.root + 1; seq <= newest; ++seq) {
+        const auto& node = tree.nodes[seq - tree.first];
+        if (node.alive && (node.parent < tree.root || node.parent >= seq))
+            return false;
+    }
+    return r.ok && r.at == in.size();
+}
+
+// read on the first history command after opening, never by editorOpen. The
+// file describes the buffer as it was when last written, which is the root of
+// the history made since opening; that history is grafted onto its current
+// state
+bool editorUndoLoadFile(editorConfig& E) {
+    auto& tree = E.undo;
+    if (tree.file_checked) return false;
+    tree.file_checked = true;
+    if (E.filename == "" || E.hex.active || tree.first != 0 ||
+        tree.root != 0)
+        return false;
+    int fd = open(editorUndoFilePath(E).c_str(), O_RDONLY);
+    if (fd == -1) return false;
+    std::string in;
+    char buf[1 << 16];
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) > 0) in.append(buf, size_t(n));
+    close(fd);
+
+    int cursor_x = E.cursor_x, cursor_y = E.cursor_y;
+    size_t resume = tree.current;
+    editorUndoTravel(E, tree.root);
+    editorUndoTree loaded;
+    bool ok = editorUndoParseFile(in, editorRowsHash(E), loaded);
+    if (ok) {
+        size_t base = loaded.first + loaded.nodes.size() - 1;
+        auto graft = [&](size_t seq) {
+            return seq == 0 ? loaded.current : base + seq;
+        };
+        for (size_t seq = 1; seq < tree.nodes.size(); ++seq) {
+            auto& node = tree.nodes[seq];
+            node.parent = graft(node.parent);
+            if (node.redo_child != 0) node.redo_child = graft(node.redo_child);
+            loaded.nodes.push_back(std::move(node));
+        }
+        if (tree.nodes[0].redo_child != 0)
+            loaded.nodes[loaded.current - loaded.first].redo_child =
+                graft(tree.nodes[0].redo_child);
+        loaded.bytes += tree.bytes;
+        loaded.max_bytes = tree.max_bytes;
+        loaded.saved = tree.saved == SIZE_MAX ? SIZE_MAX : graft(tree.saved);
+        loaded.file_checked = true;
+        resume = graft(resume);
+        tree = std::move(loaded);
+    }
+    editorUndoTravel(E, resume);
+    E.cursor_x = cursor_x;
+    E.cursor_y = cursor_y;
+    editorClampCursor(E);
+    editorUndoPrune(E);
+    return ok;
+}
+
+/** hex view */
+
+bool editorLooksBinary(int fd) {
+    char buf[BINARY_SNIFF_BYTES];
+    ssize_t n = pread(fd, buf, sizeof(buf), 0);
+    return n > 0 && memchr(buf, '\0', size_t(n)) != NULL;
+}
+
+bool editorOpenHex(editorConfig& E, int fd) {
+    struct stat st;
+    if (fstat(fd, &st) == -1 || st.st_size == 0) return false;
+    E.hex = editorHexView();
+    E.hex.active = true;
+    E.hex.fd = fd;
+    E.hex.size = size_t(st.st_size);
+    return true;
+}
+
+void editorCloseHex(editorHexView& hex) {
+    if (!hex.active) return;
+    close(hex.fd);
+    hex = editorHexView();
+}
+
+// up to len bytes of the file from offset, as it is now: fewer when it has
+// been cut short since it was opened
+size_t editorHexRead(const editorHexView& hex, size_t offset,
+                     unsigned char* buf, size_t len) {
+    size_t got = 0;
+    while (got < len) {
+        ssize_t n = pread(hex.fd, buf + got, len - got, off_t(offset + got));
+        if (n == -1 && errno == EINTR) continue;
+        if (n <= 0) break;
+        got += size_t(n);
+    }
+    return got;
+}
+
+// the byte on disk, 0 past the end of a file cut short
+unsigned char editorHexFileByte(const editorHexView& hex, size_t offset) {
+    unsigned char byte = 0;
+    editorHexRead(hex, offset, &byte, 1);
+    return byte;
+}
+
+unsigned char editorHexByte(editorConfig& E, size_t offset) {
+    auto it = E.hex.patches.find(offset);
+    return it == E.hex.patches.end() ? editorHexFileByte(E.hex, offset)
+                                     : it->second;
+}
+
+void editorHexOverwriteNibble(editorConfig& E, int digit) {
+    if (E.hex.cursor >= E.hex.size) return;
+    unsigned char byte = editorHexByte(E, E.hex.cursor);
+    if (E.hex.low_nibble)
+        byte = (unsigned char)((byte & 0xf0) | digit);
+    else
+        byte = (unsigned char)((byte & 0x0f) | (digit << 4));
+    if (byte == editorHexFileByte(E.hex, E.hex.cursor))
+        E.hex.patches.erase(E.hex.cursor);
+    else
+        E.hex.patches[E.hex.cursor] = byte;
+    E.dirty = !E.hex.patches.empty();
+    if (E.hex.low_nibble && E.hex.cursor + 1 < E.hex.size) E.hex.cursor++;
+    E.hex.low_nibble = !E.hex.low_nibble;
+}
+
+void editorHexMoveCursor(editorConfig& E, long long delta) {
+    long long target = (long long)E.hex.cursor + delta;
+    long long last = (long long)E.hex.size - 1;
+    E.hex.cursor = size_t(std::clamp(target, 0LL, last));
+    E.hex.low_nibble = false;
+}
+
+// writes runs of adjacent patched bytes in place, the file is never rewritten
+bool editorHexSave(editorConfig& E, const char* filename, size_t& written) {
+    int fd = open(filename, O_WRONLY);
+    if (fd == -1) return false;
+    written = 0;
+    std::string run;
+    auto it = E.hex.patches.begin();
+    while (it != E.hex.patches.end()) {
+        size_t start = it->first;
+        run.clear();
+        while (it != E.hex.patches.end() && it->first == start + run.size())
+            run += (char)(it++)->second;
+        if (pwrite(fd, run.data(), run.size(), off_t(start)) !=
+            (ssize_t)run.size()) {
+            close(fd);
+            return false;
+        }
+        written += run.size();
+    }
+    close(fd);
+    E.hex.patches.clear();
+    return true;
+}
+
+/** list view */
+
+void editorListMove(editorConfig& E, long long delta) {
+    auto& list = E.list;
+    long long last = (long long)list.entries.size() - 1;
+    list.selected =
+        size_t(std::clamp((long long)list.selected + delta, 0LL,
+                          std::max(last, 0LL)));
+}
+
+// closes the list at the entry picked, or where the cursor was; it stays
+// as it is when the entry is in a buffer or file that is gone
+void editorListClose(editorConfig& E, bool jump) {
+    auto& list = E.list;
+    if (jump && list.selected < list.entries.size()) {
+        const editorListEntry& entry = list.entries[list.selected];
+        bool gone =
+            entry.buffer != 0
+                ? !editorGoToBuffer(E, entry.buffer)
+                : entry.file >= 0 &&
+                      !editorEditFile(E, list.files[size_t(entry.file)]);
+        if (gone) return;
+        editorJumpToLine(E, entry.y);
+        E.cursor_x = std::min(entry.x, editorRowLen(E, E.cursor_y));
+    }
+    list.active = false;
+}
+
+// :cnext and :cprevious go to the entry after or before the one picked
+void editorListStep(editorConfig& E, long long delta) {
+    auto& list = E.list;
+    if (list.entries.empty()) {
+        editorSetStatusMessage(E, "E42: No Errors");
+        return;
+    }
+    long long selected = (long long)list.selected + delta;
+    if (selected < 0 || selected >= (long long)list.entries.size()) {
+        editorSetStatusMessage(E, "E553: No more items");
+        return;
+    }
+    list.selected = size_t(selected);
+    editorListClose(E, true);
+    if (!list.active && E.cursor_y < (int)E.rows.size())
+        editorSetStatusMessage(E, "(%zu of %zu): %s", list.selected + 1,
+                               list.entries.size(),
+                               E.rows[size_t(E.cursor_y)].raw_row.c_str());
+}
+
+/** file i/o */
+
+// the directory relative names are taken from
+std::string editorWorkingDirectory(editorConfig& E) {
+    if (!E.cwd.empty()) return E.cwd;
+    char cwd[PATH_MAX];
+    return getcwd(cwd, sizeof(cwd)) ? cwd : "/";
+}
+
+// name from the working directory, so it stays right whichever directory
+// the process is in when the file is used
+std::string editorAbsolutePath(editorConfig& E, const std::string& name) {
+    if (name.empty() || name[0] == '/') return name;
+    std::string_view rest = name;
+    while (rest.substr(0, 2) == "./") rest.remove_prefix(2);
+    std::string dir = editorWorkingDirectory(E);
+    if (rest.empty() || rest == ".") return dir;
+    return dir + (dir.back() == '/' ? "" : "/") + std::string(rest);
+}
+
+// path as it is shown, from the working directory when it is under it
+std::string editorShortPath(editorConfig& E, const std::string& path) {
+    std::string dir = editorWorkingDirectory(E);
+    if (dir.back() != '/') dir += '/';
+    if (path.size() > dir.size() && path.compare(0, dir.size(), dir) == 0)
+        return path.substr(dir.size());
+    return path;
+}
+
+void editorReadLines(editorConfig& E, FILE* fp) {
+    char* line = NULL;
+    size_t linecap = 0;
+    ssize_t linelen;
+    while ((linelen = getline(&line, &linecap, fp)) != -1) {
+        while (linelen > 0 &&
+               (line[linelen - 1] == '\n' || line[linelen - 1] == '\r'))
+            linelen--;
+        E.rows.push_back({std::string(line, size_t(linelen)), "", ""});
+    }
+    free(line);
+}
+
+// reads filename into E.rows and E.hex; false with errno set if it can't
+bool editorLoadFile(editorConfig& E, const char* filename) {
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1) return false;
+    E.compression = editorDetectCompression(fd);
+    if (E.compression == COMPRESSION_NONE && editorLooksBinary(fd) &&
+        editorOpenHex(E, fd)) {
+        E.syntax = editorSyntax();
+        return true;
+    }
+    if (E.compression == COMPRESSION_NONE) {
+        FILE* fp = fdopen(fd, "r");
+        if (!fp) {
+            close(fd);
+            return false;
+        }
+        editorReadLines(E, fp);
+        fclose(fp);
+        return true;
+    }
+    // decompress in a child process while the lines are being split here
+    int pipe_fds[2];
+    if (pipe(pipe_fds) == -1) {
+        close(fd);
+        return false;
+    }
+    pid_t pid = editorSpawn(editorCompressorArgs(E.compression, true), fd,
+                            pipe_fds[1]);
+    close(pipe_fds[1]);
+    close(fd);
+    if (pid == -1) {
+        close(pipe_fds[0]);
+        return false;
+    }
+    FILE* fp = fdopen(pipe_fds[0], "r");
+    if (!fp) close(pipe_fds[0]);
+    else {
+        editorReadLines(E, fp);
+        fclose(fp);
+    }
+    if (!editorWaitChild(pid) || !fp) {
+        if (fp) errno = EIO;
+        return false;
+    }
+    return true;
+}
+
+// loads filename into a fresh buffer that replaces the current one, keeping
+// its number and cursor; the current one is left as it was when that fails
+bool editorOpen(editorConfig& E, const char* filename) {
+    editorBuffer loading;
+    loading.number = E.number;
+    loading.cursor_x = E.cursor_x;
+    loading.cursor_y = E.cursor_y;
+    loading.row_offset = E.row_offset;
+    loading.col_offset = E.col_offset;
+    loading.undo.max_bytes = E.undo.max_bytes;
+    std::swap(static_cast<editorBuffer&>(E), loading);
+    E.filename = editorAbsolutePath(E, filename);
+    editorSelectSyntaxHighlight(E);
+    bool loaded = editorLoadFile(E, E.filename.c_str());
+    // a file that isn't there yet starts empty, and :w makes it
+    E.new_file = !loaded && errno == ENOENT;
+    if (!loaded && !E.new_file) {
+        int saved_errno = errno;
+        editorCloseHex(E.hex);
+        std::swap(static_cast<editorBuffer&>(E), loading);
+        editorSetStatusMessage(E, "E484: Can't open file %s: %s", filename,
+                               strerror(saved_errno));
+        return false;
+    }
+    editorCloseHex(loading.hex);
+    editorUndoReset(E);
+    editorDamageRows(E, 0, INT_MAX);
+    E.dirty = false;
+    return true;
+}
+
+void editorToggleHex(editorConfig& E) {
+    if (E.dirty) {
+        editorSetStatusMessage(E, "File has unsaved changes. Use :w first");
+        return;
+    }
+    if (E.filename == "" || E.compression != COMPRESSION_NONE) {
+        editorSetStatusMessage(
+            E, "Hex view needs an uncompressed file on disk");
+        return;
+    }
+    int fd = open(E.filename.c_str(), O_RDONLY);
+    if (fd == -1) {
+        editorSetStatusMessage(E, "Can't open file: %s", strerror(errno));
+        return;
+    }
+    if (E.hex.active) {
+        FILE* fp = fdopen(fd, "r");
+        if (!fp) {
+            editorSetStatusMessage(E, "Can't open file: %s", strerror(errno));
+            close(fd);
+            return;
+        }
+        editorCloseHex(E.hex);
+        editorSelectSyntaxHighlight(E);
+        editorReadLines(E, fp);
+        fclose(fp);
+    } else if (editorOpenHex(E, fd)) {
+        E.rows.clear();
+        E.cursor_x = E.cursor_y = E.row_offset = E.col_offset = 0;
+    } else {
+        close(fd);
+        editorSetStatusMessage(E, "Can't map an empty file");
+    }
+    editorUndoReset(E);
+    editorDamageRows(E, 0, INT_MAX);
+    E.dirty = false;
+}
+
+std::string editorRowsToString(editorConfig& E) {
+    std::string representation = "";
+    for (const auto& s : E.rows) representation += s.raw_row + '\n';
+    return representation;
+}
+
+bool editorWriteCompressed(editorConfig& E, int fd,
+                           const std::string& representation) {
+    int pipe_fds[2];
+    if (pipe(pipe_fds) == -1) return false;
+    pid_t pid = editorSpawn(editorCompressorArgs(E.compression, false),
+                            pipe_fds[0], fd);
+    close(pipe_fds[0]);
+    if (pid == -1) {
+        close(pipe_fds[1]);
+        return false;
+    }
+    bool written = editorWriteAll(pipe_fds[1], representation.data(),
+                                  representation.size());
+    int saved_errno = written ? EIO : errno;
+    close(pipe_fds[1]);
+    bool compressed = editorWaitChild(pid);
+    errno = saved_errno;
+    return written && compressed;
+}
+
+// the compressor writes to a new file beside the old one, which it replaces
+// only once the compressor has succeeded; false with errno set otherwise
+bool editorSaveCompressed(editorConfig& E, const std::string& representation) {
+    char* resolved = realpath(E.filename.c_str(), NULL);
+    std::string path = resolved ? resolved : E.filename;
+    free(resolved);
+    size_t slash = path.rfind('/');
+    size_t name = slash == std::string::npos ? 0 : slash + 1;
+    std::string tmp =
+        path.substr(0, name) + "." + path.substr(name) + ".XXXXXX";
+    int fd = mkstemp(&tmp[0]);
+    if (fd == -1) return false;
+    struct stat st;
+    mode_t mode = stat(path.c_str(), &st) == 0 ? st.st_mode & 07777 : 0644;
+    bool written = fchmod(fd, mode) == 0 &&
+                   editorWriteCompressed(E, fd, representation);
+    if (close(fd) == -1) written = false;
+    if (written && rename(tmp.c_str(), path.c_str()) == 0) return true;
+    int saved_errno = errno;
+    unlink(tmp.c_str());
+    errno = saved_errno;
+    return false;
+}
+
+void editorSave(editorConfig& E) {
+    if (E.filename == "") return;
+    if (E.hex.active) {
+        size_t written;
+        if (editorHexSave(E, E.filename.c_str(), written)) {
+            editorSetStatusMessage(E, "%zu bytes patched on disk", written);
+            E.dirty = false;
+        } else {
+            editorSetStatusMessage(E, "Can't save! I/O error: %s",
+                                   strerror(errno));
+        }
+        return;
+    }
+    std::string representation = editorRowsToString(E);
+    size_t len = representation.size();
+    const char* buf = representation.c_str();
+    if (E.compression != COMPRESSION_NONE) {
+        if (editorSaveCompressed(E, representation)) {
+            editorSetStatusMessage(E, "%zu bytes compressed to disk", len);
+            E.new_file = false;
+            E.undo.saved = E.undo.current;
+            editorUndoWriteFile(E, editorHash(HASH_SEED, buf, len));
+            E.dirty = false;
+            return;
+        }
+        editorSetStatusMessage(E, "Can't save! I/O error: %s",
+                               strerror(errno));
+        return;
+    }
+    int fd = open(E.filename.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd != -1) {
+        if (ftruncate(fd, off_t(len)) != -1) {
+            // one write stops short of a buffer of 2 GiB or more
+            if (editorWriteAll(fd, buf, len)) {
+                close(fd);
+                editorSetStatusMessage(E, "%zu bytes written to disk", len);
+                E.new_file = false;
+                E.undo.saved = E.undo.current;
+                editorUndoWriteFile(E, editorHash(HASH_SEED, buf, len));
+                E.dirty = false;
+                return;
+            }
+        }
+        close(fd);
+    }
+    editorSetStatusMessage(E, "Can't save! I/O error: %s", strerror(errno));
+}
+
+/** buffers */
+
+// the buffer at index i of E.buffers, which is E itself for the current one
+editorBuffer& editorBufferAt(editorConfig& E, size_t i) {
+    return i == E.buffer ? E : E.buffers[i];
+}
+
+std::string editorBufferName(editorConfig& E, const editorBuffer& buffer) {
+    return buffer.filename.empty() ? "[No Name]"
+                                   : editorShortPath(E, buffer.filename);
+}
+
+// the index in E.buffers of the buffer numbered number, or the size of
+// E.buffers when there is none
+size_t editorFindBuffer(editorConfig& E, int number) {
+    size_t i = 0;
+    while (i < E.buffers.size() && editorBufferAt(E, i).number != number) i++;
+    return i;
+}
+
+// frees what the rows of an idle buffer cached for drawing, rebuilt when they
+// are drawn again; a key press stops it wherever it has got to
+void editorCompactBuffer(editorConfig& E, editorBuffer& buffer) {
+    size_t rows = buffer.rows.size();
+    size_t chunks = (rows + PARALLEL_CHUNK_ROWS - 1) / PARALLEL_CHUNK_ROWS;
+    auto task = [&](size_t chunk, size_t) {
+        size_t end = std::min((chunk + 1) * PARALLEL_CHUNK_ROWS, rows);
+        for (size_t y = chunk * PARALLEL_CHUNK_ROWS; y < end; ++y) {
+            editorRow& row = buffer.rows[y];
+            if (row.rendered_row.empty() && row.segments.capacity() == 0 &&
+                row.matches.capacity() == 0)
+                continue;  // never drawn
+            row.stale = true;
+            row.generation++;  // so the matches are looked for again too
+            std::string().swap(row.rendered_row);
+            std::string().swap(row.highlight_row);
+            std::vector<editorSegmentState>().swap(row.segments);
+            std::vector<int>().swap(row.matches);
+        }
+    };
+    editorParallelFor(E, chunks, task, [](size_t) {});
+}
+
+// makes the buffer at index i the current one, moving the one there was back
+// to its slot as it is
+void editorSwapBuffer(editorConfig& E, size_t i) {
+    if (i == E.buffer) return;
+    std::swap(static_cast<editorBuffer&>(E), E.buffers[E.buffer]);
+    std::swap(static_cast<editorBuffer&>(E), E.buffers[i]);
+    E.buffer = i;
+}
+
+bool editorBufferShown(editorConfig& E, int number) {
+    for (size_t i = 0; i < E.windows.size(); ++i)
+        if (i != E.window && E.windows[i].buffer == number) return true;
+    return false;
+}
+
+// goes to the buffer at index i in the current window; the one left, unless
+// another window shows it, has its caches dropped with compactidle set
+void editorSwitchBuffer(editorConfig& E, size_t i) {
+    size_t left = E.buffer;
+    editorSwapBuffer(E, i);
+    if (left != i && E.compact_idle &&
+        !editorBufferShown(E, E.buffers[left].number))
+        editorCompactBuffer(E, E.buffers[left]);
+}
+
+bool editorGoToBuffer(editorConfig& E, int number) {
+    size_t i = editorFindBuffer(E, number);
+    if (i == E.buffers.size()) {
+        editorSetStatusMessage(E, "E86: Buffer %d does not exist", number);
+        return false;
+    }
+    editorSwitchBuffer(E, i);
+    return true;
+}
+
+// makes path the current buffer, opening it in a new one unless a buffer
+// has it already; an empty unnamed buffer is used up rather than kept
+bool editorEditFile(editorConfig& E, const std::string& path) {
+    std::string filename = editorAbsolutePath(E, path);
+    struct stat wanted, other;
+    bool exists = stat(filename.c_str(), &wanted) == 0;
+    if (!exists && errno != ENOENT) {
+        editorSetStatusMessage(E, "E484: Can't open file %s", path.c_str());
+        return false;
+    }
+    for (size_t i = 0; i < E.buffers.size(); ++i) {
+        const std::string& name = editorBufferAt(E, i).filename;
+        if (name == filename ||
+            (exists && stat(name.c_str(), &other) == 0 &&
+             other.st_dev == wanted.st_dev && other.st_ino == wanted.st_ino)) {
+            editorSwitchBuffer(E, i);
+            return true;
+        }
+    }
+    size_t left = E.buffer;
+    if (!E.filename.empty() || E.dirty || !E.rows.empty() || E.hex.active) {
+        E.buffers.emplace_back();
+        E.buffers.back().number = ++E.last_number;
+        editorSwitchBuffer(E, E.buffers.size() - 1);
+    }
+    if (editorOpen(E, filename.c_str())) return true;
+    if (E.buffer != left) {
+        editorSwapBuffer(E, left);
+        E.buffers.pop_back();
+        E.last_number--;
+    }
+    return false;
+}
+
+// reads the current buffer's file again, dropping its changes and history
+bool editorReloadBuffer(editorConfig& E) {
+    if (E.filename.empty()) {
+        editorSetStatusMessage(E, "E32: No file name");
+        return false;
+    }
+    std::string name = E.filename;
+    if (!editorOpen(E, name.c_str())) return false;
+    editorClampCursor(E);
+    return true;
+}
+
+// closes the buffer at index i, which has to be left for another one first
+// if it is the current one; the last buffer left is emptied instead. Windows
+// that showed it show the current buffer
+void editorDeleteBuffer(editorConfig& E, size_t i) {
+    int gone = editorBufferAt(E, i).number;
+    if (E.buffers.size() == 1) {
+        editorCloseHex(E.hex);
+        static_cast<editorBuffer&>(E) = editorBuffer();
+        E.number = ++E.last_number;
+        editorDamageRows(E, 0, INT_MAX);
+    } else {
+        if (i == E.buffer)
+            editorSwitchBuffer(E, i + 1 < E.buffers.size() ? i + 1 : i - 1);
+        editorCloseHex(E.buffers[i].hex);
+        E.buffers.erase(E.buffers.begin() + long(i));
+        if (E.buffer > i) E.buffer--;
+    }
+    for (auto& window : E.windows) {
+        if (window.buffer != gone) continue;
+        window.buffer = E.number;
+        window.cursor_x = window.cursor_y = 0;
+        window.row_offset = window.col_offset = 0;
+    }
+}
+
+// shows the buffers in the list view, picking one goes to it
+void editorListBuffers(editorConfig& E) {
+    E.list = editorListView();
+    E.list.active = true;
+    E.list.title = ":ls";
+    for (size_t i = 0; i < E.buffers.size(); ++i) {
+        const editorBuffer& buffer = editorBufferAt(E, i);
+        editorListEntry entry;
+        entry.y = buffer.cursor_y;
+        entry.x = buffer.cursor_x;
+        entry.buffer = buffer.number;
+        entry.file = (int)i;
+        if (buffer.cursor_y < (int)buffer.rows.size())
+            entry.text = buffer.rows[size_t(buffer.cursor_y)].raw_row.substr(
+                0, GREP_TEXT_BYTES);
+        E.list.entries.push_back(std::move(entry));
+        E.list.files.push_back(std::to_string(buffer.number) + " " +
+                               editorBufferName(E, buffer) +
+                               (buffer.dirty ? " [+]" : ""));
+    }
+    E.list.selected = E.buffer;
+}
+
+/** windows */
+
+// keeps the current window's view in its entry, where it is drawn from and
+// where it waits while another window is current
+void editorSaveWindow(editorConfig& E) {
+    editorWindow& window = E.windows[E.window];
+    window.buffer = E.number;
+    window.cursor_x = E.cursor_x;
+    window.cursor_y = E.cursor_y;
+    window.row_offset = E.row_offset;
+    window.col_offset = E.col_offset;
+}
+
+// makes window i the current one, with its buffer and its view of it; what
+// the current window was is not kept
+void editorLoadWindow(editorConfig& E, size_t i) {
+    E.window = i;
+    const editorWindow& window = E.windows[i];
+    editorSwapBuffer(E, editorFindBuffer(E, window.buffer));
+    E.cursor_x = window.cursor_x;
+    E.cursor_y = window.cursor_y;
+    E.row_offset = window.row_offset;
+    E.col_offset = window.col_offset;
+    E.screen_rows = window.rows;
+    E.screen_cols = window.cols;
+    editorClampCursor(E);
+}
+
+void editorEnterWindow(editorConfig& E, size_t i) {
+    editorSaveWindow(E);
+    editorLoadWindow(E, i);
+}
+
+// shares the screen area at top, left of height rows, status lines included,
+// and width cols out evenly among the windows in frame
+void editorLayoutFrame(editorConfig& E, editorFrame& frame, int top, int left,
+                       int height, int width) {
+    if (frame.window >= 0) {
+        editorWindow& window = E.windows[size_t(frame.window)];
+        window.top = top;
+        window.left = left;
+        window.rows = height - 1;
+        window.cols = width;
+        window.edge = left + width == E.total_cols;
+        return;
+    }
+    int n = (int)frame.children.size();
+    int room = frame.vertical ? width - (n - 1) : height;  // less separators
+    int at = frame.vertical ? left : top;
+    for (int k = 0; k < n; ++k) {
+        int size = room / n + (k < room % n);
+        editorFrame& child = frame.children[size_t(k)];
+        if (frame.vertical) {
+            editorLayoutFrame(E, child, top, at, height, size);
+            at += size + 1;
+        } else {
+            editorLayoutFrame(E, child, at, left, size, width);
+            at += size;
+        }
+    }
+}
+
+// lays the windows out afresh, to be drawn again in full; false when one of
+// them is left without a row or a column
+bool editorLayout(editorConfig& E) {
+    editorLayoutFrame(E, E.layout, 0, 0, E.total_rows - 1, E.total_cols);
+    E.screen_rows = E.windows[E.window].rows;
+    E.screen_cols = E.windows[E.window].cols;
+    E.redraw = true;
+    for (const auto& window : E.windows)
+        if (window.rows < 1 || window.cols < 1) return false;
+    return true;
+}
+
+// the frame that has the frame of window as a child, and where; NULL when
+// the window has the whole screen
+editorFrame* editorFrameParent(editorFrame& frame, int window, size_t& at) {
+    for (size_t k = 0; k < frame.children.size(); ++k) {
+        editorFrame& child = frame.children[k];
+        if (child.window == window) {
+            at = k;
+            return &frame;
+        }
+        if (editorFrame* found = editorFrameParent(child, window, at))
+            return found;
+    }
+    return NULL;
+}
+
+// the window at the top left of frame
+int editorFrameFirst(const editorFrame& frame) {
+    return frame.window >= 0 ? frame.window
+                             : editorFrameFirst(frame.children[0]);
+}
+
+void editorFrameRenumber(editorFrame& frame, int removed) {
+    if (frame.window > removed) frame.window--;
+    for (auto& child : frame.children) editorFrameRenumber(child, removed);
+}
+
+// splits the current window in two that show the same, the new one above or
+// on the left becoming current
+bool editorSplitWindow(editorConfig& E, bool vertical) {
+    editorSaveWindow(E);
+    editorFrame layout = E.layout;
+    int old = (int)E.window, added = (int)E.windows.size();
+    size_t at = 0;
+    editorFrame* parent = editorFrameParent(E.layout, old, at);
+    editorFrame leaf{added, false, {}};
+    if (parent && parent->vertical == vertical) {
+        parent->children.insert(parent->children.begin() + long(at), leaf);
+    } else {
+        editorFrame& frame = parent ? parent->children[at] : E.layout;
+        frame = editorFrame{-1, vertical, {leaf, frame}};
+    }
+    editorWindow copy = E.windows[E.window];
+    copy.shown_buffer = 0;
+    E.windows.push_back(copy);
+    E.window = size_t(added);
+    if (!editorLayout(E)) {
+        E.windows.pop_back();
+        E.window = size_t(old);
+        E.layout = std::move(layout);
+        editorLayout(E);
+        editorSetStatusMessage(E, "E36: Not enough room");
+        return false;
+    }
+    return true;
+}
+
+// closes window i, the windows beside it taking its room; its buffer stays
+// open
+bool editorCloseWindow(editorConfig& E, size_t i) {
+    if (E.windows.size() == 1) {
+        editorSetStatusMessage(E, "E444: Cannot close last window");
+        return false;
+    }
+    editorSaveWindow(E);
+    size_t at = 0;
+    editorFrame* parent = editorFrameParent(E.layout, (int)i, at);
+    auto& children = parent->children;
+    children.erase(children.begin() + long(at));
+    size_t next =
+        size_t(editorFrameFirst(children[std::min(at, children.size() - 1)]));
+    if (children.size() == 1) {
+        editorFrame only = std::move(children[0]);
+        *parent = std::move(only);
+    }
+    E.windows.erase(E.windows.begin() + long(i));
+    editorFrameRenumber(E.layout, (int)i);
+    if (next > i) next--;
+    bool current = E.window == i;
+    if (current)
+        E.window = next;
+    else if (E.window > i)
+        E.window--;
+    editorLayout(E);
+    if (current) editorLoadWindow(E, next);
+    return true;
+}
+
+void editorOnlyWindow(editorConfig& E) {
+    editorSaveWindow(E);
+    E.windows = {E.windows[E.window]};
+    E.window = 0;
+    E.layout = editorFrame{0, false, {}};
+    editorLayout(E);
+}
+
+// the window whose area, with its status line and separator, has the cell
+// at y, x; E.windows.size() when none has
+size_t editorWindowAt(editorConfig& E, int y, int x) {
+    size_t i = 0;
+    for (; i < E.windows.size(); ++i) {
+        const editorWindow& window = E.windows[i];
+        if (y >= window.top && y <= window.top + window.rows &&
+            x >= window.left && x < window.left + window.cols + !window.edge)
+            break;
+    }
+    return i;
+}
+
+// the key after CTRL-W: s and v split, c closes, o keeps only the current
+// window, w and W go round the windows and h, j, k and l go to the one next
+// to the cursor that way
+void editorWindowCommand(editorConfig& E, int c, long long count) {
+    const editorWindow& window = E.windows[E.window];
+    int y = window.top + std::clamp(E.cursor_y - E.row_offset, 0,
+                                    std::max(window.rows - 1, 0));
+    int x = window.left + std::clamp(E.rendered_x - E.col_offset, 0,
+                                     std::max(window.cols - 1, 0));
+    size_t n = E.windows.size();
+    switch (c) {
+        case 's':
+        case 'S':
+        case CTRL_KEY('s'):
+            editorSplitWindow(E, false);
+            return;
+        case 'v':
+        case CTRL_KEY('v'):
+            editorSplitWindow(E, true);
+            return;
+        case 'c':
+            editorCloseWindow(E, E.window);
+            return;
+        case 'q':
+        case CTRL_KEY('q'):
+            editorExecuteCommand(E, "quit");
+            return;
+        case 'o':
+        case CTRL_KEY('o'):
+            editorOnlyWindow(E);
+            return;
+        case 'w':
+        case CTRL_KEY('w'):
+            // with a count, to that window
+            if (count > 0)
+                editorEnterWindow(E, size_t(std::min(count, (long long)n) - 1));
+            else
+                editorEnterWindow(E, (E.window + 1) % n);
+            return;
+        case 'W':
+            editorEnterWindow(E, (E.window + n - 1) % n);
+            return;
+        case 'h':
+        case ARROW_LEFT:
+        case CTRL_KEY('h'):
+            x = window.left - 1;  // on the separator of the one to the left
+            break;
+        case 'l':
+        case ARROW_RIGHT:
+        case CTRL_KEY('l'):
+            x = window.left + window.cols + 1;
+            break;
+        case 'k':
+        case ARROW_UP:
+        case CTRL_KEY('k'):
+            y = window.top - 1;  // on the status line of the one above
+            break;
+        case 'j':
+        case ARROW_DOWN:
+        case CTRL_KEY('j'):
+            y = window.top + window.rows + 1;
+            break;
+        default:
+            return;
+    }
+    size_t i = editorWindowAt(E, y, x);
+    if (i < n) editorEnterWindow(E, i);
+}
+
+/** ex commands */
+
+// one address: a line number, . for the cursor row, $ for the last, 'x for
+// mark x, or /pat/ and ?pat? for the next and the previous row matching pat,
+// then any + and - offsets. Line 0 is row -1. Returns 1 with the row in
+// line, 0 when there is no address and -1 after an error
+int editorParseAddress(editorConfig& E, const std::string& cmd, size_t& at,
+                       long long& line) {
+    int found = 1;
+    char c = at < cmd.size() ? cmd[at] : 0;
+    long long rows = (long long)E.rows.size();
+    if (isdigit((unsigned char)c)) {
+        line = 0;
+        while (at < cmd.size() && isdigit((unsigned char)cmd[at]))
+            line = std::min(line * 10 + (cmd[at++] - '0'), (long long)INT_MAX);
+        line--;
+    } else if (c == '.' || c == '$') {
+        line = cmd[at++] == '.' ? E.cursor_y : rows - 1;
+    } else if (c == '\'') {
+        int y, x;
+        if (!editorGetMark(E, at + 1 < cmd.size() ? cmd[at + 1] : 0, y, x))
+            return -1;
+        at += 2;
+        line = y;
+    } else if (c == '/' || c == '?') {
+        auto re = editorUsePattern(E, editorParsePattern(cmd, at));
+        if (!re) return -1;
+        line = -1;
+        for (long long i = 1; i <= rows && line < 0; ++i) {
+            long long y = ((E.cursor_y + (c == '/' ? i : -i)) % rows + rows) %
+                          rows;
+            if (editorRegexContains(*re, E.rows[size_t(y)].raw_row)) line = y;
+        }
+        if (line < 0) {
+            editorSetStatusMessage(E, "E486: Pattern not found: %s",
+                                   E.search_pattern.c_str());
+            return -1;
+        }
+    } else {
+        line = E.cursor_y;
+        found = c == '+' || c == '-';
+    }
+    while (at < cmd.size() && (cmd[at] == '+' || cmd[at] == '-')) {
+        long long sign = cmd[at++] == '+' ? 1 : -1, step = 0;
+        if (at == cmd.size() || !isdigit((unsigned char)cmd[at])) step = 1;
+        while (at < cmd.size() && isdigit((unsigned char)cmd[at]))
+            step = std::min(step * 10 + (cmd[at++] - '0'), (long long)INT_MAX);
+        line += sign * step;
+    }
+    return found;
+}
+
+// addresses separated by , or by ; which first moves the cursor to the one
+// before it, or % for all rows. Returns how many there are, the last two
+// giving top and bottom, or -1 after an error
+int editorParseRange(editorConfig& E, const std::string& cmd, size_t& at,
+                     long long& top, long long& bottom) {
+    top = bottom = E.cursor_y;
+    if (at < cmd.size() && cmd[at] == '%') {
+        at++;
+        top = 0;
+        bottom = (long long)E.rows.size() - 1;
+        return 2;
+    }
+    long long rows = (long long)E.rows.size();
+    int count = 0, cursor_y = E.cursor_y;
+    for (bool more = true; more;) {
+        long long line;
+        int found = editorParseAddress(E, cmd, at, line);
+        if (found < 0) {
+            count = -1;
+            break;
+        }
+        more = at < cmd.size() && (cmd[at] == ',' || cmd[at] == ';');
+        if (!found && !more && count == 0) break;
+        top = count == 0 ? line : bottom;
+        bottom = line;
+        count++;
+        if (more && cmd[at++] == ';')
+            E.cursor_y = (int)std::clamp(line, 0LL, std::max(rows - 1, 0LL));
+    }
+    E.cursor_y = cursor_y;
+    return count;
+}
+
+void editorSetOption(editorConfig& E, const std::string& option) {
+    size_t eq = option.find('=');
+    std::string name = option.substr(0, eq);
+    long long value = eq == std::string::npos ? -1 : atoll(&option[eq + 1]);
+    if (name == "undomem" && value >= 0) {
+        E.undo.max_bytes = size_t(value) << 20;
+        editorUndoPrune(E);
+    } else if (name == "hlsearch" || name == "hls") {
+        E.hlsearch = true;
+        E.hlsearch_hidden = false;
+    } else if (name == "nohlsearch" || name == "nohls") {
+        E.hlsearch = false;
+    } else if (name == "expandtab" || name == "et") {
+        E.expandtab = true;
+    } else if (name == "noexpandtab" || name == "noet") {
+        E.expandtab = false;
+    } else if (name == "compactidle") {
+        E.compact_idle = true;
+    } else if (name == "nocompactidle") {
+        E.compact_idle = false;
+    } else {
+        editorSetStatusMessage(E, "Unknown option: %s", option.data());
+    }
+}
+
+// :earlier and :later take a count of states or a time like 10s, 5m, 2h, 1d
+void editorUndoTimeTravel(editorConfig& E, const std::string& arg,
+                          int direction) {
+    char* unit;
+    long long amount = strtoll(arg.c_str(), &unit, 10);
+    if (unit == arg.c_str()) amount = 1;
+    while (*unit == ' ') unit++;
+    long long scale = 0;
+    switch (*unit) {
+        case 's':
+            scale = 1;
+            break;
+        case 'm':
+            scale = 60;
+            break;
+        case 'h':
+            scale = 60 * 60;
+            break;
+        case 'd':
+            scale = 24 * 60 * 60;
+            break;
+        case '\0':
+            break;
+        default:
+            editorSetStatusMessage(E, "Invalid argument: %s", arg.c_str());
+            return;
+    }
+    if (scale == 0)
+        editorUndoStep(E, direction * amount);
+    else
+        editorUndoTime(E, direction * amount * scale);
+}
+
+// :q closes the current window, and the editor with the last one
+void editorQuitCommand(editorConfig& E, editorExCommand& ex) {
+    if (E.windows.size() > 1) {
+        editorCloseWindow(E, E.window);
+        return;
+    }
+    if (E.dirty && !ex.bang) {
+        editorSetStatusMessage(
+            E, "File has unsaved changes. Use :q! to force quit");
+        return;
+    }
+    for (const auto& buffer : E.buffers) {
+        if (buffer.dirty && !ex.bang) {
+            editorSetStatusMessage(
+                E, "E162: No write since last change for buffer \"%s\"",
+                editorBufferName(E, buffer).c_str());
+            return;
+        }
+    }
+    E.quit = true;
+}
+
+// tells which buffer is the current one now
+void editorShowBuffer(editorConfig& E) {
+    std::string size = E.hex.active ? std::to_string(E.hex.size) + " bytes"
+                                    : std::to_string(E.rows.size()) + " lines";
+    std::string name = editorBufferName(E, E);
+    if (E.new_file && !E.dirty)
+        editorSetStatusMessage(E, "\"%s\" [New]", name.c_str());
+    else
+        editorSetStatusMessage(E, "\"%s\"%s %s", name.c_str(),
+                               E.dirty ? " [+]" : "", size.c_str());
+}
+
+// :e[dit] file goes to file, in a buffer of its own; a bare :e reads the
+// current buffer's file again, throwing its changes away with !
+void editorEditCommand(editorConfig& E, editorExCommand& ex) {
+    if (!ex.arg.empty()) {
+        if (editorEditFile(E, ex.arg)) editorShowBuffer(E);
+    } else if (E.dirty && !ex.bang) {
+        editorSetStatusMessage(
+            E, "E37: No write since last change (add ! to override)");
+    } else if (editorReloadBuffer(E)) {
+        editorShowBuffer(E);
+    }
+}
+
+// :b[uffer] N goes to the buffer numbered N, :b name to the one whose file
+// name is name or, failing that, the only one it is part of
+void editorBufferCommand(editorConfig& E, editorExCommand& ex) {
+    const std::string& arg = ex.arg;
+    if (!arg.empty() && isdigit((unsigned char)arg[0])) {
+        long long number = 0;
+        if (editorCountArg(E, arg, 0, number) &&
+            editorGoToBuffer(E, (int)number))
+            editorShowBuffer(E);
+        return;
+    }
+    size_t found = E.buffers.size(), partial = 0;
+    std::string path = editorAbsolutePath(E, arg);
+    for (size_t i = 0; i < E.buffers.size() && !arg.empty(); ++i) {
+        const std::string& name = editorBufferAt(E, i).filename;
+        if (name == path) {
+            found = i;
+            partial = 1;
+            break;
+        }
+        if (name.find(arg) != std::string::npos && partial++ == 0) found = i;
+    }
+    if (partial > 1) {
+        editorSetStatusMessage(E, "E93: More than one match for %s",
+                               arg.c_str());
+        return;
+    }
+    if (!arg.empty() && found == E.buffers.size()) {
+        editorSetStatusMessage(E, "E94: No matching buffer for %s",
+                               arg.c_str());
+        return;
+    }
+    if (found < E.buffers.size()) editorSwitchBuffer(E, found);
+    editorShowBuffer(E);
+}
+
+// :sp[lit] [file] and :vs[plit] [file] split the current window, the new
+// one going to file if there is one
+void editorSplitCommand(editorConfig& E, editorExCommand& ex) {
+    if (editorSplitWindow(E, ex.name == "vsplit") && !ex.arg.empty() &&
+        editorEditFile(E, ex.arg))
+        editorShowBuffer(E);
+}
+
+// :bn[ext] [N] and :bp[revious] [N] go N buffers on or back, round the end
+void editorBufferStepCommand(editorConfig& E, editorExCommand& ex) {
+    long long count = 1;
+    if (!editorCountArg(E, ex.arg, 0, count)) return;
+    long long n = (long long)E.buffers.size();
+    long long step = ex.name == "bnext" ? count : -count;
+    editorSwitchBuffer(E, size_t((((long long)E.buffer + step) % n + n) % n));
+    editorShowBuffer(E);
+}
+
+// :bd[elete][!] [N] closes the buffer numbered N, the current one by default
+void editorBufferDeleteCommand(editorConfig& E, editorExCommand& ex) {
+    long long number = E.number;
+    if (!editorCountArg(E, ex.arg, 0, number)) return;
+    size_t i = editorFindBuffer(E, (int)number);
+    if (i == E.buffers.size()) {
+        editorSetStatusMessage(E, "E516: No buffers were deleted");
+        return;
+    }
+    if (editorBufferAt(E, i).dirty && !ex.bang) {
+        editorSetStatusMessage(
+            E, "E89: No write since last change for buffer %lld (add ! to "
+               "override)",
+            number);
+        return;
+    }
+    editorDeleteBuffer(E, i);
+    editorShowBuffer(E);
+}
+
+// :[range]d[elete] [x] [count] and :[range]y[ank] [x] [count]; a count
+// makes the range that many rows from its last one
+void editorDeleteYankCommand(editorConfig& E, editorExCommand& ex) {
+    char reg;
+    long long count;
+    if (!editorRegisterArg(E, ex.arg, reg, count)) return;
+    if (count > 0) {
+        ex.top = ex.bottom;
+        ex.bottom = (int)std::min(ex.top + count - 1,
+                                  (long long)E.rows.size() - 1);
+    }
+    int cursor_y = E.cursor_y, cursor_x = E.cursor_x;
+    editorOperate(E, ex.name[0], reg, MOTION_LINEWISE, ex.top, 0, ex.bottom, 0);
+    if (ex.name == "yank") {
+        E.cursor_y = cursor_y;
+        E.cursor_x = cursor_x;
+    }
+}
+
+// :[range]m[ove] address moves the rows below the address, 0 being above
+// the first row, and :[range]co[py] or :[range]t address puts a copy there;
+// a splice or two however many rows there are
+void editorMoveCopyCommand(editorConfig& E, editorExCommand& ex) {
+    size_t at = 0;
+    long long line;
+    int found = editorParseAddress(E, ex.arg, at, line);
+    if (found < 0) return;
+    if (!found || line < -1 || line >= (long long)E.rows.size()) {
+        editorSetStatusMessage(E, "E14: Invalid address");
+        return;
+    }
+    if (at < ex.arg.size()) {
+        editorSetStatusMessage(E, "E488: Trailing characters: %s",
+                               ex.arg.c_str() + at);
+        return;
+    }
+    bool move = ex.name == "move";
+    int top = ex.top, bottom = ex.bottom, below = (int)line + 1;
+    size_t count = size_t(bottom - top + 1);
+    if (move && below > top && below <= bottom) {
+        editorSetStatusMessage(
+            E, "E134: Cannot move a range of lines into itself");
+        return;
+    }
+    std::vector<std::string> rows;
+    rows.reserve(count);
+    for (int y = top; y <= bottom; ++y)
+        rows.push_back(E.rows[size_t(y)].raw_row);
+    if (move && below != top && below != bottom + 1) {
+        // marks go along with their rows
+        std::vector<std::pair<char, editorMark>> moved;
+        for (auto& mark : E.marks)
+            if (mark.second.y >= top && mark.second.y <= bottom)
+                moved.push_back(mark);
+        editorReplaceRows(E, top, count, {});
+        if (below > bottom) below -= (int)count;
+        editorReplaceRows(E, below, 0, std::move(rows));
+        for (auto& mark : moved) {
+            mark.second.y += below - top;
+            E.marks[mark.first] = mark.second;
+        }
+    } else if (move) {
+        below = top;
+    } else {
+        editorReplaceRows(E, below, 0, std::move(rows));
+    }
+    E.cursor_y = below + (int)count - 1;
+    E.cursor_x = (int)editorSkipClass(E.rows[size_t(E.cursor_y)].raw_row, 0,
+                                      CLASS_BLANK, false);
+    if (count > 2)
+        editorSetStatusMessage(E, move ? "%zu lines moved" : "%zu more lines",
+                               count);
+}
+
+// :[range]j[oin][!] [count] makes the rows one in a single splice, each but
+// the first without its indent and after a space, or as they are with !. A
+// range of one row joins it with the next, and a count joins that many rows
+// from the last one of the range
+void editorJoinCommand(editorConfig& E, editorExCommand& ex) {
+    long long count = 0;
+    if (!editorCountArg(E, ex.arg, 0, count)) return;
+    long long top = ex.top, bottom = ex.bottom;
+    if (count > 0) {
+        top = bottom;
+        bottom = top + std::max(count - 1, 1LL);
+    } else if (top == bottom) {
+        bottom++;
+    }
+    bottom = std::min(bottom, (long long)E.rows.size() - 1);
+    if (top >= bottom) return;
+    std::string joined = E.rows[size_t(top)].raw_row;
+    size_t x = 0;
+    for (long long y = top + 1; y <= bottom; ++y) {
+        const std::string& row = E.rows[size_t(y)].raw_row;
+        x = joined.size();
+        if (ex.bang) {
+            joined += row;
+            continue;
+        }
+        size_t start = std::min(row.find_first_not_of(" \t"), row.size());
+        if (start < row.size() && !joined.empty() && joined.back() != ' ' &&
+            joined.back() != '\t' && row[start] != ')')
+            joined += ' ';
+        joined.append(row, start, std::string::npos);
+    }
+    editorReplaceRows(E, (int)top, size_t(bottom - top + 1),
+                      {std::move(joined)});
+    E.cursor_y = (int)top;
+    E.cursor_x = (int)x;
+}
+
+// :[range]> shifts the rows right once, :[range]>> twice and so on, and :<
+// to the left; a count shifts that many rows from the last one of the range
+void editorShiftCommand(editorConfig& E, editorExCommand& ex) {
+    char op = ex.name[0];
+    long long shifts = 1, count = 0;
+    size_t at = 0;
+    for (; at < ex.arg.size() && (ex.arg[at] == op || ex.arg[at] == ' '); ++at)
+        shifts += ex.arg[at] == op;
+    if (!editorCountArg(E, ex.arg, at, count)) return;
+    if (count > 0) {
+        ex.top = ex.bottom;
+        ex.bottom = (int)std::min(ex.top + count - 1,
+                                  (long long)E.rows.size() - 1);
+    }
+    editorOperate(E, op, '"', MOTION_LINEWISE, ex.top, 0, ex.bottom, 0, shifts);
+}
+
+// :[line]pu[t] [x] puts register x as rows below the line, or above it with
+// :put!; :0put puts them above the first row
+void editorPutCommand(editorConfig& E, editorExCommand& ex) {
+    char name = ex.arg.empty() ? '"' : (char)tolower(ex.arg[0]);
+    if (ex.arg.size() > 1) {
+        editorSetStatusMessage(E, "E488: Trailing characters: %s",
+                               ex.arg.c_str() + 1);
+        return;
+    }
+    auto it = E.registers.find(name);
+    if (it == E.registers.end() || it->second->text.empty()) {
+        editorSetStatusMessage(E, "Nothing in register %c", name);
+        return;
+    }
+    int at = std::max(ex.bang ? ex.bottom : ex.bottom + 1, 0);
+    size_t added = it->second->text.size();
+    editorReplaceRows(E, at, 0, it->second->text);
+    E.cursor_y = at + (int)added - 1;
+    E.cursor_x = (int)editorSkipClass(E.rows[size_t(E.cursor_y)].raw_row, 0,
+                                      CLASS_BLANK, false);
+    if (added > 2) editorSetStatusMessage(E, "%zu more lines", added);
+}
+
+// :[line]ma[rk] x and :[line]k x set mark x at the start of the line
+void editorMarkCommand(editorConfig& E, editorExCommand& ex) {
+    if (ex.arg.empty())
+        editorSetStatusMessage(E, "E471: Argument required");
+    else if (ex.arg.size() > 1)
+        editorSetStatusMessage(E, "E488: Trailing characters: %s",
+                               ex.arg.c_str() + 1);
+    else if (!editorSetMark(E, ex.arg[0], ex.bottom, 0))
+        editorSetStatusMessage(
+            E, "E191: Argument must be a letter or forward/backward quote");
+}
+
+// :[range]!cmd replaces the rows with what cmd prints when given them, and
+// :!cmd runs cmd on the terminal, errors and all. The editor waits for it
+// as a shell would, so a front end serving others hears from none of them
+// until it is done
+void editorBangCommand(editorConfig& E, editorExCommand& ex) {
+    if (ex.arg.empty()) {
+        editorSetStatusMessage(E, "E471: Argument required");
+        return;
+    }
+    if (ex.addresses == 0) {
+        editorTerminal& terminal = E.terminal;
+        if (terminal.input_fd == -1 || terminal.output_fd == -1) {
+            editorSetStatusMessage(E, "No terminal to run %s on",
+                                   ex.arg.c_str());
+            return;
+        }
+        if (terminal.raw_mode) terminal.raw_mode(false);
+        // ^C and ^\ are for the child now, not for us
+        auto on_int = signal(SIGINT, SIG_IGN);
+        auto on_quit = signal(SIGQUIT, SIG_IGN);
+        std::string cwd = editorWorkingDirectory(E);
+        pid_t pid = editorSpawn({"sh", "-c", ex.arg.c_str()},
+                                terminal.input_fd, terminal.output_fd,
+                                terminal.output_fd, cwd.c_str());
+        int status = pid == -1 ? -1 : editorChildStatus(pid);
+        signal(SIGINT, on_int);
+        signal(SIGQUIT, on_quit);
+        const char prompt[] = "\nPress ENTER to continue";
+        std::ignore = write(terminal.output_fd, prompt, sizeof(prompt) - 1);
+        char c = 0;
+        while (c != '\n' && read(terminal.input_fd, &c, 1) == 1) {}
+        if (terminal.raw_mode) terminal.raw_mode(true);
+        E.redraw = true;
+        if (status != 0) editorSetStatusMessage(E, "shell returned %d", status);
+        return;
+    }
+    std::vector<std::string> rows;
+    int status = editorShellFilter(E, ex.arg, ex.top, ex.bottom, rows);
+    if (status == -2) {
+        editorSetStatusMessage(E, "Interrupted");
+        return;
+    }
+    if (status == -1 || (status != 0 && rows.empty())) {
+        editorSetStatusMessage(E, "shell returned %d", status);
+        return;
+    }
+    size_t count = size_t(ex.bottom - ex.top + 1);
+    // the output becomes the rows as is and the old ones move to the undo
+    editorReplaceRows(E, ex.top, count, std::move(rows));
+    E.cursor_y = ex.top;
+    E.cursor_x = 0;
+    editorClampCursor(E);
+    if (status != 0)
+        editorSetStatusMessage(E, "shell returned %d", status);
+    else
+        editorSetStatusMessage(E, "%zu lines filtered", count);
+}
+
+// :[line]r[ead] file and :[line]r[ead] !cmd put the file's rows or what cmd
+// prints below the line; :0read puts them above the first row
+void editorReadCommand(editorConfig& E, editorExCommand& ex) {
+    std::vector<std::string> rows;
+    if (!ex.arg.empty() && ex.arg[0] == '!') {
+        size_t at = ex.arg.find_first_not_of(' ', 1);
+        if (at == std::string::npos) {
+            editorSetStatusMessage(E, "E471: Argument required");
+            return;
+        }
+        int status = editorShellFilter(E, ex.arg.substr(at), 0, -1, rows);
+        if (status == -2) {
+            editorSetStatusMessage(E, "Interrupted");
+            return;
+        }
+        if (status != 0) editorSetStatusMessage(E, "shell returned %d", status);
+        if (status == -1) return;
+    } else {
+        std::string path = editorAbsolutePath(E, ex.arg);
+        if (path.empty()) path = E.filename;
+        int fd = path.empty() ? -1 : open(path.c_str(), O_RDONLY);
+        if (fd == -1) {
+            editorSetStatusMessage(E, path.empty() ? "E32: No file name"
+                                                : "E484: Can't open file %s",
+                                   editorShortPath(E, path).c_str());
+            return;
+        }
+        bool complete = editorPumpRows(E, -1, fd, 0, -1, rows);
+        close(fd);
+        if (!complete) {
+            editorSetStatusMessage(E, "Interrupted");
+            return;
+        }
+    }
+    if (rows.empty()) return;
+    int at = ex.bottom + 1;
+    size_t added = rows.size();
+    editorReplaceRows(E, at, 0, std::move(rows));
+    E.cursor_y = at;
+    E.cursor_x = 0;
+    if (added > 2) editorSetStatusMessage(E, "%zu more lines", added);
+}
+
+void editorOpenListCommand(editorConfig& E, editorExCommand&) {
+    if (E.list.entries.empty())
+        editorSetStatusMessage(E, "E42: No Errors");
+    else
+        E.list.active = true;
+}
+
+// the commands by name; a name may be typed cut short to least chars, and
+// where two names share a short form the first one gets it
+const std::vector<editorExCommandSpec> EX_COMMANDS = {
+    {"substitute", 1, EX_RANGE | EX_EXTRA, editorSubstituteCommand},
+    {"&", 1, EX_RANGE | EX_EXTRA, editorSubstituteCommand},
+    {"global", 1, EX_RANGE | EX_WHOLE | EX_BANG | EX_EXTRA,
+     editorGlobalCommand},
+    {"vglobal", 1, EX_RANGE | EX_WHOLE | EX_EXTRA, editorGlobalCommand},
+    {"delete", 1, EX_RANGE | EX_EXTRA, editorDeleteYankCommand},
+    {"yank", 1, EX_RANGE | EX_EXTRA, editorDeleteYankCommand},
+    {"move", 1, EX_RANGE | EX_EXTRA, editorMoveCopyCommand},
+    {"copy", 2, EX_RANGE | EX_EXTRA, editorMoveCopyCommand},
+    {"t", 1, EX_RANGE | EX_EXTRA, editorMoveCopyCommand},
+    {"join", 1, EX_RANGE | EX_BANG | EX_EXTRA, editorJoinCommand},
+    {">", 1, EX_RANGE | EX_EXTRA, editorShiftCommand},
+    {"<", 1, EX_RANGE | EX_EXTRA, editorShiftCommand},
+    {"put", 2, EX_RANGE | EX_ZERO | EX_BANG | EX_EXTRA, editorPutCommand},
+    {"mark", 2, EX_RANGE | EX_EXTRA, editorMarkCommand},
+    {"k", 1, EX_RANGE | EX_EXTRA, editorMarkCommand},
+    {"normal", 4, EX_RANGE | EX_BANG | EX_EXTRA, editorNormalCommand},
+    {"vimgrep", 3, EX_BANG | EX_EXTRA, editorGrepCommand},
+    {"quit", 1, EX_BANG, editorQuitCommand},
+    {"sort", 3, EX_RANGE | EX_WHOLE | EX_BANG | EX_EXTRA, editorSortCommand},
+    {"uniq", 3, EX_RANGE | EX_WHOLE | EX_EXTRA, editorUniqCommand},
+    {"retab", 3, EX_RANGE | EX_WHOLE | EX_BANG, editorRetabCommand},
+    {"!", 1, EX_RANGE | EX_EXTRA, editorBangCommand},
+    {"read", 1, EX_RANGE | EX_ZERO | EX_EXTRA, editorReadCommand},
+    {"write", 1, 0, [](editorConfig& E, editorExCommand&) { editorSave(E); }},
+    {"edit", 1, EX_BANG | EX_EXTRA, editorEditCommand},
+    {"buffer", 1, EX_EXTRA, editorBufferCommand},
+    {"bnext", 2, EX_EXTRA, editorBufferStepCommand},
+    {"bprevious", 2, EX_EXTRA, editorBufferStepCommand},
+    {"bNext", 2, EX_EXTRA, editorBufferStepCommand},
+    {"bdelete", 2, EX_BANG | EX_EXTRA, editorBufferDeleteCommand},
+    {"ls", 2, 0,
+     [](editorConfig& E, editorExCommand&) { editorListBuffers(E); }},
+    {"split", 2, EX_EXTRA, editorSplitCommand},
+    {"vsplit", 2, EX_EXTRA, editorSplitCommand},
+    {"close", 3, EX_BANG,
+     [](editorConfig& E, editorExCommand&) {
+         editorCloseWindow(E, E.window);
+     }},
+    {"only", 2, EX_BANG,
+     [](editorConfig& E, editorExCommand&) { editorOnlyWindow(E); }},
+    {"buffers", 7, 0,
+     [](editorConfig& E, editorExCommand&) { editorListBuffers(E); }},
+    {"hex", 3, 0,
+     [](editorConfig& E, editorExCommand&) { editorToggleHex(E); }},
+    {"nohlsearch", 3, 0,
+     [](editorConfig& E, editorExCommand&) { E.hlsearch_hidden = true; }},
+    {"count", 5, EX_EXTRA,
+     [](editorConfig& E, editorExCommand& ex) {
+         editorCountMatches(E, ex.arg, false);
+     }},
+    {"matches", 7, EX_EXTRA,
+     [](editorConfig& E, editorExCommand& ex) {
+         editorCountMatches(E, ex.arg, true);
+     }},
+    {"cnext", 2, 0,
+     [](editorConfig& E, editorExCommand&) { editorListStep(E, 1); }},
+    {"cprevious", 2, 0,
+     [](editorConfig& E, editorExCommand&) { editorListStep(E, -1); }},
+    {"cNext", 2, 0,
+     [](editorConfig& E, editorExCommand&) { editorListStep(E, -1); }},
+    {"copen", 4, 0, editorOpenListCommand},
+    {"cclose", 3, 0,
+     [](editorConfig& E, editorExCommand&) { E.list.active = false; }},
+    {"set", 2, EX_EXTRA,
+     [](editorConfig& E, editorExCommand& ex) {
+         editorSetOption(E, ex.arg);
+     }},
+    {"earlier", 2, EX_EXTRA,
+     [](editorConfig& E, editorExCommand& ex) {
+         editorUndoTimeTravel(E, ex.arg, -1);
+     }},
+    {"later", 3, EX_EXTRA,
+     [](editorConfig& E, editorExCommand& ex) {
+         editorUndoTimeTravel(E, ex.arg, 1);
+     }},
+};
+
+// every way of typing each command, hashed once on first use
+const editorExCommandSpec* editorFindCommand(const std::string& name) {
+    static const auto names = [] {
+        std::unordered_map<std::string, const editorExCommandSpec*> names;
+        for (const auto& spec : EX_COMMANDS) {
+            std::string full = spec.name;
+            for (size_t n = spec.least; n <= full.size(); ++n)
+                names.emplace(full.substr(0, n), &spec);
+        }
+        return names;
+    }();
+    auto it = names.find(name);
+    return it == names.end() ? NULL : it->second;
+}
+
+// takes text apart into ex: a range, a command from the table, a ! and an
+// argument, each checked against what the command takes. False, with the
+// error shown, when that fails
+bool editorParseCommand(editorConfig& E, const std::string& text,
+                        editorExCommand& ex) {
+    ex = editorExCommand();
+    ex.text = text;
+    size_t at = 0;
+    while (at < text.size() && (text[at] == ':' || text[at] == ' ')) at++;
+    long long top, bottom;
+    ex.addresses = editorParseRange(E, text, at, top, bottom);
+    if (ex.addresses < 0) return false;
+    while (at < text.size() && text[at] == ' ') at++;
+    size_t name = at;
+    if (at < text.size() && !isalpha((unsigned char)text[at]))
+        at++;  // & < > and the like are one char
+    else
+        while (at < text.size() && isalpha((unsigned char)text[at])) at++;
+    const editorExCommandSpec* spec =
+        editorFindCommand(text.substr(name, at - name));
+    if (!spec && at - name > 1 && text[name] == 'k') {
+        // :ka is :k a
+        at = name + 1;
+        spec = editorFindCommand("k");
+    }
+    if (!spec && at > name) {
+        editorSetStatusMessage(E, "E492: Not an editor command: %s",
+                               text.c_str());
+        return false;
+    }
+    int flags = spec ? spec->flags : EX_RANGE;
+    if (spec) ex.name = spec->name;
+    if (ex.addresses > 0 && !(flags & EX_RANGE)) {
+        editorSetStatusMessage(E, "E481: No range allowed");
+        return false;
+    }
+    if (flags & EX_RANGE) {
+        long long rows = (long long)E.rows.size();
+        if (ex.addresses == 0 && (flags & EX_WHOLE)) {
+            top = 0;
+            bottom = rows - 1;
+        }
+        if (top > bottom) std::swap(top, bottom);
+        if (!(flags & EX_ZERO)) {
+            top = std::max(top, 0LL);
+            bottom = std::max(bottom, 0LL);
+        } else if (rows == 0) {
+            top = bottom = -1;  // an empty buffer only has room above
+        }
+        // a bare range only moves the cursor, as far as it goes
+        if (!spec) bottom = std::min(bottom, std::max(rows - 1, 0LL));
+        if (top < -1 || (spec && bottom >= rows)) {
+            editorSetStatusMessage(E, "E16: Invalid range");
+            return false;
+        }
+        ex.top = (int)top;
+        ex.bottom = (int)bottom;
+    }
+    if ((flags & EX_BANG) && at < text.size() && text[at] == '!') {
+        ex.bang = true;
+        at++;
+    }
+    while (at < text.size() && text[at] == ' ') at++;
+    ex.arg = text.substr(at);
+    if (!ex.arg.empty() && !(flags & EX_EXTRA)) {
+        editorSetStatusMessage(E, "E488: Trailing characters: %s",
+                               ex.arg.c_str());
+        return false;
+    }
+    return true;
+}
+
+// runs command through the table; a bare range moves to its last row
+void editorExecuteCommand(editorConfig& E, const std::string& command) {
+    editorExCommand ex;
+    if (!editorParseCommand(E, command, ex)) return;
+    if (!ex.name.empty())
+        editorFindCommand(ex.name)->run(E, ex);
+    else if (ex.addresses > 0)
+        editorJumpToLine(E, ex.bottom);
+}
+
+/** input */
+
+// moves count steps at once, h and l cost one iteration per row they cross
+void editorMoveCursor(editorConfig& E, int c, long long count = 1) {
+    switch (c) {
+        case ARROW_LEFT:
+        case 'h':
+            while (count > 0) {
+                if (count <= E.cursor_x) {
+                    E.cursor_x -= (int)count;
+                    break;
+                }
+                count -= E.cursor_x + 1;
+                if (E.cursor_y == 0) {
+                    E.cursor_x = 0;
+                    break;
+                }
+                // to go to end of previous line
+                E.cursor_y--;
+                E.cursor_x = editorRowLen(E, E.cursor_y);
+            }
+            break;
+        case ARROW_RIGHT:
+        case 'l':
+            // one past the end is allowed, one more goes to the next line
+            while (count > 0 && size_t(E.cursor_y) < E.rows.size()) {
+                long long remaining = editorRowLen(E, E.cursor_y) - E.cursor_x;
+                if (count <= remaining) {
+                    E.cursor_x += (int)count;
+                    break;
+                }
+                count -= remaining + 1;
+                E.cursor_y++;
+                E.cursor_x = 0;
+            }
+            break;
+        case ARROW_DOWN:
+        case 'j':
+            E.cursor_y = (int)std::min((long long)E.cursor_y + count,
+                                       (long long)E.rows.size());
+            break;
+        case ARROW_UP:
+        case 'k':
+            E.cursor_y = (int)std::max((long long)E.cursor_y - count, 0LL);
+            break;
+    }
+    // snap to end - done in terms of cursor_x, not rendered_x
+    int row_len = editorRowLen(E, E.cursor_y);
+    if (E.cursor_x > row_len) E.cursor_x = row_len;
+}
+
+// lands where moving from the top or bottom of the screen by a page would
+void editorMovePage(editorConfig& E, int c, long long count = 1) {
+    long long pages = count * E.screen_rows;
+    if (c == PAGE_UP) {
+        E.cursor_y = (int)std::max((long long)E.row_offset - pages, 0LL);
+    } else {
+        long long bottom = E.row_offset + E.screen_rows - 1;
+        E.cursor_y = (int)std::min(bottom + pages, (long long)E.rows.size());
+    }
+    E.cursor_x = std::min(E.cursor_x, editorRowLen(E, E.cursor_y));
+}
+
+// line is 0-based and clamped to the last row
+void editorJumpToLine(editorConfig& E, long long line) {
+    long long last = std::max((long long)E.rows.size() - 1, 0LL);
+    E.cursor_y = (int)std::clamp(line, 0LL, last);
+    E.cursor_x = std::min(E.cursor_x, editorRowLen(E, E.cursor_y));
+}
+
+// the command bar reads an ex command after :, or a pattern after / or ?,
+// starting with text
+void editorStartCommand(editorConfig& E, char prompt,
+                        const std::string& text = "") {
+    E.mode = COMMAND;
+    E.command_prompt = prompt;
+    E.command_buf = text;
+    editorHistory& history = E.history[prompt != ':'];
+    history.at = history.entries.size();
+    editorSetStatusMessage(E, "%c%s", prompt, text.c_str());
+    if (prompt != ':') editorIncrementalStart(E);
+}
+
+// keeps line at the end of history, dropping the oldest past HISTORY_SIZE
+void editorHistoryAdd(editorHistory& history, const std::string& line) {
+    if (line.empty()) return;
+    auto& entries = history.entries;
+    auto it = std::find(entries.begin(), entries.end(), line);
+    if (it != entries.end()) entries.erase(it);
+    entries.push_back(line);
+    if (entries.size() > HISTORY_SIZE) entries.erase(entries.begin());
+}
+
+// Up and Down on the command bar bring back the previous or next entry that
+// starts with what was typed before the first of them, and past the newest
+// what was typed
+void editorHistoryRecall(editorConfig& E, int direction) {
+    editorHistory& history = E.history[E.command_prompt != ':'];
+    const auto& entries = history.entries;
+    if (history.at == entries.size()) history.typed = E.command_buf;
+    size_t at = history.at;
+    do {
+        if (direction < 0 ? at == 0 : at == entries.size()) return;
+        at = direction < 0 ? at - 1 : at + 1;
+    } while (at < entries.size() && entries[at].rfind(history.typed, 0) != 0);
+    history.at = at;
+    E.command_buf = at < entries.size() ? entries[at] : history.typed;
+    editorSetStatusMessage(E, "%c%s", E.command_prompt, E.command_buf.c_str());
+}
+
+void editorListProcessKeypress(editorConfig& E, int c) {
+    long long page = E.screen_rows;
+    switch (c) {
+        case ':':
+            editorStartCommand(E, ':');
+            break;
+        case '\r':
+            editorListClose(E, true);
+            break;
+        case 'q':
+        case '\x1b':
+            editorListClose(E, false);
+            break;
+        case 'j':
+        case ARROW_DOWN:
+            editorListMove(E, 1);
+            break;
+        case 'k':
+        case ARROW_UP:
+            editorListMove(E, -1);
+            break;
+        case PAGE_DOWN:
+            editorListMove(E, page);
+            break;
+        case PAGE_UP:
+            editorListMove(E, -page);
+            break;
+        case 'g':
+        case HOME_KEY:
+            editorListMove(E, LLONG_MIN / 2);
+            break;
+        case 'G':
+        case END_KEY:
+            editorListMove(E, LLONG_MAX / 2);
+            break;
+    }
+}
+
+void editorHexProcessKeypress(editorConfig& E, int c) {
+    long long row = HEX_BYTES_PER_ROW;
+    long long page = row * E.screen_rows;
+    if (E.mode == INSERT && c < 128 && isxdigit(c)) {
+        editorHexOverwriteNibble(
+            E, isdigit(c) ? c - '0' : tolower(c) - 'a' + 10);
+        return;
+    }
+    if (E.mode == NORMAL) {
+        switch (c) {
+            case 'i':
+                E.mode = INSERT;
+                return;
+            case ':':
+                editorStartCommand(E, ':');
+                return;
+            case 'G':
+                editorHexMoveCursor(E, (long long)E.hex.size);
+                return;
+            case 'h':
+                c = ARROW_LEFT;
+                break;
+            case 'j':
+                c = ARROW_DOWN;
+                break;
+            case 'k':
+                c = ARROW_UP;
+                break;
+            case 'l':
+                c = ARROW_RIGHT;
+                break;
+            case '0':
+                c = HOME_KEY;
+                break;
+            case '$':
+                c = END_KEY;
+                break;
+        }
+    }
+    long long column = (long long)(E.hex.cursor % HEX_BYTES_PER_ROW);
+    switch (c) {
+        case '\x1b':
+            E.mode = NORMAL;
+            E.hex.low_nibble = false;
+            break;
+        case ARROW_LEFT:
+        case BACKSPACE:
+        case CTRL_KEY('h'):
+            editorHexMoveCursor(E, -1);
+            break;
+        case ARROW_RIGHT:
+            editorHexMoveCursor(E, 1);
+            break;
+        case ARROW_UP:
+            editorHexMoveCursor(E, -row);
+            break;
+        case ARROW_DOWN:
+            editorHexMoveCursor(E, row);
+            break;
+        case PAGE_UP:
+            editorHexMoveCursor(E, -page);
+            break;
+        case PAGE_DOWN:
+            editorHexMoveCursor(E, page);
+            break;
+        case HOME_KEY:
+            editorHexMoveCursor(E, -column);
+            break;
+        case END_KEY:
+            editorHexMoveCursor(E, row - 1 - column);
+            break;
+    }
+}
+
+// moves the cursor as motion key c does, g tells whether it was prefixed by
+// g; count is 0 when none was typed
+int editorMotion(editorConfig& E, int c, bool g, long long count) {
+    long long n = std::max(count, 1LL);
+    if (g) {
+        if (c != 'g') return MOTION_NONE;
+        editorJumpToLine(E, count - 1);
+        return MOTION_LINEWISE;
+    }
+    switch (c) {
+        case '\r':
+            editorMoveCursor(E, ARROW_DOWN, n);
+            E.cursor_x = 0;
+            return MOTION_LINEWISE;
+        case HOME_KEY:
+        case '0':
+            E.cursor_x = 0;
+            return MOTION_EXCLUSIVE;
+        case END_KEY:
+        case '$':  // the cursor may sit past the last char
+            editorMoveCursor(E, ARROW_DOWN, n - 1);
+            E.cursor_x = editorRowLen(E, E.cursor_y);
+            return MOTION_EXCLUSIVE;
+        case BACKSPACE:
+        case CTRL_KEY('h'):
+            editorMoveCursor(E, ARROW_LEFT, n);
+            return MOTION_EXCLUSIVE;
+        case ARROW_LEFT:
+        case ARROW_RIGHT:
+        case 'h':
+        case 'l':
+            editorMoveCursor(E, c, n);
+            return MOTION_EXCLUSIVE;
+        case ARROW_DOWN:
+        case ARROW_UP:
+        case 'j':
+        case 'k':
+            editorMoveCursor(E, c, n);
+            return MOTION_LINEWISE;
+        case PAGE_UP:
+        case PAGE_DOWN:
+            editorMovePage(E, c, n);
+            return MOTION_LINEWISE;
+        case 'G':
+            if (count > 0)
+                editorJumpToLine(E, count - 1);
+            else
+                editorMoveCursor(E, ARROW_DOWN, (long long)E.rows.size());
+            return MOTION_LINEWISE;
+        case 'w':
+        case 'W':
+            while (n-- > 0)
+                editorWordForward(E, E.cursor_y, E.cursor_x, c == 'W');
+            return MOTION_EXCLUSIVE;
+        case 'b':
+        case 'B':
+            while (n-- > 0)
+                editorWordBackward(E, E.cursor_y, E.cursor_x, c == 'B');
+            return MOTION_EXCLUSIVE;
+        case 'e':
+        case 'E':
+            while (n-- > 0) editorWordEnd(E, E.cursor_y, E.cursor_x, c == 'E');
+            return MOTION_INCLUSIVE;
+        case 'n':
+        case 'N':
+            return editorSearch(E, c == 'N', n) ? MOTION_EXCLUSIVE
+                                                : MOTION_NONE;
+    }
+    return MOTION_NONE;
+}
+
+// applies operator op (d, y, c, > and < to shift, ~, u and U to change case)
+// to the text between the cursor (y, x) and where a motion of the given kind
+// went (ty, tx); a range of rows is one splice
+void editorOperate(editorConfig& E, char op, char reg, int kind, int y, int x,
+                   int ty, int tx, long long shifts) {
+    if (E.rows.empty()) return;
+    bool shift = op == '>' || op == '<';
+    bool change_case = op == '~' || op == 'u' || op == 'U';
+    if (shift) kind = MOTION_LINEWISE;
+    if (kind == MOTION_LINEWISE) {
+        int top = std::min(y, ty);
+        int bottom = std::min(std::max(y, ty), (int)E.rows.size() - 1);
+        if (top > bottom) return;
+        size_t lines = size_t(bottom - top + 1);
+        if (shift || change_case) {
+            std::vector<std::string> rows;
+            rows.reserve(lines);
+            for (int i = top; i <= bottom; ++i) {
+                rows.push_back(E.rows[size_t(i)].raw_row);
+                if (shift)
+                    editorShiftRow(rows.back(), op == '>' ? shifts : -shifts);
+                else
+                    editorChangeCase(rows.back(), 0, rows.back().size(), op);
+            }
+            editorReplaceRows(E, top, lines, std::move(rows));
+            E.cursor_y = top;
+            E.cursor_x = 0;
+            if (shift) {
+                E.cursor_x = (int)editorSkipClass(E.rows[size_t(top)].raw_row,
+                                                  0, CLASS_BLANK, false);
+                if (lines > 2)
+                    editorSetStatusMessage(E, "%zu lines %ced %lld time%s",
+                                           lines, op, shifts,
+                                           shifts > 1 ? "s" : "");
+            }
+            return;
+        }
+        std::vector<std::string> text;
+        text.reserve(lines);
+        for (int i = top; i <= bottom; ++i)
+            text.push_back(E.rows[size_t(i)].raw_row);
+        editorSetRegister(E, reg, std::move(text), true, op == 'y');
+        if (op == 'd')
+            editorReplaceRows(E, top, lines, {});
+        else if (op == 'c')
+            editorReplaceRows(E, top, lines, {""});
+        E.cursor_y = top;
+        E.cursor_x = 0;
+        editorClampCursor(E);
+        if (lines > 2)
+            editorSetStatusMessage(E, op == 'y' ? "%zu lines yanked"
+                                             : "%zu fewer lines",
+                                   op == 'c' ? lines - 1 : lines);
+    } else {
+        if (ty < y || (ty == y && tx < x)) {
+            std::swap(y, ty);
+            std::swap(x, tx);
+        }
+        if (kind == MOTION_INCLUSIVE && tx < editorRowLen(E, ty)) tx++;
+        if (y >= (int)E.rows.size()) return;
+        if (ty >= (int)E.rows.size()) {
+            ty = (int)E.rows.size() - 1;
+            tx = editorRowLen(E, ty);
+        }
+        E.cursor_y = y;
+        E.cursor_x = x;
+        if (change_case) {
+            editorChangeCaseText(E, y, x, ty, tx, op);
+            return;
+        }
+        auto text = op == 'y' ? editorGetText(E, y, x, ty, tx)
+                              : editorDeleteText(E, y, x, ty, tx);
+        editorSetRegister(E, reg, std::move(text), false, op == 'y');
+    }
+    if (op == 'c') E.mode = INSERT;
+}
+
+/** visual mode */
+
+bool editorIsVisual(editorConfig& E) {
+    return E.mode == VISUAL || E.mode == VISUAL_LINE || E.mode == VISUAL_BLOCK;
+}
+
+void editorStartVisual(editorConfig& E, int mode) {
+    E.visual_y = E.cursor_y;
+    E.visual_x = E.cursor_x;
+    E.mode = mode;
+}
+
+// '< and '> are the ends of the selection, as visual mode last had it
+void editorSetVisualMarks(editorConfig& E) {
+    bool forward = E.visual_y < E.cursor_y ||
+                   (E.visual_y == E.cursor_y && E.visual_x <= E.cursor_x);
+    editorSetMark(E, '<', forward ? E.visual_y : E.cursor_y,
+                  forward ? E.visual_x : E.cursor_x);
+    editorSetMark(E, '>', forward ? E.cursor_y : E.visual_y,
+                  forward ? E.cursor_x : E.visual_x);
+}
+
+// the rendered column just past the char at x in row y
+int editorColumnAfter(editorConfig& E, int y, int x) {
+    if (y >= (int)E.rows.size()) return 1;
+    editorRow& row = E.rows[size_t(y)];
+    if (x >= (int)row.raw_row.size())
+        return editorComputeRenderedX(E, row, x) + 1;
+    return editorComputeRenderedX(E, row, x + 1);
+}
+
+// the rendered columns [left, right) of a visual block
+void editorVisualBlock(editorConfig& E, int& left, int& right) {
+    left = right = 0;
+    int columns[2] = {0, 0};
+    int ys[2] = {E.visual_y, E.cursor_y}, xs[2] = {E.visual_x, E.cursor_x};
+    for (int i = 0; i < 2; ++i)
+        if (ys[i] < (int)E.rows.size())
+            columns[i] = editorComputeRenderedX(E, E.rows[size_t(ys[i])],
+                                                xs[i]);
+    left = std::min(columns[0], columns[1]);
+    right = std::max(editorColumnAfter(E, ys[0], xs[0]),
+                     editorColumnAfter(E, ys[1], xs[1]));
+}
+
+// the rendered columns [from, to) of row y that are selected, drawn over the
+// row's own highlighting
+bool editorVisualColumns(editorConfig& E, int y, int& from, int& to) {
+    int y1 = E.visual_y, x1 = E.visual_x, y2 = E.cursor_y, x2 = E.cursor_x;
+    if (std::tie(y2, x2) < std::tie(y1, x1)) {
+        std::swap(y1, y2);
+        std::swap(x1, x2);
+    }
+    if (y < y1 || y > y2 || y >= (int)E.rows.size()) return false;
+    from = 0;
+    to = INT_MAX;
+    if (E.mode == VISUAL_BLOCK)
+        editorVisualBlock(E, from, to);
+    else if (E.mode == VISUAL) {
+        if (y == y1) from = editorComputeRenderedX(E, E.rows[size_t(y)], x1);
+        if (y == y2) to = editorColumnAfter(E, y, x2);
+    }
+    return true;
+}
+
+// d, y, c and the case changes over a block each make one splice of the
+// selected rows
+void editorBlockOperate(editorConfig& E, char op, char reg) {
+    int top = std::min(E.visual_y, E.cursor_y);
+    int bottom = std::min(std::max(E.visual_y, E.cursor_y),
+                          (int)E.rows.size() - 1);
+    if (top > bottom) return;
+    int left, right;
+    editorVisualBlock(E, left, right);
+    std::vector<std::string> text, rows;
+    text.reserve(size_t(bottom - top + 1));
+    if (op != 'y') rows.reserve(size_t(bottom - top + 1));
+    for (int y = top; y <= bottom; ++y) {
+        editorRow& row = E.rows[size_t(y)];
+        size_t x1 = size_t(editorComputeCursorX(E, row, left));
+        size_t x2 = size_t(editorComputeCursorX(E, row, right));
+        text.push_back(row.raw_row.substr(x1, x2 - x1));
+        if (op == 'y') continue;
+        rows.push_back(row.raw_row);
+        if (op == 'd' || op == 'c')
+            rows.back().erase(x1, x2 - x1);
+        else
+            editorChangeCase(rows.back(), x1, x2, op);
+    }
+    if (op == 'd' || op == 'c' || op == 'y')
+        editorSetRegister(E, reg, std::move(text), false, op == 'y', true);
+    if (op != 'y')
+        editorReplaceRows(E, top, size_t(bottom - top + 1), std::move(rows));
+    E.cursor_y = top;
+    E.cursor_x = editorComputeCursorX(E, E.rows[size_t(top)], left);
+    if (op == 'c') {
+        E.block_insert = {true, top, bottom, left, E.cursor_x,
+                          editorRowLen(E, top), false};
+        E.mode = INSERT;
+    }
+}
+
+// I and A in a block start typing at its left or right edge of the top row
+void editorBlockInsertStart(editorConfig& E, bool append) {
+    int top = std::min(E.visual_y, E.cursor_y);
+    int bottom = std::max(E.visual_y, E.cursor_y);
+    int left, right;
+    editorVisualBlock(E, left, right);
+    int column = append ? right : left;
+    if (top == (int)E.rows.size()) editorInsertRow(E, top, "");
+    editorRow& row = E.rows[size_t(top)];
+    int end = editorComputeRenderedX(E, row, (int)row.raw_row.size());
+    if (append && end < column)
+        editorReplaceInRow(E, top, (int)row.raw_row.size(), 0,
+                           std::string(size_t(column - end), ' '));
+    E.cursor_y = top;
+    E.cursor_x = editorComputeCursorX(E, E.rows[size_t(top)], column);
+    E.block_insert = {true, top, bottom, column, E.cursor_x,
+                      editorRowLen(E, top), append};
+    E.mode = INSERT;
+}
+
+// copies what was typed into the top row of a block to the rows below it, all
+// in one splice
+void editorBlockInsertFinish(editorConfig& E) {
+    editorBlockInsert block = E.block_insert;
+    E.block_insert.active = false;
+    int added = editorRowLen(E, block.top) - block.length;
+    if (E.cursor_y != block.top || added <= 0 || block.top >= block.bottom)
+        return;
+    std::string text = E.rows[size_t(block.top)].raw_row.substr(
+        size_t(block.x), size_t(added));
+    int bottom = std::min(block.bottom, (int)E.rows.size() - 1);
+    std::vector<std::string> rows;
+    rows.reserve(size_t(bottom - block.top));
+    for (int y = block.top + 1; y <= bottom; ++y) {
+        editorRow& row = E.rows[size_t(y)];
+        rows.push_back(row.raw_row);
+        int end = editorComputeRenderedX(E, row, (int)row.raw_row.size());
+        size_t x = size_t(editorComputeCursorX(E, row, block.column));
+        if (end < block.column) {
+            // short rows are left alone unless appending, when the text
+            // goes after the blanks that reach the column
+            if (!block.append) continue;
+            rows.back().append(size_t(block.column - end), ' ');
+            x = rows.back().size();
+        }
+        rows.back().insert(std::min(x, rows.back().size()), text);
+    }
+    editorReplaceRows(E, block.top + 1, size_t(bottom - block.top),
+                      std::move(rows));
+    E.cursor_x = block.x;
+}
+
+void editorProcessVisualKey(editorConfig& E, int c) {
+    std::string typed = E.normal_buf;
+    if ((c == BACKSPACE || c == CTRL_KEY('h')) && !typed.empty()) {
+        E.normal_buf.pop_back();
+        return;
+    }
+    E.normal_buf = "";
+    size_t i = 0;
+    char reg = '"';
+    if (!typed.empty() && typed[0] == '"') {
+        if (typed.size() == 1) {
+            if (c < 128 && (isalnum(c) || c == '"' || c == '_'))
+                E.normal_buf = typed + (char)c;
+            return;
+        }
+        reg = typed[1];
+        i = 2;
+    }
+    size_t count_from = i;
+    while (i < typed.size() && isdigit(typed[i])) i++;
+    long long count = i > count_from ? atoll(&typed[count_from]) : 0;
+    long long n = std::max(count, 1LL);
+    char prefix = i < typed.size() ? typed[i] : 0;
+    size_t digits = i - count_from;
+    if (!prefix && c < 128 && isdigit(c) && (c != '0' || digits > 0)) {
+        E.normal_buf = digits < 9 ? typed + (char)c : typed;
+        return;
+    }
+    if (!prefix && (c == 'g' || c == 'i' || c == 'a')) {
+        E.normal_buf = typed + (char)c;
+        return;
+    }
+    if (prefix == 'i' || prefix == 'a') {
+        int y1, x1, y2, x2;
+        if (editorTextObject(E, c, prefix == 'a', n, y1, x1, y2, x2) &&
+            (y1 < y2 || x1 < x2)) {
+            E.visual_y = y1;
+            E.visual_x = x1;
+            E.cursor_y = x2 > 0 ? y2 : y2 - 1;
+            E.cursor_x = x2 > 0 ? x2 - 1 : editorRowLen(E, E.cursor_y);
+        }
+        return;
+    }
+    if (editorMotion(E, c, prefix == 'g', count) != MOTION_NONE) return;
+
+    int mode = E.mode;
+    char op = 0;
+    bool linewise = false;
+    switch (c) {
+        case '\x1b':
+            E.mode = NORMAL;
+            return;
+        case 'v':
+        case 'V':
+        case CTRL_KEY('v'): {
+            int target = c == 'v' ? VISUAL : c == 'V' ? VISUAL_LINE
+                                                      : VISUAL_BLOCK;
+            E.mode = target == mode ? NORMAL : target;
+            return;
+        }
+        case 'o':
+            std::swap(E.visual_y, E.cursor_y);
+            std::swap(E.visual_x, E.cursor_x);
+            return;
+        case ':':
+            editorStartCommand(E, ':', "'<,'>");
+            return;
+        case 'I':
+        case 'A':
+            if (mode == VISUAL_BLOCK) editorBlockInsertStart(E, c == 'A');
+            return;
+        case 'd':
+        case 'x':
+        case DEL_KEY:
+            op = 'd';
+            break;
+        case 'y':
+            op = 'y';
+            break;
+        case 'c':
+        case 's':
+            op = 'c';
+            break;
+        case 'D':
+        case 'X':
+            op = 'd', linewise = true;
+            break;
+        case 'Y':
+            op = 'y', linewise = true;
+            break;
+        case 'C':
+        case 'S':
+        case 'R':
+            op = 'c', linewise = true;
+            break;
+        case '>':
+        case '<':
+        case '~':
+        case 'u':
+        case 'U':
+            op = (char)c;
+            break;
+        default:
+            return;
+    }
+    E.mode = NORMAL;
+    if (mode == VISUAL_BLOCK && !linewise && op != '>' && op != '<') {
+        editorBlockOperate(E, op, reg);
+        return;
+    }
+    int kind = mode == VISUAL_LINE || linewise ? MOTION_LINEWISE
+                                               : MOTION_INCLUSIVE;
+    editorOperate(E, op, reg, kind, E.visual_y, E.visual_x, E.cursor_y,
+                  E.cursor_x, n);
+}
+
+// normal_buf holds the keys of a command typed so far, which has the form
+// ["r] [count] [operator [count]] [g] key
+void editorProcessNormalKey(editorConfig& E, int c) {
+    std::string typed = E.normal_buf;
+    if ((c == BACKSPACE || c == CTRL_KEY('h')) && !typed.empty()) {
+        E.normal_buf.pop_back();
+        return;
+    }
+    E.normal_buf = "";
+    if (c == '\x1b') return;
+    size_t i = 0;
+    char reg = '"';
+    if (!typed.empty() && typed[0] == '"') {
+        if (typed.size() == 1) {
+            if (c < 128 && (isalnum(c) || c == '"' || c == '_'))
+                E.normal_buf = typed + (char)c;
+            return;
+        }
+        reg = typed[1];
+        i = 2;
+    }
+    size_t count_from = i;
+    while (i < typed.size() && isdigit(typed[i])) i++;
+    long long count = i > count_from ? atoll(&typed[count_from]) : 0;
+    char op = 0;
+    long long op_count = 0;
+    if (i < typed.size() && strchr("dyc<>", typed[i])) {
+        op = typed[i++];
+        count_from = i;
+        while (i < typed.size() && isdigit(typed[i])) i++;
+        op_count = i > count_from ? atoll(&typed[count_from]) : 0;
+    }
+    // a pending g, m, ', ` or CTRL-W, or i / a starting a text object
+    char prefix = i < typed.size() ? typed[i] : 0;
+    bool g = prefix == 'g';
+    size_t digits = i - count_from;
+    if (!prefix && c < 128 && isdigit(c) && (c != '0' || digits > 0)) {
+        E.normal_buf = digits < 9 ? typed + (char)c : typed;
+        return;
+    }
+    long long total = 0;
+    if (count > 0 || op_count > 0)
+        total = std::max(count, 1LL) * std::max(op_count, 1LL);
+    long long n = std::max(total, 1LL);
+    if (!prefix && (c == 'g' || c == '\'' || c == '`' ||
+                    (!op && (c == 'm' || c == CTRL_KEY('w'))) ||
+                    (op && (c == 'i' || c == 'a')))) {
+        E.normal_buf = typed + (char)c;
+        return;
+    }
+    if (prefix == 'm') {
+        editorSetMark(E, (char)c, E.cursor_y, E.cursor_x);
+        return;
+    }
+    if (prefix == CTRL_KEY('w')) {
+        editorWindowCommand(E, c, total);
+        return;
+    }
+    if (prefix == '\'' || prefix == '`') {
+        // to the mark's row, or with ` to the mark itself
+        int y, x;
+        if (c >= 128 || !editorGetMark(E, (char)c, y, x)) return;
+        bool linewise = prefix == '\'';
+        if (linewise && y < (int)E.rows.size())
+            x = (int)editorSkipClass(E.rows[size_t(y)].raw_row, 0, CLASS_BLANK,
+                                     false);
+        if (op) {
+            editorOperate(E, op, reg,
+                          linewise ? MOTION_LINEWISE : MOTION_EXCLUSIVE,
+                          E.cursor_y, E.cursor_x, y, x);
+        } else {
+            E.cursor_y = y;
+            E.cursor_x = x;
+        }
+        return;
+    }
+
+    if (op && (prefix == 'i' || prefix == 'a')) {
+        int y1, x1, y2, x2;
+        if (editorTextObject(E, c, prefix == 'a', n, y1, x1, y2, x2))
+            editorOperate(E, op, reg, MOTION_EXCLUSIVE, y1, x1, y2, x2);
+        return;
+    }
+    if (op) {
+        int y = E.cursor_y, x = E.cursor_x;
+        int kind = MOTION_LINEWISE;
+        if (!g && c == op) {
+            editorMoveCursor(E, ARROW_DOWN, n - 1);
+        } else if (op == 'c' && (c == 'w' || c == 'W') &&
+                   x < editorRowLen(E, y) &&
+                   editorCharClass(E.rows[size_t(y)].raw_row[size_t(x)],
+                                   false) != CLASS_BLANK) {
+            // cw changes up to the end of the word, like ce
+            E.cursor_x--;
+            kind = editorMotion(E, c == 'w' ? 'e' : 'E', false, total);
+        } else {
+            kind = editorMotion(E, c, g, total);
+        }
+        int ty = E.cursor_y, tx = E.cursor_x;
+        E.cursor_y = y;
+        E.cursor_x = x;
+        // an exclusive motion ending at the start of a later row stops at
+        // the end of the row before it
+        if (kind == MOTION_EXCLUSIVE && tx == 0 && ty > y)
+            tx = editorRowLen(E, --ty);
+        if (kind != MOTION_NONE) editorOperate(E, op, reg, kind, y, x, ty, tx);
+        return;
+    }
+    if (g) {
+        if (c == '-' || c == '+')
+            editorUndoStep(E, c == '-' ? -n : n);
+        else
+            editorMotion(E, c, true, total);
+        return;
+    }
+    if (editorMotion(E, c, false, total) != MOTION_NONE) return;
+    // shorthands for an operator and a motion
+    const char* expansion = NULL;
+    switch (c) {
+        case 'x':
+            expansion = "dl";
+            break;
+        case 'X':
+            expansion = "dh";
+            break;
+        case 'D':
+            expansion = "d$";
+            break;
+        case 'C':
+            expansion = "c$";
+            break;
+        case 's':
+            expansion = "cl";
+            break;
+        case 'Y':
+            expansion = "yy";
+            break;
+    }
+    if (expansion) {
+        E.normal_buf = typed + expansion[0];
+        editorProcessNormalKey(E, expansion[1]);
+        return;
+    }
+    switch (c) {
+        case 'd':
+        case 'y':
+        case 'c':
+        case '>':
+        case '<':
+            E.normal_buf = typed + (char)c;
+            break;
+        case 'v':
+            editorStartVisual(E, VISUAL);
+            break;
+        case 'V':
+            editorStartVisual(E, VISUAL_LINE);
+            break;
+        case CTRL_KEY('v'):
+            editorStartVisual(E, VISUAL_BLOCK);
+            break;
+        case '"':
+            if (typed.empty()) E.normal_buf = "\"";
+            break;
+        case 'p':
+        case 'P':
+            editorPut(E, reg, n, c == 'p');
+            break;
+        case 'u':
+            while (n-- > 0 && editorUndo(E)) {
+            }
+            break;
+        case CTRL_KEY('r'):
+            while (n-- > 0 && editorRedo(E)) {
+            }
+            break;
+        case 'i':
+            E.mode = INSERT;
+            break;
+        case ':': {
+            // a count gives the range of that many rows
+            std::string range;
+            if (total == 1) range = ".";
+            if (total > 1) range = ".,.+" + std::to_string(total - 1);
+            editorStartCommand(E, ':', range);
+            break;
+        }
+        case '/':
+        case '?':
+            editorStartCommand(E, (char)c);
+            break;
+        case CTRL_KEY('l'):
+            break;
+    }
+}
+
+void editorProcessKey(editorConfig& E, int c) {
+    if (E.list.active && E.mode != COMMAND) {
+        editorListProcessKeypress(E, c);
+        return;
+    }
+    if (E.hex.active && E.mode != COMMAND) {
+        editorHexProcessKeypress(E, c);
+        return;
+    }
+    if (E.mode == INSERT) {
+        switch (c) {
+            case '\x1b':
+                E.mode = NORMAL;
+                if (E.block_insert.active) editorBlockInsertFinish(E);
+                break;
+            case '\r':
+                editorInsertNewline(E);
+                break;
+            case HOME_KEY:
+                E.cursor_x = 0;
+                break;
+            case END_KEY:
+                if (E.cursor_y < (int)E.rows.size())
+                    E.cursor_x = (int)E.rows[size_t(E.cursor_y)].raw_row.size();
+                break;
+            case BACKSPACE:
+            case CTRL_KEY('h'):
+            case DEL_KEY:
+                if (c == DEL_KEY) editorMoveCursor(E, ARROW_RIGHT);
+                editorDelChar(E);
+                break;
+            case PAGE_UP:
+            case PAGE_DOWN:
+                editorMovePage(E, c);
+                break;
+            case ARROW_LEFT:
+            case ARROW_DOWN:
+            case ARROW_UP:
+            case ARROW_RIGHT:
+                editorMoveCursor(E, c);
+                break;
+            case CTRL_KEY('l'):
+                break;
+            case '\t':
+                if (E.expandtab) {
+                    int column = 0;
+                    if (E.cursor_y < (int)E.rows.size())
+                        column = editorComputeRenderedX(
+                            E, E.rows[size_t(E.cursor_y)], E.cursor_x);
+                    for (int i = column % TAB_STOP; i < TAB_STOP; ++i)
+                        editorInsertChar(E, ' ');
+                } else {
+                    editorInsertChar(E, c);
+                }
+                break;
+            default:
+                editorInsertChar(E, c);
+                break;
+        }
+    } else if (E.mode == NORMAL) {
+        editorProcessNormalKey(E, c);
+    } else if (editorIsVisual(E)) {
+        editorSetVisualMarks(E);
+        editorProcessVisualKey(E, c);
+    } else if (E.mode == COMMAND) {
+        switch (c) {
+            case '\r':
+                E.mode = NORMAL;
+                editorHistoryAdd(E.history[E.command_prompt != ':'],
+                                 E.command_buf);
+                // the command may run keys that type another one
+                if (E.command_prompt == ':')
+                    editorExecuteCommand(E, std::string(E.command_buf));
+                else
+                    editorSearchCommand(E);
+                E.command_buf = "";
+                break;
+            case '\x1b':
+                E.command_buf = "";
+                E.mode = NORMAL;
+                editorSetStatusMessage(E, "");
+                break;
+            case BACKSPACE:
+                if (!E.command_buf.empty())
+                    E.command_buf.pop_back(),
+                        editorSetStatusMessage(E, "%c%s", E.command_prompt,
+                                               E.command_buf.c_str());
+                else
+                    E.mode = NORMAL, editorSetStatusMessage(E, "");
+                break;
+            case ARROW_UP:
+            case ARROW_DOWN:
+                editorHistoryRecall(E, c == ARROW_UP ? -1 : 1);
+                break;
+            default:
+                E.command_buf.push_back((char)c);
+                editorSetStatusMessage(E, "%c%s", E.command_prompt,
+                                       E.command_buf.c_str());
+                break;
+        }
+        if (E.command_prompt == ':') return;
+        if (E.mode == COMMAND) {
+            editorIncrementalSearch(E);
+        } else if (c != '\r') {
+            editorIncrementalRestore(E);
+            E.incsearch.levels.clear();
+        }
+    }
+}
+
+// every key typed in normal or visual mode starts a new undo step, unlike
+// those run by :normal
+void editorTypeKey(editorConfig& E, int c) {
+    if (!E.list.active && !E.hex.active &&
+        (E.mode == NORMAL || editorIsVisual(E)))
+        editorUndoBreak(E);
+    editorProcessKey(E, c);
+}
+
+void editorProcessKeypress(editorConfig& E) {
+    int c = editorReadKey(E);
+    if (E.error == 0) editorTypeKey(E, c);
+}
+
+/** output */
+
+void editorScroll(editorConfig& E) {
+    if (E.list.active) {
+        auto& list = E.list;
+        if (list.selected < list.row_offset) list.row_offset = list.selected;
+        if (list.selected >= list.row_offset + size_t(E.screen_rows))
+            list.row_offset = list.selected - size_t(E.screen_rows) + 1;
+        return;
+    }
+    if (E.hex.active) {
+        size_t cursor_row = E.hex.cursor / HEX_BYTES_PER_ROW;
+        if (cursor_row < E.hex.row_offset) E.hex.row_offset = cursor_row;
+        if (cursor_row >= E.hex.row_offset + size_t(E.screen_rows))
+            E.hex.row_offset = cursor_row - size_t(E.screen_rows) + 1;
+        return;
+    }
+    E.rendered_x = 0;
+    if (E.cursor_y < (int)E.rows.size())
+        E.rendered_x =
+            editorComputeRenderedX(E, E.rows[size_t(E.cursor_y)], E.cursor_x);
+    if (E.cursor_y < E.row_offset) E.row_offset = E.cursor_y;
+    if (E.cursor_y >= E.row_offset + E.screen_rows)
+        E.row_offset = E.cursor_y - E.screen_rows + 1;
+    if (E.rendered_x < E.col_offset) E.col_offset = E.rendered_x;
+    if (E.rendered_x >= E.col_offset + E.screen_cols)
+        E.col_offset = E.rendered_x - E.screen_cols + 1;
+}
+
+void editorDrawHighlighted(std::string& s, const char* c, const char* hl,
+                           int len, bool selected = false) {
+    int current_color = -1;
+    if (selected) s += "\x1b[7m";
+    for (int j = 0; j < len; ++j) {
+        if (iscntrl((unsigned char)c[j])) {
+            // control bytes are shown inverted instead of being sent raw
+            s += selected ? "\x1b[27m" : "\x1b[7m";
+            s += (unsigned char)c[j] < 32 ? char('@' + c[j]) : '?';
+            s += selected ? "\x1b[m\x1b[7m" : "\x1b[m";
+            current_color = -2;  // attributes were reset
+            continue;
+        }
+        int color = hl[j] == HIGHLIGHT_NORMAL ? -1 : editorSyntaxToColor(hl[j]);
+        if (color != current_color) {
+            // backgrounds go with black text and are reset on the way out
+            if (current_color >= 40) s += "\x1b[49m";
+            current_color = color;
+            char buf[16];
+            std::ignore = snprintf(buf, sizeof(buf),
+                                   color < 0    ? "\x1b[39m"
+                                   : color < 40 ? "\x1b[%dm"
+                                                : "\x1b[30;%dm",
+                                   color);
+            s += buf;
+        }
+        s += c[j];
+    }
+    s += selected ? "\x1b[39;49;27m" : "\x1b[39;49m";
+}
+
+// hl with the search matches among the len columns from rendered column from
+// marked, copied to overlay if there are any; long rows are only searched
+// around what is on screen
+const char* editorSearchOverlay(editorConfig& E, editorRow& row, int from,
+                                int len, const char* hl, std::string& overlay) {
+    auto re = editorHighlightRegex(E);
+    if (!re || len <= 0) return hl;
+    const std::string& raw = row.raw_row;
+    std::vector<int> window;
+    const std::vector<int>* matches = &window;
+    if (editorIsLongRow(row)) {
+        size_t begin = size_t(editorComputeCursorX(E, row, from));
+        size_t end = size_t(editorComputeCursorX(E, row, from + len));
+        size_t at = begin > ROW_SEGMENT_SIZE ? begin - ROW_SEGMENT_SIZE : 0;
+        for (size_t stop; at <= end; at = std::max(stop, at + 1)) {
+            if ((at = editorRegexFind(*re, raw, at, &stop)) > end) break;
+            window.push_back((int)at);
+            window.push_back((int)stop);
+        }
+    } else {
+        matches = &editorRowMatches(E, row, *re);
+    }
+    // rendered columns are worked out going along the row once
+    size_t pos = 0;
+    int rendered_x = -1;
+    auto advance = [&](size_t to) {
+        if (rendered_x < 0) {
+            rendered_x = editorComputeRenderedX(E, row, (int)to);
+            pos = to;
+        }
+        for (; pos < to; ++pos)
+            rendered_x += raw[pos] == '\t' ? TAB_STOP - rendered_x % TAB_STOP
+                                            : 1;
+        return rendered_x - from;
+    };
+    for (size_t i = 0; i + 1 < matches->size(); i += 2) {
+        size_t start = size_t((*matches)[i]), stop = size_t((*matches)[i + 1]);
+        if (start == stop) continue;
+        int a = advance(start);
+        if (a >= len) break;
+        int b = std::min(advance(stop), len);
+        if (b <= 0) continue;
+        if (overlay.empty()) overlay.assign(hl, size_t(len));
+        for (int k = std::max(a, 0); k < b; ++k)
+            overlay[size_t(k)] = HIGHLIGHT_MATCH;
+    }
+    return overlay.empty() ? hl : overlay.data();
+}
+
+// moves to row y of window's text and clears it, as far as the window goes
+void editorStartLine(std::string& s, const editorWindow& window, int y) {
+    s += "\x1b[" + std::to_string(window.top + y + 1) + ";" +
+         std::to_string(window.left + 1) + "H";
+    s += window.edge ? "\x1b[K" : "\x1b[" + std::to_string(window.cols) + "X";
+}
+
+// the rows of buffer in window, with the selection when visual
+void editorDrawRows(editorConfig& E, std::string& s, const editorWindow& window,
+                    editorBuffer& buffer, bool visual) {
+    int col_offset = window.col_offset, cols = window.cols;
+    for (int y = 0; y < window.rows; y++) {
+        editorStartLine(s, window, y);
+        int row_number = window.row_offset + y;
+        if (row_number >= (int)buffer.rows.size())
+            s += '~';
+        else {
+            editorRow& row = buffer.rows[size_t(row_number)];
+            size_t at = editorRenderRow(E, row, col_offset, cols);
+            int len = (int)row.rendered_row.size() - (int)at;
+            len = std::clamp(len, 0, cols);
+            const char* chars = row.rendered_row.c_str() + at;
+            std::string overlay;
+            const char* hl = editorSearchOverlay(
+                E, row, col_offset, len, row.highlight_row.c_str() + at,
+                overlay);
+            int from, to;
+            if (visual && editorVisualColumns(E, row_number, from, to)) {
+                // the selection is drawn as a span of its own on top of the
+                // row's highlighting
+                int a = std::clamp(from - col_offset, 0, len);
+                int b = (int)std::clamp((long long)to - col_offset, 0LL,
+                                        (long long)len);
+                editorDrawHighlighted(s, chars, hl, a);
+                editorDrawHighlighted(s, chars + a, hl + a, b - a, true);
+                editorDrawHighlighted(s, chars + b, hl + b, len - b);
+                // a selected line end shows as one more cell
+                if (E.mode != VISUAL_BLOCK && to > col_offset + len &&
+                    len < cols && row.window_at_end &&
+                    size_t(len) + at == row.rendered_row.size())
+                    s += "\x1b[7m \x1b[27m";
+            } else if (len > 0) {
+                editorDrawHighlighted(s, chars, hl, len);
+            }
+        }
+    }
+}
+
+int editorHexCursorColumn(editorConfig& E) {
+    size_t row_start = E.hex.cursor - E.hex.cursor % HEX_BYTES_PER_ROW;
+    int column = snprintf(NULL, 0, "%08zx  ", row_start);
+    int i = int(E.hex.cursor % HEX_BYTES_PER_ROW);
+    return column + 3 * i + (i >= HEX_BYTES_PER_ROW / 2) + E.hex.low_nibble;
+}
+
+// only the rows on screen are formatted, read from the file in one go; a
+// file cut short since it was opened ends early rather than faulting as a
+// mapping of it would
+void editorDrawHexRows(std::string& s, const editorWindow& window,
+                       const editorHexView& hex) {
+    static const char digits[] = "0123456789abcdef";
+    std::string chars, hl, ascii, ascii_hl;
+    size_t first = hex.row_offset * HEX_BYTES_PER_ROW;
+    std::vector<unsigned char> bytes(size_t(window.rows) * HEX_BYTES_PER_ROW);
+    size_t size =
+        first < hex.size
+            ? first + editorHexRead(hex, first, bytes.data(),
+                                    std::min(bytes.size(), hex.size - first))
+            : hex.size;
+    for (int y = 0; y < window.rows; y++) {
+        editorStartLine(s, window, y);
+        size_t start = (hex.row_offset + size_t(y)) * HEX_BYTES_PER_ROW;
+        if (start >= size)
+            s += '~';
+        else {
+            size_t end = std::min(start + HEX_BYTES_PER_ROW, size);
+            char offset[32];
+            std::ignore = snprintf(offset, sizeof(offset), "%08zx  ", start);
+            chars = offset;
+            hl.assign(chars.size(), HIGHLIGHT_HEX_OFFSET);
+            ascii = " |";
+            ascii_hl.assign(ascii.size(), HIGHLIGHT_NORMAL);
+            auto patch = hex.patches.lower_bound(start);
+            for (size_t i = start; i < start + HEX_BYTES_PER_ROW; ++i) {
+                if (i - start == HEX_BYTES_PER_ROW / 2)
+                    chars += ' ', hl += HIGHLIGHT_NORMAL;
+                if (i >= end) {
+                    chars += "   ";
+                    hl.append(3, HIGHLIGHT_NORMAL);
+                    continue;
+                }
+                unsigned char byte = bytes[i - first];
+                char type = HIGHLIGHT_NORMAL;
+                if (patch != hex.patches.end() && patch->first == i) {
+                    byte = (patch++)->second;
+                    type = HIGHLIGHT_HEX_PATCHED;
+                }
+                chars += digits[byte >> 4];
+                chars += digits[byte & 15];
+                chars += ' ';
+                hl.append(2, type);
+                hl += HIGHLIGHT_NORMAL;
+                ascii += isprint(byte) ? char(byte) : '.';
+                ascii_hl += type;
+            }
+            chars += ascii + '|';
+            hl += ascii_hl + char(HIGHLIGHT_NORMAL);
+            int len = std::min((int)chars.size(), window.cols);
+            editorDrawHighlighted(s, chars.data(), hl.data(), len);
+        }
+    }
+}
+
+// each entry shows as line:column: and the row's text
+void editorDrawListRows(editorConfig& E, std::string& s,
+                        const editorWindow& window) {
+    const auto& list = E.list;
+    int width = (int)std::to_string(E.rows.size()).size();
+    std::string chars, hl;
+    for (int y = 0; y < window.rows; y++) {
+        editorStartLine(s, window, y);
+        size_t i = list.row_offset + size_t(y);
+        if (i >= list.entries.size()) {
+            s += '~';
+        } else {
+            const editorListEntry& entry = list.entries[i];
+            bool other_file = entry.file >= 0;
+            chars = other_file
+                        ? editorShortPath(E, list.files[size_t(entry.file)]) +
+                              ':'
+                        : "";
+            char location[48];
+            std::ignore =
+                snprintf(location, sizeof(location), "%*d:%d: ",
+                         other_file ? 0 : width, entry.y + 1, entry.x + 1);
+            chars += location;
+            hl.assign(chars.size() - 1, HIGHLIGHT_LIST_LOCATION);
+            hl += HIGHLIGHT_NORMAL;
+            std::string_view raw = entry.text;
+            if (!other_file && entry.buffer == E.number &&
+                entry.y < (int)E.rows.size())
+                raw = E.rows[size_t(entry.y)].raw_row;
+            raw = raw.substr(0, size_t(window.cols));
+            for (char c : raw) chars += c == '\t' ? ' ' : c;
+            int len = std::min((int)chars.size(), window.cols);
+            hl.resize(size_t(len), HIGHLIGHT_NORMAL);
+            editorDrawHighlighted(s, chars.data(), hl.data(), len,
+                                  i == list.selected);
+        }
+    }
+}
+
+// the line below a window; only the current one's shows the mode
+void editorDrawStatusBar(editorConfig& E, std::string& s,
+                         const editorWindow& window, const editorBuffer& buffer,
+                         bool current) {
+    bool list = current && E.list.active;
+    std::string display_name =
+        list ? E.list.title : editorBufferName(E, buffer);
+    std::string display_status =
+        display_name.substr(size_t(0),
+                            std::min(display_name.size(), size_t(20))) +
+        " - " +
+        (list ? std::to_string(E.list.entries.size()) + " entries"
+         : buffer.hex.active ? std::to_string(buffer.hex.size) + " bytes"
+                             : std::to_string(buffer.rows.size()) + " lines") +
+        " " + (buffer.dirty ? "(modified)" : "");
+    if (current) {
+        display_status += " [";
+        switch (E.mode) {
+            case NORMAL:
+                display_status += list ? "LIST" : "NORMAL";
+                break;
+            case INSERT:
+                display_status += "INSERT";
+                break;
+            case COMMAND:
+                display_status += "COMMAND";
+                break;
+            case VISUAL:
+                display_status += "VISUAL";
+                break;
+            case VISUAL_LINE:
+                display_status += "VISUAL LINE";
+                break;
+            case VISUAL_BLOCK:
+                display_status += "VISUAL BLOCK";
+                break;
+        }
+        display_status += "] ";
+        for (char c : E.normal_buf) {
+            // a pending CTRL-W shows as ^W
+            if (iscntrl((unsigned char)c)) display_status += '^', c += '@';
+            display_status += c;
+        }
+    }
+    size_t width = size_t(window.cols + !window.edge);
+    display_status.resize(width, ' ');
+    auto line_number = std::to_string(window.cursor_y);
+    if (buffer.hex.active) {
+        char offset[32];
+        std::ignore =
+            snprintf(offset, sizeof(offset), "0x%zx", buffer.hex.cursor);
+        line_number = offset;
+    }
+    if (list) line_number = std::to_string(E.list.selected + 1);
+    if (line_number.size() <= width)
+        display_status.replace(width - line_number.size(), line_number.size(),
+                               line_number);
+    s += "\x1b[" + std::to_string(window.top + window.rows + 1) + ";" +
+         std::to_string(window.left + 1) + "H";
+    s += "\x1b[7m";
+    s += display_status;
+    s += "\x1b[m";
+}
+
+void editorDrawCommandBar(editorConfig& E, std::string& s) {
+    s += "\x1b[" + std::to_string(E.total_rows) + ";1H";
+    s += "\x1b[K";
+    s += E.command_bar;
+}
+
+// the text of a window: the list view, the hex view or the rows, and the
+// separator on its right
+void editorDrawWindow(editorConfig& E, std::string& s,
+                      const editorWindow& window, editorBuffer& buffer,
+                      bool current) {
+    if (current && E.list.active) {
+        editorDrawListRows(E, s, window);
+    } else if (buffer.hex.active) {
+        editorDrawHexRows(s, window, buffer.hex);
+    } else {
+        // rows are highlighted with E.syntax, which a window on another
+        // buffer borrows while it is drawn
+        bool other = &buffer != &static_cast<editorBuffer&>(E);
+        if (other) std::swap(E.syntax, buffer.syntax);
+        editorDrawRows(E, s, window, buffer, current && editorIsVisual(E));
+        if (other) std::swap(E.syntax, buffer.syntax);
+    }
+    for (int y = 0; y < window.rows && !window.edge; y++)
+        s += "\x1b[" + std::to_string(window.top + y + 1) + ";" +
+             std::to_string(window.left + window.cols + 1) + "H\x1b[7m|\x1b[m";
+}
+
+// draws the windows whose text changed since they were drawn: they show
+// other rows, other matches or another buffer, their buffer was edited
+// within them, or they hold something drawn afresh each time. Status lines
+// and the command bar are always drawn
+void editorRefreshScreen(editorConfig& E) {
+    editorScroll(E);
+    editorSaveWindow(E);
+    if (E.terminal.output_fd == -1) return;
+    std::string s = "";
+    s += "\x1b[?25l";  // to hide the cursor
+    unsigned highlight = editorHighlightRegex(E) ? E.hlsearch_key + 1 : 0;
+    for (size_t i = 0; i < E.windows.size(); ++i) {
+        editorWindow& window = E.windows[i];
+        editorBuffer& buffer =
+            editorBufferAt(E, editorFindBuffer(E, window.buffer));
+        bool current = i == E.window;
+        bool plain = !buffer.hex.active &&
+                     !(current && (E.list.active || editorIsVisual(E)));
+        int bottom = window.row_offset + window.rows - 1;
+        bool damaged = buffer.damage_top <= bottom &&
+                       buffer.damage_bottom >= window.row_offset;
+        if (E.redraw || damaged || !plain || !window.shown_plain ||
+            window.shown_buffer != buffer.number ||
+            window.shown_row_offset != window.row_offset ||
+            window.shown_col_offset != window.col_offset ||
+            window.shown_highlight != highlight)
+            editorDrawWindow(E, s, window, buffer, current);
+        window.shown_buffer = buffer.number;
+        window.shown_row_offset = window.row_offset;
+        window.shown_col_offset = window.col_offset;
+        window.shown_highlight = highlight;
+        window.shown_plain = plain;
+        editorDrawStatusBar(E, s, window, buffer, current);
+    }
+    for (size_t i = 0; i < E.buffers.size(); ++i) {
+        editorBuffer& buffer = editorBufferAt(E, i);
+        buffer.damage_top = INT_MAX;
+        buffer.damage_bottom = -1;
+    }
+    E.redraw = false;
+    editorDrawCommandBar(E, s);
+    const editorWindow& window = E.windows[E.window];
+    int y = E.cursor_y - E.row_offset, x = E.rendered_x - E.col_offset;
+    if (E.list.active) {
+        y = int(E.list.selected - E.list.row_offset);
+        x = 0;
+    } else if (E.hex.active) {
+        y = int(E.hex.cursor / HEX_BYTES_PER_ROW - E.hex.row_offset);
+        x = editorHexCursorColumn(E);
+    }
+    // to go to a specified position
+    s += "\x1b[" + std::to_string(window.top + y + 1) + ";" +
+         std::to_string(window.left + x + 1) + "H";
+    s += "\x1b[?25h";  // to show the cursor again
+    std::ignore = write(E.terminal.output_fd, s.c_str(), s.size());
+}
+
+void editorSetStatusMessage(editorConfig& E, const char* fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    char buf[80];
+    vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    E.command_bar = buf;
+}
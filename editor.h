@@ -0,0 +1,521 @@
+#ifndef EDITOR_H
+#define EDITOR_H
+
+/** includes */
+
+#include <array>
+#include <atomic>
+#include <bitset>
+#include <climits>
+#include <condition_variable>
+#include <cstdint>
+#include <ctime>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/** defines */
+
+#define TAB_STOP 4
+#define QUIT_TIMES 3
+#define HEX_BYTES_PER_ROW 16
+#define BINARY_SNIFF_BYTES 4096
+#define ROW_SEGMENT_SIZE 4096
+#define LONG_ROW_THRESHOLD (16 * ROW_SEGMENT_SIZE)
+#define HIGHLIGHT_LOOKAHEAD 64
+#define UNDO_DEFAULT_MEGABYTES 64
+#define UNDO_FILE_MAGIC "VINUNDO3"
+#define HASH_SEED 0xcbf29ce484222325ULL
+#define INCSEARCH_SCAN_BYTES (1 << 20)
+#define REGEX_MAX_PROGRAM 20000
+#define REGEX_MAX_DFA_STATES 2000
+#define REGEX_MAX_DFA_FLUSHES 16
+#define REGEX_CACHE_SIZE 64
+#define PARALLEL_CHUNK_ROWS 4096
+#define PARALLEL_REDRAW_MS 50
+#define GREP_TEXT_BYTES 256
+#define GREP_MMAP_BYTES (1 << 20)
+#define GREP_CHUNK_FILES 64
+#define HISTORY_SIZE 100
+#define PIPE_CHUNK_BYTES (1 << 16)
+
+#define CTRL_KEY(k) ((k)&0b00011111)
+
+enum editorKey {
+    BACKSPACE = 127,
+    ARROW_LEFT = 1000,
+    ARROW_RIGHT,
+    ARROW_UP,
+    ARROW_DOWN,
+    PAGE_UP,
+    PAGE_DOWN,
+    HOME_KEY,
+    END_KEY,
+    DEL_KEY
+};
+
+enum editorHighlight {
+    HIGHLIGHT_NORMAL = 0,
+    HIGHLIGHT_KEYWORD1,
+    HIGHLIGHT_KEYWORD2,
+    HIGHLIGHT_COMMENT,
+    HIGHLIGHT_STRING,
+    HIGHLIGHT_NUMBER,
+    HIGHLIGHT_HEX_OFFSET,
+    HIGHLIGHT_HEX_PATCHED,
+    HIGHLIGHT_LIST_LOCATION,
+    HIGHLIGHT_MATCH
+};
+
+#define HL_HIGHLIGHT_NUMBERS (1 << 0)
+#define HL_HIGHLIGHT_STRINGS (1 << 1)
+
+#define EX_RANGE (1 << 0)  // takes a range
+#define EX_WHOLE (1 << 1)  // all rows when none is given
+#define EX_ZERO (1 << 2)   // line 0 means above the first row
+#define EX_BANG (1 << 3)   // takes a ! after the name
+#define EX_EXTRA (1 << 4)  // takes an argument
+
+enum editorMode { NORMAL, COMMAND, INSERT, VISUAL, VISUAL_LINE, VISUAL_BLOCK };
+
+enum editorMotionKind {
+    MOTION_NONE = 0,
+    MOTION_EXCLUSIVE,
+    MOTION_INCLUSIVE,
+    MOTION_LINEWISE
+};
+
+enum editorCharClass { CLASS_BLANK = 0, CLASS_WORD, CLASS_PUNCT };
+
+enum editorRegexOp {
+    RE_CHAR = 0,  // one byte out of set
+    RE_SPLIT,     // go on at x, and at y with less priority
+    RE_JMP,
+    RE_SAVE,      // record the position in capture slot x
+    RE_ASSERT,    // check assertion x between two bytes
+    RE_MATCH
+};
+
+enum editorRegexAssertion {
+    RE_LINE_START = 0,
+    RE_LINE_END,
+    RE_WORD_START,
+    RE_WORD_END
+};
+
+enum editorCompression {
+    COMPRESSION_NONE = 0,
+    COMPRESSION_GZIP,
+    COMPRESSION_ZSTD
+};
+
+/** data */
+
+struct editorSyntax {
+    std::string filetype = "";
+    std::vector<std::string> filematch{};
+    std::vector<std::string> keywords{};
+    std::string singleline_comment_start = "";
+    int flags = 0;
+};
+
+// where rendering and highlighting stand at the start of a row segment
+struct editorSegmentState {
+    int rendered_x = 0;
+    int carry = 0;  // chars of a token from the previous segment to skip
+    char carry_hl = HIGHLIGHT_NORMAL;
+    char in_string = 0;
+    char prev_hl = HIGHLIGHT_NORMAL;
+    bool prev_sep = true;
+    bool in_comment = false;
+};
+
+// rendered_row and highlight_row are built lazily when the row is drawn. For
+// rows longer than LONG_ROW_THRESHOLD they only hold the part on screen, and
+// segments caches the state at every ROW_SEGMENT_SIZE raw bytes up to the
+// furthest point rendered since the last edit
+struct editorRow {
+    std::string raw_row;
+    std::string rendered_row;
+    std::string highlight_row;
+    bool stale = true;  // rendered_row and highlight_row need a rebuild
+    bool marked = false;  // picked by :g, until its command has run here
+    int window_rx = 0;  // rendered x of rendered_row[0]
+    bool window_at_end = true;
+    std::vector<editorSegmentState> segments;
+    unsigned generation = 0;  // bumped by every edit
+    // where the search pattern matches, as start and end pairs, when
+    // matches_key and matches_generation are current
+    std::vector<int> matches;
+    unsigned matches_key = 0;
+    unsigned matches_generation = 0;
+    editorRow() : raw_row(), rendered_row(), highlight_row() {}
+    editorRow(const std::string& _raw_row, const std::string& _rendered_row,
+              const std::string& _highlight_row)
+        : raw_row(_raw_row),
+          rendered_row(_rendered_row),
+          highlight_row(_highlight_row) {}
+};
+
+struct editorHexView {
+    bool active = false;
+    int fd = -1;            // read from as it is drawn, never mapped
+    size_t size = 0;        // as it was when opened
+    size_t cursor = 0;      // offset of the byte under the cursor
+    size_t row_offset = 0;  // first visible row of HEX_BYTES_PER_ROW bytes
+    bool low_nibble = false;
+    std::map<size_t, unsigned char> patches;  // overwritten, not yet saved
+};
+
+// one change swaps a span of the buffer with the text it replaced. While the
+// change is applied the buffer holds present chars (x >= 0, inside row y) or
+// present rows (x == -1, starting at row y) and absent holds what they
+// replaced; undoing or redoing it swaps the two, so only absent is stored.
+// With x == -2 the rows are scattered: lines says where they are when in the
+// buffer, and either all of them are present or absent holds them all. With
+// x == -3 the present rows from y were reordered, row y + i coming from
+// y + lines[i], and applying the op turns lines into its inverse
+struct editorUndoOp {
+    int y = 0;
+    int x = -1;
+    size_t present = 0;
+    std::vector<std::string> absent;
+    std::vector<int> lines;  // ascending, unless x == -3
+};
+
+// the buffer states form a tree: a node holds the ops that turn its parent's
+// state into its own, so versions share everything but their deltas and only
+// the current one is materialized in rows
+struct editorUndoNode {
+    std::vector<editorUndoOp> ops;
+    size_t parent = 0;
+    size_t redo_child = 0;  // child last undone from, 0 when none
+    bool alive = true;      // false once pruned
+    int cursor_x = 0;       // cursor before the change
+    int cursor_y = 0;
+    time_t time = 0;
+};
+
+struct editorUndoTree {
+    std::deque<editorUndoNode> nodes = std::deque<editorUndoNode>(1);
+    size_t first = 0;    // sequence number of nodes[0]
+    size_t root = 0;     // oldest state that can still be reached
+    size_t current = 0;  // state the buffer is in
+    size_t saved = 0;    // state last written to disk
+    size_t bytes = 0;
+    size_t max_bytes = size_t(UNDO_DEFAULT_MEGABYTES) << 20;
+    bool group_open = false;  // ops are added to the current node
+    bool file_checked = false;  // the history file was looked for
+};
+
+// a position set with m, or the start or end of the last visual selection,
+// kept on its row as rows around it come and go
+struct editorMark {
+    int y = 0, x = 0;
+};
+
+// an ex command taken apart
+struct editorExCommand {
+    std::string text;  // as typed, for messages and titles
+    std::string name;  // the full name, "" for a bare range
+    int addresses = 0;  // how many were typed
+    int top = 0, bottom = 0;  // the range; -1 for line 0
+    bool bang = false;
+    std::string arg;
+};
+
+struct editorConfig;
+
+// an entry of the command table: name can be cut short to least chars
+struct editorExCommandSpec {
+    const char* name;
+    size_t least;
+    int flags;
+    void (*run)(editorConfig& E, editorExCommand& ex);
+};
+
+// the commands or the patterns typed before; Up and Down go through the
+// ones starting with what was typed
+struct editorHistory {
+    std::vector<std::string> entries;  // the oldest first, each only once
+    size_t at = 0;      // the one recalled, entries.size() while typing
+    std::string typed;  // what there was before recalling any
+};
+
+struct editorRegister {
+    std::vector<std::string> text;  // one entry per line
+    bool linewise = false;
+    bool blockwise = false;  // lines go into successive rows at one column
+};
+
+// text typed at the top of a visual block is copied to the rows below it
+// when insert mode ends
+struct editorBlockInsert {
+    bool active = false;
+    int top = 0, bottom = 0;
+    int column = 0;   // rendered column the text goes in at
+    int x = 0;        // where typing started in the top row
+    int length = 0;   // the length of the top row before typing
+    bool append = false;  // rows shorter than the column get padded
+};
+
+struct editorRegexInst {
+    int op;
+    int x = 0, y = 0;
+    std::bitset<256> set;
+};
+
+struct editorDfaState {
+    std::vector<int> pcs;   // the threads alive, CHAR or pending line ends
+    bool match = false;     // a match has been seen on the way here
+    int match_at_end = -1;  // whether the row ending here completes one
+};
+
+// a compiled pattern; rows are checked with a DFA built lazily from the
+// program, and only matching rows run the program itself as a Pike VM to
+// find where the match is
+struct editorRegex {
+    std::vector<editorRegexInst> program;
+    int groups = 0;            // \( \) groups, not counting the whole match
+    bool literal = false;      // plain bytes, searched for as they are
+    std::string literal_text;
+    std::string prefix;        // what every match starts with
+    bool dfa_exact = true;     // no word boundaries, which need lookbehind
+                               // and so pass the DFA as if always there
+    std::bitset<256> first;    // the bytes a match can start with
+    bool first_usable = true;  // false when the match can be empty
+    std::array<int, 256> byte_class{};
+    int classes = 0;
+    std::vector<editorDfaState> states;
+    std::map<std::vector<int>, int> state_ids;
+    std::vector<int> transitions;  // by state and class, the next state
+                                   // times classes; -1 until needed and -2
+                                   // into a match
+    int start[2] = {-1, -1};       // the first state, away from or at column 0
+    int flushes = 0;
+    std::vector<unsigned> marks;
+    unsigned generation = 0;
+};
+
+// the rows matching one prefix of a pattern typed after / or ?, in the order
+// a search from the origin meets them
+struct editorSearchLevel {
+    std::string pattern;
+    std::shared_ptr<editorRegex> regex;
+    std::vector<int> hits;
+    size_t done = 0;         // how many rows from the origin are decided
+    size_t parent_hits = 0;  // hits of the shorter prefix checked so far
+};
+
+struct editorIncrementalSearch {
+    std::vector<editorSearchLevel> levels;  // the longest prefix last
+    int origin_y = 0, origin_x = 0;
+    int row_offset = 0, col_offset = 0;
+};
+
+// a list of places in the buffers or in other files, such as all matches of
+// a pattern, shown instead of the rows until one is picked
+struct editorListEntry {
+    int y = 0, x = 0;
+    int buffer = 0;    // by number, the buffer it is in; 0 for a file
+    int file = -1;     // index in files, or -1 for a buffer
+    std::string text;  // the start of the line, for other files
+};
+
+struct editorListView {
+    bool active = false;
+    std::string title;
+    std::vector<editorListEntry> entries;
+    std::vector<std::string> files;
+    size_t selected = 0;
+    size_t row_offset = 0;
+};
+
+// one line of a .gitignore or .ignore file
+struct editorIgnoreRule {
+    std::string glob;
+    bool negate = false;    // a ! rule, taking back what an earlier one ignored
+    bool dir_only = false;  // ended in /
+    bool anchored = false;  // matched against the path below the file's
+                            // directory rather than the name alone
+};
+
+// the ignore files of a directory, over those of the directories above
+struct editorIgnoreFile {
+    std::shared_ptr<const editorIgnoreFile> parent;
+    std::string base;   // the directory, as walked, ending in /
+    std::string above;  // for a file above the walk, the path from its
+                        // directory down to base
+    std::vector<editorIgnoreRule> rules;
+};
+
+// a directory :vimgrep has still to read
+struct editorWalkDir {
+    std::string path;
+    std::shared_ptr<const editorIgnoreFile> ignore;
+};
+
+// threads for work that splits into independent tasks, started on first use
+// and kept until exit
+struct editorWorkers {
+    std::vector<std::thread> threads;
+    std::deque<std::function<void()>> jobs;
+    std::mutex lock;
+    std::condition_variable wake;
+    bool stopping = false;
+    ~editorWorkers() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& thread : threads) thread.join();
+    }
+};
+
+// what :s makes of the rows of one chunk that it changes
+struct editorSubstituteChunk {
+    std::vector<int> changed;       // the rows, in order
+    std::vector<size_t> produced;   // how many rows each one became
+    std::vector<std::string> rows;  // all of those
+    size_t substitutions = 0;
+};
+
+// what :sort orders the rows of its range by, row i of the range being
+// row top + i of the buffer: the key is the whole row or the span a pattern
+// picked, compared by its first number or by its bytes
+struct editorSortKeys {
+    int top = 0;
+    bool numeric = false;
+    bool ignore_case = false;
+    bool reverse = false;  // keys go backwards, equal ones still in order
+    std::vector<std::pair<size_t, size_t>> spans;  // start and end, if picked
+};
+
+// an open file and what goes with it. E is the one being edited and the rest
+// wait in E.buffers: switching moves them in and out of E, which takes a few
+// pointers and keeps every row's render, highlight and match caches
+struct editorBuffer {
+    int number = 1;       // as :ls shows it, never reused
+    int cursor_x = 0;     // location in the file
+    int cursor_y = 0;     // location in the file
+    int row_offset = 0;   // number of rows to be offset - truncation, hence
+                          // works for both file and screen
+    int col_offset = 0;   // number of cols to be offset - works with rendered_x
+    bool dirty = false;   // whether we have made changes or not
+    std::vector<editorRow> rows;  // rows
+    std::string filename = "";
+    bool new_file = false;  // not on disk until it is written
+    int compression = COMPRESSION_NONE;  // format to recompress with on save
+    editorSyntax syntax;
+    editorHexView hex;  // replaces rows when viewing a binary file
+    editorUndoTree undo;
+    std::map<char, editorMark> marks;  // a to z, and < and >
+    int damage_top = INT_MAX;  // the rows edited since the windows were
+    int damage_bottom = -1;    // drawn, through damage_bottom; INT_MAX when
+                               // the rows below moved as well
+};
+
+// a view of a buffer on part of the screen. The current window's cursor and
+// offsets are E's own while it is current; every window keeps what it last
+// drew, so only those whose rows changed are drawn again
+struct editorWindow {
+    int buffer = 1;  // by number
+    int cursor_x = 0, cursor_y = 0;
+    int row_offset = 0, col_offset = 0;
+    int top = 0, left = 0;  // on screen, as laid out
+    int rows = 0, cols = 0;  // of text, with a status line below
+    bool edge = true;  // reaches the right of the screen, else a separator
+                       // column follows
+    int shown_buffer = 0;  // 0 until drawn
+    int shown_row_offset = 0, shown_col_offset = 0;
+    unsigned shown_highlight = 0;
+    bool shown_plain = false;  // with no list, hex view or selection, which
+                               // change with no row being edited
+};
+
+// the screen is cut into windows: a frame is one window, or frames side by
+// side when vertical and one above another when not
+struct editorFrame {
+    int window = -1;  // index in E.windows, for a frame of one window
+    bool vertical = false;
+    std::vector<editorFrame> children;
+};
+
+// what the front end lends an editor to draw on and read keys from. With
+// neither fd the editor is headless: nothing is drawn, no key interrupts
+// long work and the caller feeds keys to editorTypeKey itself
+struct editorTerminal {
+    int input_fd = -1;
+    int output_fd = -1;
+    std::function<void(bool)> raw_mode;  // off while :!cmd runs on it
+};
+
+struct editorConfig : editorBuffer {
+    int mode = NORMAL;    // mode in which the editor operates
+    int rendered_x = 0;   // taking into account rendering of characters, hence
+                          // location in the rendered row
+    int screen_rows = 0;  // total number of rows in the current window
+    int screen_cols = 0;  // total number of cols in the current window
+    int total_rows = 0;   // of the terminal, windows and command bar together
+    int total_cols = 0;
+    std::vector<editorWindow> windows = std::vector<editorWindow>(1);
+    size_t window = 0;    // the current one
+    editorFrame layout = editorFrame{0, false, {}};
+    bool redraw = true;   // every window is drawn at the next refresh
+    std::deque<editorBuffer> buffers = std::deque<editorBuffer>(1);
+    size_t buffer = 0;    // the one in E, its own slot left empty meanwhile
+    int last_number = 1;
+    bool compact_idle = false;  // buffers left drop their rows' caches
+    std::string command_bar = "";  // for command mode and alert messages
+    std::string normal_buf = "";
+    std::string command_buf = "";
+    char command_prompt = ':';  // / and ? read a search pattern instead
+    editorHistory history[2];   // of commands and of search patterns
+    std::string search_pattern = "";
+    bool search_forward = true;
+    std::string last_replacement = "";  // for ~ and a bare :s
+    bool global_busy = false;  // :g is running its command on its rows
+    bool expandtab = false;    // tabs are typed, and :retab puts, as spaces
+    bool hlsearch = false;         // matches of the last pattern are shown
+    bool hlsearch_hidden = false;  // until the next search, after :noh
+    std::string hlsearch_pattern;  // the pattern hlsearch_key stands for
+    unsigned hlsearch_key = 0;
+    editorIncrementalSearch incsearch;
+    std::unordered_map<std::string, std::shared_ptr<editorRegex>> regex_cache;
+    editorListView list;  // replaces rows while open
+    editorWorkers workers;
+    std::map<char, std::shared_ptr<editorRegister>> registers;
+    int visual_x = 0;  // the end of the selection the cursor is not at
+    int visual_y = 0;
+    editorBlockInsert block_insert;
+    editorTerminal terminal;
+    std::string cwd;  // relative names are taken from here, or from the
+                      // process's directory when empty
+    bool quit = false;  // :q was given, for the front end to act on
+    int error = 0;      // errno of the terminal read that failed, with quit
+};
+
+/** api */
+
+// everything an editor has is in its editorConfig, so editors can run side by
+// side, one to a thread. The front end lends it a terminal and a size, hands
+// it keys and has it refresh; it must ignore SIGPIPE for the (de)compressors
+bool editorOpen(editorConfig& E, const char* filename);
+bool editorEditFile(editorConfig& E, const std::string& path);
+bool editorLayout(editorConfig& E);
+void editorOnlyWindow(editorConfig& E);
+void editorSetStatusMessage(editorConfig& E, const char* fmt, ...);
+void editorRefreshScreen(editorConfig& E);
+int editorReadKey(editorConfig& E);
+void editorTypeKey(editorConfig& E, int c);
+void editorProcessKeypress(editorConfig& E);
+void editorExecuteCommand(editorConfig& E, const std::string& command);
+
+#endif
@@ -1,121 +1,33 @@
 /** includes */
 
 #include <fcntl.h>
+#include <poll.h>
 #include <signal.h>
 #include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 #include <termios.h>
 #include <unistd.h>
 
-#include <algorithm>
-#include <cctype>
 #include <cerrno>
-#include <cstdarg>
+#include <climits>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
-#include <string>
-#include <string_view>
 #include <tuple>
-#include <utility>
-#include <vector>
+
+#include "editor.h"
 
 /** defines */
 
-#define TAB_STOP 4
-#define QUIT_TIMES 3
-
-#define CTRL_KEY(k) ((k)&0b00011111)
-
-enum editorKey {
-    BACKSPACE = 127,
-    ARROW_LEFT = 1000,
-    ARROW_RIGHT,
-    ARROW_UP,
-    ARROW_DOWN,
-    PAGE_UP,
-    PAGE_DOWN,
-    HOME_KEY,
-    END_KEY,
-    DEL_KEY
-};
-
-enum editorHighlight {
-    HIGHLIGHT_NORMAL = 0,
-    HIGHLIGHT_KEYWORD1,
-    HIGHLIGHT_KEYWORD2,
-    HIGHLIGHT_COMMENT,
-    HIGHLIGHT_STRING,
-    HIGHLIGHT_NUMBER
-};
-
-#define HL_HIGHLIGHT_NUMBERS (1 << 0)
-#define HL_HIGHLIGHT_STRINGS (1 << 1)
-
-enum editorMode { NORMAL, COMMAND, INSERT };
+#define SERVER_START_MS 2000
 
 /** data */
 
-struct editorSyntax {
-    std::string filetype = "";
-    std::vector<std::string> filematch{};
-    std::vector<std::string> keywords{};
-    std::string singleline_comment_start = "";
-    int flags = 0;
-};
-
-struct editorRow {
-    std::string raw_row;
-    std::string rendered_row;
-    std::string highlight_row;
-    editorRow() : raw_row(), rendered_row(), highlight_row() {}
-    editorRow(const std::string& _raw_row, const std::string& _rendered_row,
-              const std::string& _highlight_row)
-        : raw_row(_raw_row),
-          rendered_row(_rendered_row),
-          highlight_row(_highlight_row) {}
-};
-
-struct editorConfig {
-    int mode = NORMAL;    // mode in which the editor operates
-    int cursor_x = 0;     // location in the file
-    int cursor_y = 0;     // location in the file
-    int rendered_x = 0;   // taking into account rendering of characters, hence
-                          // location in the rendered row
-    int screen_rows = 0;  // total number of rows on the screen
-    int screen_cols = 0;  // total number of cols on the screen
-    int row_offset = 0;   // number of rows to be offset - truncation, hence
-                          // works for both file and screen
-    int col_offset = 0;   // number of cols to be offset - works with rendered_x
-    bool dirty = false;   // whether we have made changes or not
-    std::vector<editorRow> rows;  // rows
-    std::string filename = "";
-    std::string command_bar = "";  // for command mode and alert messages
-    std::string normal_buf = "";
-    std::string command_buf = "";
-    editorSyntax syntax;
-    struct termios
-        original_termios;  // terminal information to be restored in the end
-};
-
 struct editorConfig E;
-
-/** filetypes */
-
-std::vector<std::string> C_HL_extensions = {".c", ".h", ".cpp"};
-std::vector<std::string> C_HL_keywords = {
-    "switch", "if",    "while",     "for",     "break",   "continue",
-    "return", "else",  "struct",    "union",   "typedef", "static",
-    "enum",   "class", "case",      "int|",    "long|",   "double|",
-    "float|", "char|", "unsigned|", "signed|", "void|"};
-
-std::vector<editorSyntax> HLDB = {
-    editorSyntax{"c", C_HL_extensions, C_HL_keywords, "//",
-                 HL_HIGHLIGHT_NUMBERS | HL_HIGHLIGHT_STRINGS},
-};
-
-/** prototypes */
-
-void editorSetStatusMessage(const char* fmt, ...);
+struct termios original_termios;  // to be restored in the end
+int server_fd = -1;  // the client's connection, told of resizes
 
 /** terminal */
 
@@ -126,89 +38,34 @@ void die(const char* s) {
     exit(1);
 }
 
+// also run at exit, so it can't exit itself
 void disableRawMode() {
-    std::ignore = write(STDOUT_FILENO, "\x1b[?1049l", 8);
-    if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &E.original_termios) == -1)
-        die("tcsetattr");
+    int in = E.terminal.input_fd, out = E.terminal.output_fd;
+    if (in == -1) return;
+    std::ignore = write(out, "\x1b[?1049l", 8);
+    tcsetattr(in, TCSAFLUSH, &original_termios);
 }
 
 void enableRawMode() {
-    if (tcgetattr(STDIN_FILENO, &E.original_termios) == -1) die("tcgetattr");
-    atexit(disableRawMode);
-    struct termios raw = E.original_termios;
+    static bool restored_at_exit = false;
+    int in = E.terminal.input_fd, out = E.terminal.output_fd;
+    if (tcgetattr(in, &original_termios) == -1) die("tcgetattr");
+    if (!restored_at_exit) atexit(disableRawMode);
+    restored_at_exit = true;
+    struct termios raw = original_termios;
     raw.c_iflag &= tcflag_t(~(BRKINT | ICRNL | INPCK | ISTRIP | IXON));
     raw.c_oflag &= tcflag_t(~(OPOST));
     raw.c_cflag |= tcflag_t((CS8));
     raw.c_lflag &= tcflag_t(~(ECHO | ICANON | IEXTEN | ISIG));
     raw.c_cc[VMIN] = 0;
     raw.c_cc[VTIME] = 1;
-    std::ignore = write(STDOUT_FILENO, "\x1b[?1049h", 8);
-    if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw) == -1) die("tcsetattr");
+    std::ignore = write(out, "\x1b[?1049h", 8);
+    if (tcsetattr(in, TCSAFLUSH, &raw) == -1) die("tcsetattr");
 }
 
-int editorReadKey() {
-    ssize_t nread;
-    char c;
-    while ((nread = read(STDIN_FILENO, &c, 1)) != 1)
-        if (nread == -1 && errno != EAGAIN) die("read");
-    if (c == '\x1b') {
-        char seq[3];
-        if (read(STDIN_FILENO, &seq[0], 1) != 1) return '\x1b';
-        if (read(STDIN_FILENO, &seq[1], 1) != 1) return '\x1b';
-        if (seq[0] == '[') {
-            if (seq[1] >= '0' && seq[1] <= '9') {
-                if (read(STDIN_FILENO, &seq[2], 1) != 1) return '\x1b';
-                if (seq[2] == '~') {
-                    switch (seq[1]) {
-                        case '1':
-                            return HOME_KEY;
-                        case '3':
-                            return DEL_KEY;
-                        case '4':
-                            return END_KEY;
-                        case '5':
-                            return PAGE_UP;
-                        case '6':
-                            return PAGE_DOWN;
-                        case '7':
-                            return HOME_KEY;
-                        case '8':
-                            return END_KEY;
-                    }
-                }
-            } else {
-                switch (seq[1]) {
-                    case 'A':
-                        return ARROW_UP;
-                    case 'B':
-                        return ARROW_DOWN;
-                    case 'C':
-                        return ARROW_RIGHT;
-                    case 'D':
-                        return ARROW_LEFT;
-                    case 'H':
-                        return HOME_KEY;
-                    case 'F':
-                        return END_KEY;
-                }
-            }
-        } else if (seq[0] == 'O') {
-            switch (seq[1]) {
-                case 'H':
-                    return HOME_KEY;
-                case 'F':
-                    return END_KEY;
-            }
-        }
-        return '\x1b';
-    } else {
-        return c;
-    }
-}
-
-int getWindowSize(int& rows, int& cols) {
+int getWindowSize(int fd, int& rows, int& cols) {
     struct winsize ws;
-    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == -1 || ws.ws_col == 0)
+    if (ioctl(fd, TIOCGWINSZ, &ws) == -1 || ws.ws_col == 0)
         return -1;
     else {
         cols = ws.ws_col;
@@ -217,621 +74,373 @@ int getWindowSize(int& rows, int& cols) {
     }
 }
 
-/** syntax highlighting */
-
-bool is_separator(char c) {
-    return isspace(c) || c == '\0' || strchr(",.()+-/*=~%<>[];", c) != NULL;
+void useTerminal(int input_fd, int output_fd) {
+    E.terminal.input_fd = input_fd;
+    E.terminal.output_fd = output_fd;
+    E.terminal.raw_mode = [](bool on) {
+        if (on)
+            enableRawMode();
+        else
+            disableRawMode();
+    };
+    enableRawMode();
 }
 
-void editorUpdateSyntax(editorRow& row) {
-    row.highlight_row = std::string(row.rendered_row.size(), HIGHLIGHT_NORMAL);
-    if (E.syntax.filetype == "") return;
-    const auto& keywords = E.syntax.keywords;
-    const auto& scs = E.syntax.singleline_comment_start;
-    size_t i = 0;
-    size_t len = row.rendered_row.size();
-    bool prev_sep = true;
-    char in_string = 0;
-    char prev_hl = HIGHLIGHT_NORMAL;
-    while (i < len) {
-        char c = row.rendered_row[i];
-        if (i > 0) prev_hl = row.highlight_row[i - 1];
-
-        if (scs.size() != 0 && !in_string) {
-            if (!strncmp(row.rendered_row.data() + i, scs.data(), scs.size())) {
-                memset(row.highlight_row.data() + i, HIGHLIGHT_COMMENT,
-                       len - i);
-                break;
-            }
-        }
-
-        if ((E.syntax.flags & HL_HIGHLIGHT_STRINGS) != 0) {
-            if (in_string) {
-                row.highlight_row[i] = HIGHLIGHT_STRING;
-                if (c == '\\' && i + 1 < row.rendered_row.size()) {
-                    row.highlight_row[i + 1] = HIGHLIGHT_STRING;
-                    i += 2;
-                    continue;
-                }
-                if (c == in_string) in_string = false;
-                i++;
-                prev_sep = 1;
-                continue;
-            } else {
-                if (c == '"' || c == '\'') {
-                    in_string = c;
-                    row.highlight_row[i] = HIGHLIGHT_STRING;
-                    i++;
-                    continue;
-                }
-            }
-        }
-
-        if ((E.syntax.flags & HL_HIGHLIGHT_NUMBERS) != 0) {
-            if ((isdigit(c) && (prev_sep || prev_hl == HIGHLIGHT_NUMBER)) ||
-                (c == '.' && prev_hl == HIGHLIGHT_NUMBER)) {
-                row.highlight_row[i] = HIGHLIGHT_NUMBER;
-                i++;
-                prev_sep = 0;
-                continue;
-            }
-        }
-
-        if (prev_sep) {
-            for (const auto& keyword : keywords) {
-                size_t klen = keyword.size();
-                bool kw2 = keyword[klen - 1] == '|';
-                if (kw2) klen--;
-                if (!strncmp(row.rendered_row.data() + i, keyword.data(),
-                             klen) &&
-                    is_separator(row.rendered_row[i + klen])) {
-                    memset(row.highlight_row.data() + i,
-                           kw2 ? HIGHLIGHT_KEYWORD2 : HIGHLIGHT_KEYWORD1, klen);
-                    i += klen;
-                    break;
-                }
-            }
-            prev_sep = 0;
-            continue;
-        }
+/** init */
 
-        prev_sep = is_separator(c);
-        i++;
-    }
+bool resizeEditor() {
+    int& rows = E.total_rows;
+    int& cols = E.total_cols;
+    if (getWindowSize(E.terminal.output_fd, rows, cols) == -1) return false;
+    if (!editorLayout(E)) editorOnlyWindow(E);
+    return true;
 }
 
-int editorSyntaxToColor(int x) {
-    switch (x) {
-        case HIGHLIGHT_COMMENT:
-            return 90;
-        case HIGHLIGHT_KEYWORD1:
-            return 94;  // 33;
-        case HIGHLIGHT_KEYWORD2:
-            return 91;  // 32;
-        case HIGHLIGHT_NUMBER:
-            return 36;  // 31;
-        case HIGHLIGHT_STRING:
-            return 36;  // 35;
-        default:
-            return 37;
-    }
+void initEditor() {
+    if (!resizeEditor()) die("getWindowSize");
 }
 
-void editorSelectSyntaxHighlight() {
-    if (E.filename == "") return;
-    char* ext = strrchr(E.filename.data(), '.');
-    for (unsigned int j = 0; j < HLDB.size(); j++) {
-        editorSyntax* s = &HLDB[j];
-        unsigned int i = 0;
-        while (i < s->filematch.size()) {
-            int is_ext = (s->filematch[i][0] == '.');
-            if ((is_ext && ext && !strcmp(ext, s->filematch[i].c_str())) ||
-                (!is_ext &&
-                 strstr(E.filename.c_str(), s->filematch[i].c_str()))) {
-                E.syntax = *s;
-                for (auto& row : E.rows) editorUpdateSyntax(row);
-                return;
-            }
-            i++;
-        }
+void handleSIGWINCH(int t = 0) {
+    std::ignore = t;
+    initEditor();
+    editorRefreshScreen(E);
+}
+
+void setSignalHandler() {
+    signal(SIGWINCH, handleSIGWINCH);
+    signal(SIGPIPE, SIG_IGN);  // a dying (de)compressor shows up as EPIPE
+}
+
+/** server */
+
+// vin --daemon keeps one editor, and so every buffer with its caches, alive
+// between sessions. vin --remote hands it the fds of its terminal over a
+// socket; the server then reads keys and draws on that terminal itself, only
+// what changed, until :q detaches the client and leaves the buffers loaded
+// as they are. After that first message the socket only carries bytes: w
+// from the client when its terminal is resized, and the server's last word,
+// d when detached, b when busy with another client or n for a terminal it
+// can't use
+
+// the socket sits in a directory only this user can get into, so nobody
+// else can put one there first; "" when that directory isn't private
+std::string serverSocketPath() {
+    const char* runtime = getenv("XDG_RUNTIME_DIR");
+    std::string dir = runtime && *runtime
+                          ? std::string(runtime) + "/vin"
+                          : "/tmp/vin-" + std::to_string(getuid());
+    mkdir(dir.c_str(), 0700);
+    struct stat st;
+    if (lstat(dir.c_str(), &st) == -1 || !S_ISDIR(st.st_mode) ||
+        st.st_uid != getuid() || (st.st_mode & 077) != 0)
+        return "";
+    return dir + "/socket";
+}
+
+bool serverAddress(struct sockaddr_un& addr) {
+    std::string path = serverSocketPath();
+    addr = {};
+    addr.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(addr.sun_path)) return false;
+    strcpy(addr.sun_path, path.c_str());
+    return true;
+}
+
+// whether the other end of the socket runs as this user
+bool samePeerUser(int fd) {
+    struct ucred cred;
+    socklen_t size = sizeof(cred);
+    return getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &size) == 0 &&
+           cred.uid == getuid();
+}
+
+int connectServer() {
+    struct sockaddr_un addr;
+    if (!serverAddress(addr)) return -1;
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd == -1) return -1;
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
+        close(fd);
+        return -1;
     }
-}
-
-/** row operations */
-
-void editorUpdateRow(editorRow& row) {
-    row.rendered_row = "";
-    for (auto c : row.raw_row)
-        if (c == '\t') {
-            row.rendered_row += ' ';
-            while (row.rendered_row.size() % TAB_STOP != 0)
-                row.rendered_row += ' ';
-        } else
-            row.rendered_row += c;
-    editorUpdateSyntax(row);
-}
-
-void editorInsertRow(int at, const std::string& s) {
-    if (at < 0 || at > (int)E.rows.size()) return;
-    E.rows.insert(E.rows.begin() + at, {s, "", ""});
-    editorUpdateRow(*(E.rows.begin() + at));
-    E.dirty = true;
-}
-
-void editorRowInsertChar(editorRow& row, int at, int c) {
-    auto& s = row.raw_row;
-    if (at < 0 || at > (int)s.size()) at = (int)s.size();
-    s.insert(s.begin() + at, (char)c);
-    editorUpdateRow(row);
-    E.dirty = true;
-}
-
-void editorRowDelChar(editorRow& row, int at) {
-    auto& s = row.raw_row;
-    if (at <= 0 || at > (int)s.size()) return;
-    s.erase(s.begin() + at - 1);
-    editorUpdateRow(row);
-    E.dirty = true;
-}
-
-void editorRowAppendString(editorRow& row, const std::string& to_append) {
-    row.raw_row += to_append;
-    editorUpdateRow(row);
-    E.dirty = true;
-}
-
-int editorComputeRenderedX(const std::string& s, int cursor_x) {
-    int rendered_x = 0;
-    for (auto c : std::string_view(s.data(), size_t(cursor_x)))
-        if (c == '\t')
-            rendered_x += TAB_STOP - rendered_x % TAB_STOP;
-        else
-            rendered_x++;
-    return rendered_x;
-}
-
-/** editor operations */
-
-void editorInsertChar(int c) {
-    if (E.cursor_y == (int)E.rows.size())
-        editorInsertRow((int)E.rows.size(), "");
-    editorRowInsertChar(E.rows[size_t(E.cursor_y)], E.cursor_x, c);
-    E.cursor_x++;
-}
-
-void editorInsertNewline() {
-    if (E.cursor_x == 0) {
-        editorInsertRow(E.cursor_y, "");
-    } else {
-        editorInsertRow(
-            E.cursor_y + 1,
-            E.rows[size_t(E.cursor_y)].raw_row.substr(size_t(E.cursor_x)));
-        E.rows[size_t(E.cursor_y)].raw_row =
-            E.rows[size_t(E.cursor_y)].raw_row.substr(size_t(0),
-                                                      size_t(E.cursor_x));
-        editorUpdateRow(E.rows[size_t(E.cursor_y)]);
+    if (!samePeerUser(fd)) {
+        close(fd);
+        errno = EACCES;
+        return -1;
     }
-    E.cursor_x = 0;
-    E.cursor_y++;
-}
-
-void editorDelRow(int at) {
-    if (at < 0 || at >= (int)E.rows.size()) return;
-    E.rows.erase(E.rows.begin() + at);
-    E.dirty = true;
-}
-
-void editorDelChar() {
-    if (E.cursor_y == (int)E.rows.size()) return;
-    if (E.cursor_x == 0 && E.cursor_y == 0) return;
-    if (E.cursor_x == 0) {
-        E.cursor_x = (int)E.rows[size_t(E.cursor_y - 1)].raw_row.size();
-        editorRowAppendString(E.rows[size_t(E.cursor_y - 1)],
-                              E.rows[size_t(E.cursor_y)].raw_row);
-        editorDelRow(E.cursor_y);
-        E.cursor_y--;
-    } else {
-        editorRowDelChar(E.rows[size_t(E.cursor_y)], E.cursor_x);
-        E.cursor_x--;
+    return fd;
+}
+
+// the socket to serve on, or -1 when another server has it
+int listenServer() {
+    struct sockaddr_un addr;
+    if (!serverAddress(addr)) return -1;
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd == -1) return -1;
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
+        // a socket no server answers on is left from one that was killed
+        int other = errno == EADDRINUSE ? connectServer() : -1;
+        if (other != -1 || errno != ECONNREFUSED ||
+            unlink(addr.sun_path) == -1 ||
+            bind(fd, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
+            if (other != -1) close(other);
+            close(fd);
+            return -1;
+        }
     }
-}
-
-/** file i/o */
-
-void editorOpen(char* filename) {
-    E.filename = filename;
-    editorSelectSyntaxHighlight();
-    FILE* fp = fopen(filename, "r");
-    if (!fp) die("fopen");
-    char* line = NULL;
-    size_t linecap = 0;
-    ssize_t linelen;
-    while ((linelen = getline(&line, &linecap, fp)) != -1) {
-        while (linelen > 0 &&
-               (line[linelen - 1] == '\n' || line[linelen - 1] == '\r'))
-            linelen--;
-        editorInsertRow((int)E.rows.size(),
-                        std::string(line).substr(0, size_t(linelen)));
+    if (listen(fd, 4) == -1) {
+        close(fd);
+        return -1;
     }
-    free(line);
-    fclose(fp);
-    E.dirty = false;
-}
-
-std::string editorRowsToString() {
-    std::string representation = "";
-    for (const auto& s : E.rows) representation += s.raw_row + '\n';
-    return representation;
-}
-
-void editorSave() {
-    if (E.filename == "") return;
-    std::string representation = editorRowsToString();
-    int len = (int)representation.size();
-    const char* buf = representation.c_str();
-    int fd = open(E.filename.c_str(), O_RDWR | O_CREAT, 0644);
-    if (fd != -1) {
-        if (ftruncate(fd, len) != -1) {
-            if (write(fd, buf, size_t(len)) == len) {
+    return fd;
+}
+
+// takes a client's terminal and the file it asked for; false if the
+// request is malformed
+bool attachClient(int client) {
+    char data[2 * PATH_MAX + 2];
+    char control[CMSG_SPACE(2 * sizeof(int))];
+    struct iovec iov = {data, sizeof(data) - 1};
+    struct msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    ssize_t size = recvmsg(client, &msg, MSG_CMSG_CLOEXEC);
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    if (size <= 0 || !cmsg || cmsg->cmsg_type != SCM_RIGHTS ||
+        cmsg->cmsg_len != CMSG_LEN(2 * sizeof(int))) {
+        // whatever descriptors did arrive are ours now
+        for (; cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (cmsg->cmsg_level != SOL_SOCKET ||
+                cmsg->cmsg_type != SCM_RIGHTS)
+                continue;
+            size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            for (size_t i = 0; i < count; i++) {
+                int fd;
+                memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(fd));
                 close(fd);
-                editorSetStatusMessage("%d bytes written to disk", len);
-                E.dirty = false;
-                return;
             }
         }
-        close(fd);
+        return false;
     }
-    editorSetStatusMessage("Can't save! I/O error: %s", strerror(errno));
-}
-
-void editorExecuteCommand() {
-    if (E.command_buf == "q") {
-        if (E.dirty) {
-            editorSetStatusMessage(
-                "File has unsaved changes. Use :q! to force quit");
-            return;
-        }
-        std::ignore = write(STDOUT_FILENO, "\x1b[2J", 4);
-        std::ignore = write(STDOUT_FILENO, "\x1b[H", 3);
-        exit(0);
-    } else if (E.command_buf == "q!") {
-        std::ignore = write(STDOUT_FILENO, "\x1b[2J", 4);
-        std::ignore = write(STDOUT_FILENO, "\x1b[H", 3);
-        exit(0);
-    } else if (E.command_buf == "w") {
-        editorSave();
-    } else {
-        editorSetStatusMessage("Unsupported command: %s", E.command_buf.data());
+    int fds[2], rows, cols;
+    memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+    // the client's directory, then the file, each ending in a NUL
+    data[size] = '\0';
+    std::string cwd = data;
+    std::string filename = data + std::min(cwd.size() + 1, size_t(size));
+    if (cwd[0] != '/' || !isatty(fds[0]) ||
+        getWindowSize(fds[1], rows, cols) == -1) {
+        close(fds[0]);
+        close(fds[1]);
+        return false;
     }
-}
-
-/** input */
-
-void editorMoveCursor(int c) {
-    bool not_on_last = size_t(E.cursor_y) < E.rows.size();
-    switch (c) {
-        case ARROW_LEFT:
-        case 'h':
-            if (E.cursor_x > 0)
-                E.cursor_x--;
-            else if (E.cursor_y > 0) {  // to go to end of previous line
-                E.cursor_y--;
-                E.cursor_x = (int)E.rows[size_t(E.cursor_y)].raw_row.size();
-            }
-            break;
-        case ARROW_RIGHT:
-        case 'l':
-            // to not allow overflowing past the end (one past the end allowed)
-            if (not_on_last &&
-                size_t(E.cursor_x) < E.rows[size_t(E.cursor_y)].raw_row.size())
-                E.cursor_x++;
-            // to allow going to the next line with a right movement
-            else if (not_on_last &&
-                     size_t(E.cursor_x) ==
-                         E.rows[size_t(E.cursor_y)].raw_row.size()) {
-                E.cursor_y++;
-                E.cursor_x = 0;
-            }
-            break;
-        case ARROW_DOWN:
-        case 'j':
-            if (E.cursor_y < (int)E.rows.size()) E.cursor_y++;
-            break;
-        case ARROW_UP:
-        case 'k':
-            if (E.cursor_y > 0) E.cursor_y--;
-            break;
+    useTerminal(fds[0], fds[1]);
+    E.cwd = cwd;
+    resizeEditor();
+    E.redraw = true;
+    if (!filename.empty())
+        editorEditFile(E, filename);
+    else
+        editorSetStatusMessage(E, "Use :q to detach, the buffers stay");
+    return true;
+}
+
+// hands the terminal back as it was, unless it is gone already
+void detachClient(bool hung_up) {
+    if (!hung_up) {
+        int out = E.terminal.output_fd;
+        std::ignore = write(out, "\x1b[2J", 4);
+        std::ignore = write(out, "\x1b[H", 3);
+        disableRawMode();
     }
-    // snap to end - done in terms of cursor_x, not rendered_x
-    int row_len = (size_t(E.cursor_y) >= E.rows.size()
-                       ? 0
-                       : (int)E.rows[size_t(E.cursor_y)].raw_row.size());
-    if (E.cursor_x > row_len) E.cursor_x = row_len;
-}
-
-void editorProcessKeypress() {
-    int c = editorReadKey();
-    if (E.mode == INSERT) {
-        switch (c) {
-            case '\x1b':
-                E.mode = NORMAL;
-                break;
-            case '\r':
-                editorInsertNewline();
-                break;
-            case HOME_KEY:
-                E.cursor_x = 0;
-                break;
-            case END_KEY:
-                if (E.cursor_y < (int)E.rows.size())
-                    E.cursor_x = (int)E.rows[size_t(E.cursor_y)].raw_row.size();
-                break;
-            case BACKSPACE:
-            case CTRL_KEY('h'):
-            case DEL_KEY:
-                if (c == DEL_KEY) editorMoveCursor(ARROW_RIGHT);
-                editorDelChar();
-                break;
-            case PAGE_UP:
-            case PAGE_DOWN: {
-                if (c == PAGE_UP) {
-                    E.cursor_y = E.row_offset;
-                } else if (c == PAGE_DOWN) {
-                    E.cursor_y = E.row_offset + E.screen_rows - 1;
-                    if (E.cursor_y > (int)E.rows.size())
-                        E.cursor_y = (int)E.rows.size();
-                }
-                int times = E.screen_rows;
-                while (times--)
-                    editorMoveCursor(c == PAGE_UP ? ARROW_UP : ARROW_DOWN);
-            } break;
-            case ARROW_LEFT:
-            case ARROW_DOWN:
-            case ARROW_UP:
-            case ARROW_RIGHT:
-                editorMoveCursor(c);
-                break;
-            case CTRL_KEY('l'):
-                break;
-            default:
-                editorInsertChar(c);
-                break;
-        }
-    } else if (E.mode == NORMAL) {
-        if (E.normal_buf.empty()) {
-            switch (c) {
-                case 'i':
-                    E.normal_buf = "";
-                    E.mode = INSERT;
-                    break;
-                case ':':
-                    E.normal_buf = "";
-                    E.mode = COMMAND;
-                    editorSetStatusMessage(":");
-                    break;
-                case '\x1b':
-                    E.mode = NORMAL;
-                    break;
-                case '\r':
-                    editorMoveCursor(ARROW_DOWN);
-                case HOME_KEY:
-                case '0':
-                    E.cursor_x = 0;
-                    break;
-                case END_KEY:
-                case '$':
-                    if (E.cursor_y < (int)E.rows.size())
-                        E.cursor_x =
-                            (int)E.rows[size_t(E.cursor_y)].raw_row.size();
-                    break;
-                case BACKSPACE:
-                case CTRL_KEY('h'):
-                    editorMoveCursor(ARROW_LEFT);
-                    break;
-                case PAGE_UP:
-                case PAGE_DOWN: {
-                    if (c == PAGE_UP) {
-                        E.cursor_y = E.row_offset;
-                    } else if (c == PAGE_DOWN) {
-                        E.cursor_y = E.row_offset + E.screen_rows - 1;
-                        if (E.cursor_y > (int)E.rows.size())
-                            E.cursor_y = (int)E.rows.size();
-                    }
-                    int times = E.screen_rows;
-                    while (times--)
-                        editorMoveCursor(c == PAGE_UP ? ARROW_UP : ARROW_DOWN);
-                } break;
-                case ARROW_LEFT:
-                case ARROW_DOWN:
-                case ARROW_UP:
-                case ARROW_RIGHT:
-                case 'h':
-                case 'j':
-                case 'k':
-                case 'l':
-                    editorMoveCursor(c);
-                    break;
-                case CTRL_KEY('l'):
-                    break;
-                case 'G':
-                    while (E.cursor_y != (int)E.rows.size())
-                        editorMoveCursor(ARROW_DOWN);
-            }
-        } else {
-            switch (c) {
-                case BACKSPACE:
-                    E.normal_buf.pop_back();
-                    break;
+    close(E.terminal.input_fd);
+    close(E.terminal.output_fd);
+    E.terminal = editorTerminal();
+    E.quit = false;
+    E.error = 0;
+}
+
+// edits on the client's terminal until :q, the client going away or its
+// terminal hanging up; another client trying to attach is turned away,
+// once a :!cmd running on the terminal is done
+void serveClient(int listen_fd, int client) {
+    bool hung_up = false;
+    while (!E.quit) {
+        editorRefreshScreen(E);
+        struct pollfd fds[3] = {{E.terminal.input_fd, POLLIN, 0},
+                                {client, POLLIN, 0},
+                                {listen_fd, POLLIN, 0}};
+        if (poll(fds, 3, -1) == -1) continue;
+        if (fds[2].revents) {
+            int other = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+            if (other != -1) {
+                if (samePeerUser(other)) std::ignore = write(other, "b", 1);
+                close(other);
             }
         }
-    } else if (E.mode == COMMAND) {
-        switch (c) {
-            case '\r':
-                editorExecuteCommand();
-                E.command_buf = "";
-                E.mode = NORMAL;
-                break;
-            case '\x1b':
-                E.command_buf = "";
-                E.mode = NORMAL;
-                editorSetStatusMessage("");
-                break;
-            case BACKSPACE:
-                if (!E.command_buf.empty())
-                    E.command_buf.pop_back(),
-                        editorSetStatusMessage((":" + E.command_buf).data());
-                else
-                    E.mode = NORMAL, editorSetStatusMessage("");
-                break;
-            default:
-                E.command_buf.push_back((char)c);
-                editorSetStatusMessage((":" + E.command_buf).data());
-                break;
+        if (fds[1].revents) {
+            char c;
+            if (read(client, &c, 1) != 1) break;
+            if (c == 'w') resizeEditor();
+            continue;
+        }
+        if (fds[0].revents & (POLLHUP | POLLERR)) {
+            hung_up = true;
+            break;
         }
+        if (fds[0].revents & POLLIN) editorProcessKeypress(E);
+        hung_up = E.error != 0;
     }
-}
-
-/** output */
-
-void editorScroll() {
-    E.rendered_x = 0;
-    if (E.cursor_y < (int)E.rows.size())
-        E.rendered_x = editorComputeRenderedX(
-            E.rows[size_t(E.cursor_y)].raw_row, E.cursor_x);
-    if (E.cursor_y < E.row_offset) E.row_offset = E.cursor_y;
-    if (E.cursor_y >= E.row_offset + E.screen_rows)
-        E.row_offset = E.cursor_y - E.screen_rows + 1;
-    if (E.rendered_x < E.col_offset) E.col_offset = E.rendered_x;
-    if (E.rendered_x >= E.col_offset + E.screen_cols)
-        E.col_offset = E.rendered_x - E.screen_cols + 1;
-}
-
-void editorDrawRows(std::string& s) {
-    for (int y = 0; y < E.screen_rows; y++) {
-        int row_number = E.row_offset + y;
-        if (row_number >= (int)E.rows.size())
-            s += '~';
-        else {
-            int len = (int)E.rows[size_t(row_number)].rendered_row.size() -
-                      E.col_offset;
-            len = std::clamp(len, 0, E.screen_cols);
-            const char* c =
-                E.rows[size_t(row_number)].rendered_row.c_str() + E.col_offset;
-            const char* hl =
-                E.rows[size_t(row_number)].highlight_row.c_str() + E.col_offset;
-            int current_color = -1;
-            for (int j = 0; j < len; ++j) {
-                if (hl[j] == HIGHLIGHT_NORMAL) {
-                    if (current_color != -1) {
-                        s += "\x1b[39m";
-                        current_color = -1;
-                    }
-                } else {
-                    int color = editorSyntaxToColor(hl[j]);
-                    if (color != current_color) {
-                        current_color = color;
-                        char buf[16];
-                        std::ignore =
-                            snprintf(buf, sizeof(buf), "\x1b[%dm", color);
-                        s += buf;
-                    }
-                }
-                s += c[j];
-            }
-            s += "\x1b[39m";
+    detachClient(hung_up);
+    std::ignore = write(client, "d", 1);
+}
+
+void runServer(int listen_fd) {
+    signal(SIGPIPE, SIG_IGN);
+    while (true) {
+        int client = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (client == -1) continue;
+        // another user's client doesn't get to drive this editor
+        if (samePeerUser(client)) {
+            if (attachClient(client))
+                serveClient(listen_fd, client);
+            else
+                std::ignore = write(client, "n", 1);
         }
-        s += "\x1b[K";  // to clear a single line
-        s += "\r\n";
+        close(client);
     }
 }
 
-void editorDrawStatusBar(std::string& s) {
-    s += "\x1b[7m";
-    std::string display_name =
-        (E.filename.size() == 0 ? "[No Name]" : E.filename);
-    std::string display_status =
-        display_name.substr(size_t(0),
-                            std::min(display_name.size(), size_t(20))) +
-        " - " + std::to_string(E.rows.size()) + " lines" + " " +
-        (E.dirty ? "(modified)" : "");
-    display_status += " [";
-    switch (E.mode) {
-        case NORMAL:
-            display_status += "NORMAL";
-            break;
-        case INSERT:
-            display_status += "INSERT";
-            break;
-        case COMMAND:
-            display_status += "COMMAND";
-            break;
+// starts a server in the background, detached from this terminal; false
+// if one is running already
+bool startServer() {
+    int listen_fd = listenServer();
+    if (listen_fd == -1) return false;
+    pid_t pid = fork();
+    if (pid == -1) die("fork");
+    if (pid > 0) {
+        close(listen_fd);
+        return true;
     }
-    display_status += "] ";
-    s += display_status;
-    display_status = display_status.substr(
-        size_t(0), std::min(display_status.size(), size_t(E.screen_cols)));
-    s += std::string(size_t(E.screen_cols) - display_status.size(), ' ');
-    auto line_number = std::to_string(E.cursor_y);
-    for (int i = 0; i < (int)line_number.size(); ++i) s.pop_back();
-    s += line_number;
-    s += "\x1b[m";
-    s += "\r\n";
+    setsid();
+    int null_fd = open("/dev/null", O_RDWR);
+    for (int fd : {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO})
+        dup2(null_fd, fd);
+    if (null_fd > STDERR_FILENO) close(null_fd);
+    runServer(listen_fd);
+    _exit(0);
 }
 
-void editorDrawCommandBar(std::string& s) {
-    s += "\x1b[K";
-    s += E.command_bar;
-}
-
-void editorRefreshScreen() {
-    editorScroll();
-    std::string s = "";
-    s += "\x1b[?25l";  // to hide the cursor
-    // s += "\x1b[2J";    // to clear the screen
-    s += "\x1b[H";  // to go to the top left
-    editorDrawRows(s);
-    editorDrawStatusBar(s);
-    editorDrawCommandBar(s);
-    s += "\x1b[" + std::to_string(E.cursor_y - E.row_offset + 1) + ";" +
-         std::to_string(E.rendered_x - E.col_offset + 1) + "H";
-    // to go to a specified position
-    s += "\x1b[?25h";  // to show the cursor again
-    std::ignore = write(STDOUT_FILENO, s.c_str(), s.size());
-}
+/** client */
 
-void editorSetStatusMessage(const char* fmt, ...) {
-    va_list ap;
-    va_start(ap, fmt);
-    char buf[80];
-    vsnprintf(buf, sizeof(buf), fmt, ap);
-    va_end(ap);
-    E.command_bar = buf;
-}
-
-/** init */
-
-void initEditor() {
-    if (getWindowSize(E.screen_rows, E.screen_cols) == -1) die("getWindowSize");
-    E.screen_rows -= 2;
-}
-
-void handleSIGWINCH(int t = 0) {
+void handleClientSIGWINCH(int t) {
     std::ignore = t;
-    initEditor();
-    editorRefreshScreen();
+    std::ignore = send(server_fd, "w", 1, MSG_NOSIGNAL);
 }
 
-void setSignalHandler() { signal(SIGWINCH, handleSIGWINCH); }
+// attaches this terminal to the server, starting one if none runs, and
+// waits until it is handed back
+int runClient(const char* filename) {
+    if (!isatty(STDIN_FILENO) || !isatty(STDOUT_FILENO)) {
+        fprintf(stderr, "vin: --remote needs a terminal\n");
+        return 1;
+    }
+    std::string path = serverSocketPath();
+    if (path.empty()) {
+        fprintf(stderr, "vin: no private directory for the socket\n");
+        return 1;
+    }
+    server_fd = connectServer();
+    if (server_fd == -1) {
+        startServer();
+        for (int waited = 0; server_fd == -1 && waited < SERVER_START_MS;
+             waited += 10) {
+            usleep(10000);
+            server_fd = connectServer();
+        }
+    }
+    if (server_fd == -1) {
+        fprintf(stderr, "vin: can't reach the server at %s\n", path.c_str());
+        return 1;
+    }
+    char cwd[PATH_MAX];
+    if (!getcwd(cwd, sizeof(cwd))) die("getcwd");
+    std::string data = cwd;
+    data += '\0';
+    if (filename) {
+        // the server may be somewhere else by the time it saves
+        if (filename[0] != '/') data += std::string(cwd) + "/";
+        data += filename;
+    }
+    data += '\0';
+    int fds[2] = {STDIN_FILENO, STDOUT_FILENO};
+    char control[CMSG_SPACE(sizeof(fds))] = {};
+    struct iovec iov = {&data[0], data.size()};
+    struct msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+    // in case the server dies with the terminal raw
+    if (tcgetattr(STDIN_FILENO, &original_termios) == -1) die("tcgetattr");
+    signal(SIGWINCH, handleClientSIGWINCH);
+    // the server reads them as keys, but while :!cmd has the terminal
+    // cooked they would be signals for this client
+    signal(SIGINT, SIG_IGN);
+    signal(SIGQUIT, SIG_IGN);
+    // a busy server has answered and hung up before this arrives
+    std::ignore = sendmsg(server_fd, &msg, MSG_NOSIGNAL);
+    char reply = 0;
+    ssize_t nread;
+    while ((nread = read(server_fd, &reply, 1)) == -1 && errno == EINTR) {}
+    if (nread == 1 && reply == 'b') {
+        fprintf(stderr, "vin: the server has a client already\n");
+        return 1;
+    }
+    if (nread == 1 && reply == 'n') {
+        fprintf(stderr, "vin: the server can't use this terminal\n");
+        return 1;
+    }
+    if (nread == 1 && reply == 'd') return 0;
+    std::ignore = write(STDOUT_FILENO, "\x1b[?1049l", 8);
+    tcsetattr(STDIN_FILENO, TCSAFLUSH, &original_termios);
+    fprintf(stderr, "vin: lost the server\n");
+    return 1;
+}
 
 int main(int argc, char** argv) {
-    enableRawMode();
+    if (argc >= 2 && strcmp(argv[1], "--daemon") == 0) {
+        std::string path = serverSocketPath();
+        if (path.empty())
+            fprintf(stderr, "vin: no private directory for the socket\n");
+        else if (startServer())
+            return 0;
+        else
+            fprintf(stderr, "vin: can't serve on %s, is a server running?\n",
+                    path.c_str());
+        return 1;
+    }
+    if (argc >= 2 && strcmp(argv[1], "--remote") == 0)
+        return runClient(argc >= 3 ? argv[2] : NULL);
+    useTerminal(STDIN_FILENO, STDOUT_FILENO);
     initEditor();
     setSignalHandler();
-    if (argc >= 2) editorOpen(argv[1]);
-    editorSetStatusMessage("Use :q to quit, :w to save");
-    while (1) {
-        editorRefreshScreen();
-        editorProcessKeypress();
+    if (argc >= 2) editorOpen(E, argv[1]);
+    editorSetStatusMessage(E, "Use :q to quit, :w to save");
+    while (!E.quit) {
+        editorRefreshScreen(E);
+        editorProcessKeypress(E);
     }
+    errno = E.error;
+    if (errno != 0) die("read");
+    std::ignore = write(STDOUT_FILENO, "\x1b[2J", 4);
+    std::ignore = write(STDOUT_FILENO, "\x1b[H", 3);
     return 0;
 }